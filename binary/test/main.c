@@ -10,6 +10,7 @@
 #include <time.h>
 #include <taskscan.h>
 #include <math.h>
+#include <ioctl.h>
 
 char test[4096];
 
@@ -420,8 +421,109 @@ void float_test()
     printf("ln 10=%f\n", ln(10));
 }
 
+/* 和内核的HZ保持一致，用来把ticks换算成秒 */
+#define BENCH_HZ        500
+
+/* 每种大小至少测试的ticks数 */
+#define BENCH_TICKS     (BENCH_HZ / 5)
+
+static char bench_src[65536 + 16];
+static char bench_dst[65536 + 16];
+
+/**
+ * bench_report - 运行一项测试并输出速度
+ * @name: 测试名字
+ * @size: 每次操作的字节数
+ * @which: 0是memcpy，1是memset，2是memcmp
+ */
+void bench_report(const char *name, int size, int which)
+{
+    unsigned int loops = 0;
+    unsigned int start, ticks;
+    
+    /* 等到tick边界，减少计时误差 */
+    start = time(NULL);
+    while (time(NULL) == start);
+    start = time(NULL);
+
+    do {
+        int i;
+        for (i = 0; i < 64; i++) {
+            if (which == 0)
+                memcpy(bench_dst, bench_src, size);
+            else if (which == 1)
+                memset(bench_dst, i, size);
+            else
+                memcmp(bench_dst, bench_src, size);
+        }
+        loops += 64;
+        ticks = time(NULL) - start;
+    } while (ticks < BENCH_TICKS);
+    
+    /* 以KB为单位计算，避免溢出，size都是2的幂 */
+    unsigned int kb;
+    if (size >= 1024)
+        kb = loops * (size / 1024);
+    else
+        kb = loops / (1024 / size);
+    printf("%s %6d bytes: %6d MB/s\n", name, size, kb * BENCH_HZ / ticks / 1024);
+}
+
+void memops_bench()
+{
+    printf("memory operations benchmark\n");
+
+    memset(bench_src, 0x5a, sizeof(bench_src));
+    memset(bench_dst, 0x5a, sizeof(bench_dst));
+
+    int size;
+    for (size = 16; size <= 65536; size *= 4) {
+        bench_report("memcpy", size, 0);
+        bench_report("memset", size, 1);
+        /* memcmp比较相同的数据才能测到完整的长度 */
+        memcpy(bench_dst, bench_src, size);
+        bench_report("memcmp", size, 2);
+    }
+}
+
+/**
+ * readahead_test - 顺序读取文件，输出用时和预读统计
+ * @path: 文件路径
+ */
+void readahead_test(const char *path)
+{
+    static char rabuf[4096];
+    struct rastat stat;
+    unsigned int start, total = 0;
+    int fd, n;
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        printf("open %s failed!\n", path);
+        return;
+    }
+    start = time(NULL);
+    while ((n = read(fd, rabuf, sizeof(rabuf))) > 0)
+        total += n;
+    
+    printf("read %s %d bytes in %d ticks\n", path, total, time(NULL) - start);
+    if (!ioctl(fd, FILE_IOCTL_RASTAT, (int)&stat)) {
+        printf("readahead: %d blocks, %d hits, window %d\n",
+            stat.ra_reads, stat.ra_hits, stat.ra_window);
+    }
+    /* 缓存的命中统计输出在内核的控制台上 */
+    ioctl(fd, FILE_IOCTL_FSSTAT, 0);
+    close(fd);
+}
+
 int main(int argc, char *argv[])
 {
+    if (argc > 1)
+        readahead_test(argv[1]);
+    
+    memops_bench();
+    return 0;
+
     float_test();
     return 0;
 
@@ -585,7 +687,7 @@ int main(int argc, char *argv[])
 
 	//memory_state();
 	
-	char *maped = mmap(0, 4096, 0, 0);
+	char *maped = mmap(0, 4096, PROT_READ|PROT_WRITE, 0, -1, 0);
 
 	if(maped == (void *)-1) {
 		printf("mmap failed!\n");
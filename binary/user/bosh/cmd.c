@@ -275,10 +275,29 @@ int cmd_kill(uint32_t argc, char** argv)
 	return 0;
 }
 
+/**
+ * print_memcache - 打印内核内存缓存的使用情况
+ */
+static void print_memcache()
+{
+    memcache_status_t ms;
+    int idx = 0;
+    printf("    SIZE  OBJSIZE   OBJECTS     TOTAL  GROUPS   PAGES     WASTE NAME\n");
+    while (!memcachescan(&ms, &idx)) {
+        printf("%8d %8d %9d %9d %7d %7d %9d %s\n", ms.mc_size, ms.mc_objsize,
+            ms.mc_objects, ms.mc_total, ms.mc_groups, ms.mc_pages, ms.mc_waste, 
+            ms.mc_name);
+    }
+}
+
 void cmd_free(uint32_t argc, char** argv)
 {
     if (argc > 1) {
-        printf("free: no arguments support!\n");
+        if (argc == 2 && !strcmp(argv[1], "-c")) {
+            print_memcache();
+            return;
+        }
+        printf("free: only -c argument support!\n");
         return;
     }
     meminfo_t mi;
@@ -837,7 +856,7 @@ void cmd_help(uint32_t argc, char** argv)
 	printf("  ls          list files in current dirctory.\n");
 	printf("  lsdisk      list disk drives.\n");
 	printf("  mkdir       create a dir.\n");
-	printf("  free        print memory info.\n");
+	printf("  free        print memory info, -c print kernel mem caches.\n");
 	printf("  mv          move a file.\n");
 	printf("  ps          print tasks.\n");
 	printf("  pwd         print work directory.\n");
@@ -894,16 +913,17 @@ int cmd_ps(uint32_t argc, char** argv)
         }
     }
 
-    printf("   PID   PPID     STAT    PRO        TICKS NAME\n");
+    printf("   PID   PPID     STAT    PRO        TICKS     WAIT  MAXWAIT   SWITCH NAME\n");
     while (!taskscan(&ts, &num)) {
         /* 如果没有全部标志，就只显示用户进程。也就是ppid不为-1的进程 */
         if (!all) {
             if (ts.ts_ppid == -1)
                 continue;
         }
-        printf("%6d %6d %8s %6d %12d %s\n", 
+        printf("%6d %6d %8s %6d %12d %8d %8d %8d %s\n", 
             ts.ts_pid, ts.ts_ppid, task_status[ts.ts_state], ts.ts_priority,
-            ts.ts_runticks, ts.ts_name);
+            ts.ts_runticks, ts.ts_waitticks, ts.ts_maxwait, ts.ts_switches,
+            ts.ts_name);
     }
     return 0;
 	/*if(argc != 1){
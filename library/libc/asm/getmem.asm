@@ -20,3 +20,19 @@ getmem:
 	int INT_VECTOR_SYS_CALL
 	pop ebx
 	ret
+
+global memcachescan
+
+; int memcachescan(memcache_status_t *ms, int *idx);
+memcachescan:
+	push ebx
+    push ecx
+
+    mov eax, SYS_MEMCACHESCAN
+	mov ebx, [esp + 8 + 4]
+    mov ecx, [esp + 8 + 4 * 2]
+	int INT_VECTOR_SYS_CALL
+
+    pop ecx
+	pop ebx
+	ret
@@ -12,16 +12,19 @@
 
 global mmap
 
-; int mmap(uint32_t addr, uint32_t len, uint32_t prot, uint32_t flags);
+; void *mmap(uint32_t addr, uint32_t len, uint32_t prot, uint32_t flags, int fd, uint32_t offset);
+; 第5个参数通过edx传递，第6个参数通过ebp传递
 mmap:
-	
+	push ebp
 
 	mov eax, SYS_MMAP
-	mov ebx, [esp + 4]
-	mov ecx, [esp + 8]
-	mov esi, [esp + 12]
-	mov edi, [esp + 16]
+	mov ebx, [esp + 8]
+	mov ecx, [esp + 12]
+	mov esi, [esp + 16]
+	mov edi, [esp + 20]
+	mov edx, [esp + 24]
+	mov ebp, [esp + 28]
 	int INT_VECTOR_SYS_CALL
 	
-	
-	ret
\ No newline at end of file
+	pop ebp
+	ret
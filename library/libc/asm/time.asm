@@ -24,6 +24,39 @@ alarm:
 	pop ebx
 	ret
 
+global getitimer
+; int getitimer(int which, struct itimerval *value);
+getitimer:
+	push ebx
+	push ecx
+
+	mov eax, SYS_GETITIMER
+	mov ebx, [esp + 4 + 8]
+	mov ecx, [esp + 8 + 8]
+	int INT_VECTOR_SYS_CALL
+	
+	pop ecx
+	pop ebx
+	ret
+
+global setitimer
+; int setitimer(int which, const struct itimerval *value, struct itimerval *ovalue);
+setitimer:
+	push ebx
+	push ecx
+	push esi
+
+	mov eax, SYS_SETITIMER
+	mov ebx, [esp + 4 + 12]
+	mov ecx, [esp + 8 + 12]
+	mov esi, [esp + 12 + 12]
+	int INT_VECTOR_SYS_CALL
+	
+	pop esi
+	pop ecx
+	pop ebx
+	ret
+
 global time
 ; unsigned int time(struct tm *tm);
 time:
@@ -0,0 +1,32 @@
+/*
+ * file:		alarm.c
+ * auther:		Jason Hu
+ * time:		2020/4/20
+ * copyright:	(C) 2018-2020 by Book OS developers. All rights reserved.
+ */
+
+#include <unistd.h>
+#include <stddef.h>
+#include <time.h>
+
+/**
+ * ualarm - 设置微秒级的闹钟
+ * @usecs: 微秒数，为0就取消闹钟
+ * @interval: 周期微秒数，为0时只触发一次
+ * 
+ * 返回上次闹钟剩余的微秒数
+ */
+unsigned int ualarm(unsigned int usecs, unsigned int interval)
+{
+    struct itimerval value, ovalue;
+
+    value.it_value.tv_sec = usecs / 1000000;
+    value.it_value.tv_usec = usecs % 1000000;
+    value.it_interval.tv_sec = interval / 1000000;
+    value.it_interval.tv_usec = interval % 1000000;
+
+    if (setitimer(ITIMER_REAL, &value, &ovalue) < 0)
+        return -1;
+    
+    return ovalue.it_value.tv_sec * 1000000 + ovalue.it_value.tv_usec;
+}
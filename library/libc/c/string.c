@@ -67,9 +67,30 @@ int atoi(const char *src)
     return s * (is_minus ? -1 : 1);
 }
 
+/*
+ * 内存操作先按字节对齐目标地址，然后用rep movsl/stosl按4字节处理，
+ * 最后处理剩下不足4字节的部分。数据很少的时候直接按字节处理。
+ */
+#define MEM_WORD_MIN	16
+
 void *memset(void* src, uint8_t value, uint32_t size) 
 {
 	uint8_t* s = (uint8_t*)src;
+	uint32_t d0, d1;
+	
+	if (size >= MEM_WORD_MIN) {
+		uint32_t head = (-(uint32_t)s) & 3;
+		size -= head;
+		while (head--)
+			*s++ = value;
+		
+		__asm__ __volatile__ ("rep stosl"
+			: "=&c" (d0), "=&D" (d1)
+			: "a" (value * 0x01010101U), "0" (size >> 2), "1" (s)
+			: "memory");
+		s = (uint8_t*)d1;
+		size &= 3;
+	}
 	while (size > 0){
 		*s++ = value;
 		--size;
@@ -79,19 +100,21 @@ void *memset(void* src, uint8_t value, uint32_t size)
 
 void *memset16(void* src, uint16_t value, uint32_t size) 
 {
-	uint16_t* s = (uint16_t*)src;
-	while (size-- > 0){
-		*s++ = value;
-	}
+	uint32_t d0, d1;
+	__asm__ __volatile__ ("rep stosw"
+		: "=&c" (d0), "=&D" (d1)
+		: "a" (value), "0" (size), "1" (src)
+		: "memory");
 	return src;
 }
 
 void *memset32(void* src, uint32_t value, uint32_t size) 
 {
-	uint32_t* s = (uint32_t*)src;
-	while (size-- > 0){
-		*s++ = value;
-	}
+	uint32_t d0, d1;
+	__asm__ __volatile__ ("rep stosl"
+		: "=&c" (d0), "=&D" (d1)
+		: "a" (value), "0" (size), "1" (src)
+		: "memory");
 	return src;
 }
 
@@ -99,6 +122,22 @@ void memcpy(void* dst_, const void* src_, uint32_t size) {
  
    uint8_t* dst = dst_;
    const uint8_t* src = src_;
+   uint32_t d0, d1, d2;
+
+   if (size >= MEM_WORD_MIN) {
+      uint32_t head = (-(uint32_t)dst) & 3;
+      size -= head;
+      while (head--)
+         *dst++ = *src++;
+
+      __asm__ __volatile__ ("rep movsl"
+         : "=&c" (d0), "=&D" (d1), "=&S" (d2)
+         : "0" (size >> 2), "1" (dst), "2" (src)
+         : "memory");
+      dst = (uint8_t*)d1;
+      src = (const uint8_t*)d2;
+      size &= 3;
+   }
    while (size-- > 0)
       *dst++ = *src++;
 }
@@ -151,8 +190,14 @@ int memcmp(const void * s1, const void *s2, int n)
 
 	const char * p1 = (const char *)s1;
 	const char * p2 = (const char *)s2;
-	int i;
-	for (i = 0; i < n; i++,p1++,p2++) {
+	int i = 0;
+	/* 先按4字节比较，找到不同的字之后再逐个字节比较 */
+	while (i + 4 <= n && *(const uint32_t *)p1 == *(const uint32_t *)p2) {
+		i += 4;
+		p1 += 4;
+		p2 += 4;
+	}
+	for (; i < n; i++,p1++,p2++) {
 		if (*p1 != *p2) {
 			return (*p1 - *p2);
 		}
@@ -20,7 +20,36 @@ typedef struct meminfo {
 
 void getmem(meminfo_t *mi);
 
-void *mmap(uint32_t addr, uint32_t len, uint32_t prot, uint32_t flags);
+/* 内存缓存信息 */
+typedef struct memcache_status {
+    char mc_name[24];           /* cache的名字 */
+    unsigned long mc_size;      /* 要求的对象大小 */
+    unsigned long mc_objsize;   /* 对齐后每个对象占用的大小 */
+    unsigned long mc_objects;   /* 正在使用的对象数量 */
+    unsigned long mc_total;     /* 所有group中的对象数量 */
+    unsigned long mc_groups;    /* group数量 */
+    unsigned long mc_pages;     /* 占用的页数 */
+    unsigned long mc_waste;     /* 占用的内存中不能存放对象数据的字节数 */
+} memcache_status_t;
+
+int memcachescan(memcache_status_t *ms, int *idx);
+
+/* 页保护 */
+#define PROT_NONE        0x0       /* 页不能访问 */
+#define PROT_READ        0x1       /* 页可以读取 */
+#define PROT_WRITE       0x2       /* 页可以写入 */
+#define PROT_EXEC        0x4       /* 页可以执行 */
+
+/* 映射标志 */
+#define MAP_FIXED        0x10      /* 使用传入的地址 */
+#define MAP_SHARED       0x20      /* 修改写回文件，和其它映射共享 */
+#define MAP_PRIVATE      0x40      /* 修改只对自己可见 */
+
+/* 映射失败的返回值 */
+#define MAP_FAILED       ((void *)-1)
+
+/* fd为-1时是匿名映射，offset需要页对齐 */
+void *mmap(uint32_t addr, uint32_t len, uint32_t prot, uint32_t flags, int fd, uint32_t offset);
 int munmap(uint32_t addr, uint32_t len);
 
 #endif  /* _LIB_MMAN_H */
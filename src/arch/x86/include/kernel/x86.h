@@ -24,9 +24,11 @@ void LoadTR(uint32_t tr);
 int32_t ReadCR0(void );
 int32_t ReadCR3(void );
 uint32_t ReadCR2(void );
+uint32_t ReadCR4(void );
 
 void WriteCR0(uint32_t address);
 void WriteCR3(uint32_t address);
+void WriteCR4(uint32_t value);
 void StoreGDTR(uint32_t gdtr);
 void LoadGDTR(uint32_t limit, uint32_t addr);
 void StoreIDTR(uint32_t idtr);
@@ -75,6 +77,19 @@ STATIC INLINE unsigned int __Xchg(unsigned int x,
     return old;
 }
 
+/* CR0的写保护位，置1后内核写只读页也会产生页故障 */
+#define CR0_WP  0x00010000
+
+/* CR4的FXSAVE/SSE支持位，置1后才能使用SSE指令 */
+#define CR4_OSFXSR  0x00000200
+
+/* CPUID(1)返回的edx中的特性位 */
+#define CPUID_EDX_MMX   (1 << 23)
+#define CPUID_EDX_FXSR  (1 << 24)
+#define CPUID_EDX_SSE   (1 << 25)
+
+void InitFastMemcpy(uint32_t features);
+
 /* x86特性 */
 #define X86_FEATURE_XMM2 (0*32+26) /* Streaming SIMD Extensions-2 */
 
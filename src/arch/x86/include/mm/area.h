@@ -11,32 +11,37 @@
 #include "page.h"
 #include <book/list.h>
 #include <book/bitmap.h>
-#include <share/stdint.h>
+#include <lib/stdint.h>
 
-/* 一共有10个order，0~9 */
-#define MAX_ORDER 10
+/* 一共有11个order，0~10 */
+#define MAX_ORDER 11
 
 /*
-在buddy内存管理系统中，我们需要保证最大的页数是512的倍数，
-为什么呢？因为order 9的area的页数量是512，我们在对它进行
-拆分和合并的时候，所有的页都需要从它里面分割出去。回收的
-时候也是回收到它里面，所以，整个页数对齐后，就可以完美进行
-分配和回收了。当所有页都回收之后，不会出现存在位于其它order
-的页。这样也可以保证获取index的时候不会出错。不然就会越界。
+在buddy内存管理系统中，每一个order的块的页数量是2^order，
+块的起始页索引也必须和2^order对齐，这样才能通过 index ^ (1 << order)
+找到伙伴块。最大的order的页的数量是1024，也就是4MB，这也是kmalloc
+能分配的最大内存。
 */
 /* 最大的order的页的数量 */
-#define MAX_ORDER_PAGE_NR 512
+#define MAX_ORDER_PAGE_NR (1 << (MAX_ORDER - 1))
 
-/* 最大的order的页的数量 */
+/* 最大的order的内存大小 */
 #define MAX_ORDER_MEM_SIZE (MAX_ORDER_PAGE_NR*PAGE_SIZE)
 
 /* 空闲区域结构 */
 struct FreeArea {
-    struct List pageList;
-    struct Bitmap map;  /* 记录当前area中的页的使用状态 */
+    struct List freeList;       /* 空闲块链表，链接的是块的第一个内存节点 */
+    unsigned int freeBlocks;    /* 空闲块的数量 */
 };
 
-
-
+/* 
+ * 内存区域，管理一段连续的内存节点，伙伴只会在区域内部合并
+ */
+struct MemZone {
+    unsigned int startIndex;    /* 区域的第一个节点的索引 */
+    unsigned int endIndex;      /* 区域结束节点的索引（不包含） */
+    unsigned int freePages;     /* 空闲页的数量 */
+    struct FreeArea freeArea[MAX_ORDER];
+};
 
 #endif  /*_X86_MM_AREA_H*/
@@ -46,6 +46,9 @@ typedef unsigned int pte_t;
 #define	 PAGE_US_S  	0	// 0000 U/S system level, cpl0,1,2
 #define	 PAGE_US_U  	4	// 0100 U/S user level, cpl3
 
+/* 页表项中留给软件使用的位，标记写时复制的页 */
+#define	 PAGE_COW  	0x200
+
 #define PAGE_SHIFT 12
 
 #define PAGE_SIZE (1U<<PAGE_SHIFT)  
@@ -154,6 +157,10 @@ PUBLIC unsigned int AllocPages(unsigned int count);
 PUBLIC int FreePages(unsigned int page);
 #define FreePage(page) FreePages(page)
 
+PUBLIC int HoldPages(unsigned int page);
+#define HoldPage(page) HoldPages(page)
+PUBLIC int PagesReference(unsigned int page);
+
 PUBLIC int PageTableAdd(unsigned int virtualAddr,
 		unsigned int physicAddr,
         unsigned int protect);
@@ -169,5 +176,10 @@ PUBLIC int MapPagesMaybeMapped(unsigned int start,
     unsigned int npages, 
     unsigned int protect);
 
+PUBLIC void FreeUserPageTables(pde_t *pgdir);
+PUBLIC int SharePagesCopyOnWrite(pde_t *pgdir, unsigned int start, unsigned int end,
+        char shared);
+PUBLIC void InitCopyOnWrite();
+
 
 #endif  /*_X86_MM_PAGE_H */
@@ -59,9 +59,14 @@ struct MemNode {
     unsigned int reference;     /* 引用次数 */
     struct MemCache *memCache;  /* 内存缓冲 */
     struct MemGroup *group;     /* 内存组 */
+    struct List list;           /* 空闲时链接到伙伴系统的空闲链表 */
+    unsigned int order;         /* 空闲块的order */
 };
 #define SIZEOF_MEM_NODE sizeof(struct MemNode) 
 
+/* 内存节点标志 */
+#define MEM_NODE_FREE       0x01    /* 节点是伙伴系统中一个空闲块的第一个节点 */
+
 /* 转换成物理地址 */
 #define __PA(x) ((unsigned long)(x) - PAGE_OFFSET)
 /* 转换成虚拟地址 */ 
@@ -90,7 +95,8 @@ PUBLIC void *Phy2Vir(unsigned long address);
 PUBLIC struct MemNode *Page2MemNode(unsigned int page);
 PUBLIC unsigned int MemNode2Page(struct MemNode *node);
 
-PUBLIC struct MemNode *GetFreeMemNode();
+PUBLIC struct MemNode *AllocMemNodes(unsigned int count);
+PUBLIC void FreeMemNodes(struct MemNode *node);
 
 PUBLIC unsigned int GetPhysicMemoryFreeSize();
 PUBLIC unsigned int GetPhysicMemoryTotalSize();
@@ -0,0 +1,145 @@
+/*
+ * file:		arch/x86/kernel/core/memcpy.c
+ * auther:		Jason Hu
+ * time:		2020/4/20
+ * copyright:	(C) 2018-2020 by Book OS developers. All rights reserved.
+ */
+
+#include <kernel/x86.h>
+#include <kernel/interrupt.h>
+#include <lib/types.h>
+#include <lib/stddef.h>
+#include <lib/string.h>
+
+/*
+ * 大块内存复制的加速，根据cpu特性选择SSE或者MMX。
+ * 任务切换时不会保存浮点和SIMD寄存器，所以复制的时候要关闭中断，
+ * 并且保存和恢复使用到的寄存器，避免破坏用户态的数据。
+ */
+
+/**
+ * MemcpyMmx - 使用MMX复制内存
+ * @dst: 目标地址
+ * @src: 源地址
+ * @size: 字节数
+ */
+PRIVATE void MemcpyMmx(void *dst, const void *src, uint32_t size)
+{
+    uint8_t *d = dst;
+    const uint8_t *s = src;
+    /* fnsave需要108字节 */
+    uint8_t fpuState[108] __attribute__((aligned(16)));
+    uint32_t blocks = size >> 6;
+
+    unsigned long flags = InterruptSave();
+
+    /* 保存浮点状态，MMX寄存器和浮点寄存器是共用的 */
+    __asm__ __volatile__ ("fnsave %0" : "=m" (fpuState) : : "memory");
+
+    while (blocks--) {
+        __asm__ __volatile__ (
+            "movq 0(%0), %%mm0\n\t"
+            "movq 8(%0), %%mm1\n\t"
+            "movq 16(%0), %%mm2\n\t"
+            "movq 24(%0), %%mm3\n\t"
+            "movq 32(%0), %%mm4\n\t"
+            "movq 40(%0), %%mm5\n\t"
+            "movq 48(%0), %%mm6\n\t"
+            "movq 56(%0), %%mm7\n\t"
+            "movq %%mm0, 0(%1)\n\t"
+            "movq %%mm1, 8(%1)\n\t"
+            "movq %%mm2, 16(%1)\n\t"
+            "movq %%mm3, 24(%1)\n\t"
+            "movq %%mm4, 32(%1)\n\t"
+            "movq %%mm5, 40(%1)\n\t"
+            "movq %%mm6, 48(%1)\n\t"
+            "movq %%mm7, 56(%1)\n\t"
+            : : "r" (s), "r" (d) : "memory");
+        s += 64;
+        d += 64;
+    }
+
+    /* 恢复浮点状态，同时也退出了MMX状态 */
+    __asm__ __volatile__ ("frstor %0" : : "m" (fpuState) : "memory");
+
+    InterruptRestore(flags);
+
+    /* 剩下不足64字节的部分 */
+    memcpy(d, s, size & 63);
+}
+
+/**
+ * MemcpySse - 使用SSE复制内存
+ * @dst: 目标地址
+ * @src: 源地址
+ * @size: 字节数
+ */
+PRIVATE void MemcpySse(void *dst, const void *src, uint32_t size)
+{
+    uint8_t *d = dst;
+    const uint8_t *s = src;
+    /* 内核栈只保证4字节对齐，aligned属性不会让gcc对齐栈，所以保存和恢复用不对齐的movups */
+    uint8_t xmmState[64];
+    uint32_t blocks;
+
+    /* 先把目标地址对齐到16字节，后面就可以用对齐的写入 */
+    uint32_t head = (-(uint32_t)d) & 15;
+    memcpy(d, s, head);
+    d += head;
+    s += head;
+    size -= head;
+    blocks = size >> 6;
+
+    unsigned long flags = InterruptSave();
+
+    /* 保存用到的xmm寄存器 */
+    __asm__ __volatile__ (
+        "movups %%xmm0, 0(%0)\n\t"
+        "movups %%xmm1, 16(%0)\n\t"
+        "movups %%xmm2, 32(%0)\n\t"
+        "movups %%xmm3, 48(%0)\n\t"
+        : : "r" (xmmState) : "memory");
+
+    while (blocks--) {
+        __asm__ __volatile__ (
+            "movups 0(%0), %%xmm0\n\t"
+            "movups 16(%0), %%xmm1\n\t"
+            "movups 32(%0), %%xmm2\n\t"
+            "movups 48(%0), %%xmm3\n\t"
+            "movaps %%xmm0, 0(%1)\n\t"
+            "movaps %%xmm1, 16(%1)\n\t"
+            "movaps %%xmm2, 32(%1)\n\t"
+            "movaps %%xmm3, 48(%1)\n\t"
+            : : "r" (s), "r" (d) : "memory");
+        s += 64;
+        d += 64;
+    }
+
+    /* 恢复xmm寄存器 */
+    __asm__ __volatile__ (
+        "movups 0(%0), %%xmm0\n\t"
+        "movups 16(%0), %%xmm1\n\t"
+        "movups 32(%0), %%xmm2\n\t"
+        "movups 48(%0), %%xmm3\n\t"
+        : : "r" (xmmState) : "memory");
+
+    InterruptRestore(flags);
+
+    /* 剩下不足64字节的部分 */
+    memcpy(d, s, size & 63);
+}
+
+/**
+ * InitFastMemcpy - 根据cpu特性选择大块内存复制的方法
+ * @features: CPUID(1)返回的edx
+ */
+void InitFastMemcpy(uint32_t features)
+{
+    if ((features & CPUID_EDX_SSE) && (features & CPUID_EDX_FXSR)) {
+        /* 打开SSE支持 */
+        WriteCR4(ReadCR4() | CR4_OSFXSR);
+        memcpyLarge = MemcpySse;
+    } else if (features & CPUID_EDX_MMX) {
+        memcpyLarge = MemcpyMmx;
+    }
+}
@@ -22,6 +22,8 @@ global	ReadCR3
 global	WriteCR3
 global	ReadCR0
 global	WriteCR0
+global	ReadCR4
+global	WriteCR4
 global	StoreGDTR
 global	LoadGDTR
 global	StoreIDTR
@@ -105,6 +107,15 @@ WriteCR0:
 	mov eax,[esp+4]
 	mov cr0,eax
 	ret	
+
+ReadCR4:
+	mov eax,cr4
+	ret
+
+WriteCR4:
+	mov eax,[esp+4]
+	mov cr4,eax
+	ret
 	
 StoreGDTR:
 	mov eax, [esp + 4]
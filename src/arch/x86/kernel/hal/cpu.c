@@ -25,6 +25,7 @@ PRIVATE struct Private {
 	unsigned int stepping;	//频率
 	unsigned int maxCpuid;	
 	unsigned int  maxCpuidExt;
+	unsigned int features;	//CPUID(1)的edx，cpu特性
 	char *familyString;
 	char *modelString;
 
@@ -266,6 +267,13 @@ PRIVATE void CpuHalInit()
 		}
 	}
 
+	/* 获取cpu特性，根据特性选择内存复制的方法 */
+	if (private.maxCpuid >= 1) {
+		X86Cpuid(0x00000001, &eax, &ebx, &ecx, &edx);
+		private.features = edx;
+	}
+	InitFastMemcpy(private.features);
+
 	//默认指向vendor
 	private.steerString = private.vendor;
 	//默认是string
@@ -13,18 +13,13 @@
 #include <book/vmspace.h>
 #include <book/task.h>
 #include <book/signal.h>
+#include <book/vmarea.h>
 #include <lib/stdint.h>
 #include <lib/string.h>
 #include <lib/math.h>
 #include <mm/page.h>
 #include <mm/phymem.h>
 
-EXTERN struct MemNode *memNodeTable;
-/* 节点数量 */
-EXTERN unsigned int memNodeCount;
-EXTERN unsigned int memNodeBase;
-
-
 PUBLIC unsigned long Vir2Phy(void *address)
 {
     return __PA(address);
@@ -35,18 +30,18 @@ PUBLIC void *Phy2Vir(unsigned long address)
     return __VA(address);
 }
 
+/**
+ * AllocPages - 分配连续的物理页
+ * @count: 页的数量
+ * 
+ * 从伙伴系统中分配，成功返回物理页地址，失败返回0
+ */
 PUBLIC unsigned int AllocPages(unsigned int count)
 {
-    struct MemNode *node = GetFreeMemNode();
+    struct MemNode *node = AllocMemNodes(count);
     if (node == NULL)
         return 0;
     
-    int index = node - memNodeTable;
-
-    /* 如果分配的页数超过范围 */
-    if (index + count > memNodeCount)
-        return 0; 
-
     /* 第一次分配的时候设置引用为1 */
     node->reference = 1;
     node->count = count;
@@ -57,6 +52,16 @@ PUBLIC unsigned int AllocPages(unsigned int count)
     return MemNode2Page(node);
 }
 
+/* 写时复制时用来临时映射新页的内核虚拟地址 */
+PRIVATE unsigned int copyWindow;
+
+/**
+ * FreePages - 释放物理页
+ * @page: AllocPages返回的物理页地址
+ * 
+ * 把分配时的所有页都还给伙伴系统。
+ * 如果页被多个进程共享（写时复制），只减少引用次数
+ */
 int FreePages(unsigned int page)
 {
     struct MemNode *node = Page2MemNode(page);
@@ -64,17 +69,54 @@ int FreePages(unsigned int page)
     if (node == NULL)
         return -1;
     
-	if (node->reference) {
+    unsigned long flags = InterruptSave();
+	if (node->reference > 1) {
+		node->reference--;
+	} else if (node->reference) {
 		node->reference = 0;
-		node->count = 0;
-		node->flags = 0;
 		node->memCache = NULL;
 		node->group = NULL;
+		
+		FreeMemNodes(node);
 		//printk("free page at %x\n", page);
 	}
+    InterruptRestore(flags);
     return 0;
 }
 
+/**
+ * HoldPages - 增加物理页的引用
+ * @page: AllocPages返回的物理页地址
+ * 
+ * 页被多个地方使用时（比如页缓存和进程的映射），每个使用者持有一个引用，
+ * 使用完后用FreePages释放
+ */
+PUBLIC int HoldPages(unsigned int page)
+{
+    struct MemNode *node = Page2MemNode(page);
+
+    if (node == NULL)
+        return -1;
+    
+    unsigned long flags = InterruptSave();
+    node->reference++;
+    InterruptRestore(flags);
+    return 0;
+}
+
+/**
+ * PagesReference - 获取物理页的引用次数
+ * @page: AllocPages返回的物理页地址
+ */
+PUBLIC int PagesReference(unsigned int page)
+{
+    struct MemNode *node = Page2MemNode(page);
+
+    if (node == NULL)
+        return 0;
+    return node->reference;
+}
+
 /*
  * PageTableAdd - 物理地址和虚拟地址链接起来
  * @virtualAddr: 虚拟地址
@@ -109,6 +151,16 @@ PUBLIC int PageTableAdd(unsigned int virtualAddr,
 	return 0;
 }
 
+/**
+ * MapPages - 映射虚拟地址到物理页
+ * @start: 开始地址
+ * @len: 长度
+ * @protect: 页保护属性
+ * 
+ * 伙伴系统中连续的页有最大限制，所以这里逐个分配物理页，
+ * 物理页之间不一定是连续的。
+ * 成功返回0，失败返回-1
+ */
 PUBLIC int MapPages(unsigned int start,
     unsigned int len, 
     unsigned int protect)
@@ -116,34 +168,34 @@ PUBLIC int MapPages(unsigned int start,
     // 长度和页对齐
     len = PAGE_ALIGN(len);
 
-	/* 判断长度是否超过剩余内存大小 */
-    
-    //printk("len %d pages %d\n", len, len / PAGE_SIZE);
-
-	/* 分配物理页 */
-	unsigned int paddr = AllocPages(len / PAGE_SIZE);
-
-	if (!paddr) {
-        printk("map pages get bad bpages!\n");
-        return -1;
-    }
-	
-	//printk("map pages:%x->%x len %x\n", start, paddr, len);
-	
+    unsigned int vaddr = start;
     unsigned int end = start + len;
+    unsigned int paddr;
 
-	while (start < end)
+	while (vaddr < end)
 	{
-        //printk("map pages:%x->%x\n", start, paddr);
+		/* 分配物理页 */
+		paddr = AllocPage();
+		if (!paddr) {
+			printk("map pages get bad bpages!\n");
+			goto ToUnmap;
+		}
+		
 		// 对单个页进行链接
-		PageTableAdd(start, paddr, protect);
-		//fill_vir_page_talbe(start, paddr, protect);
+		if (PageTableAdd(vaddr, paddr, protect)) {
+			FreePage(paddr);
+			goto ToUnmap;
+		}
 		
-		start += PAGE_SIZE;
-        paddr += PAGE_SIZE;
+		vaddr += PAGE_SIZE;
 	}
 
 	return 0;
+ToUnmap:
+	/* 把已经映射的页取消 */
+	if (vaddr > start)
+		UnmapPages(start, vaddr - start);
+	return -1;
 }
 
 /**
@@ -201,6 +253,83 @@ PUBLIC int MapPagesMaybeMapped(unsigned int start,
     return 0;
 }
 
+/**
+ * SharePagesCopyOnWrite - 把当前页目录中的页以写时复制的方式共享给另一个页目录
+ * @pgdir: 要共享到的页目录
+ * @start: 开始地址
+ * @end: 结束地址
+ * @shared: 共享映射的空间，可写的页保持可写，两边写入的是同一个页
+ * 
+ * 不复制页的数据，只复制页表项。可写的页在两边都变成只读并且打上写时复制标志，
+ * 物理页的引用次数增加，写的时候才在页故障中复制。
+ * 成功返回0，失败返回-1
+ */
+PUBLIC int SharePagesCopyOnWrite(pde_t *pgdir, unsigned int start, unsigned int end,
+        char shared)
+{
+	unsigned int vaddr = start & PAGE_MASK;
+	pde_t *pde, *childPde;
+	pte_t *pte, *childTable;
+	struct MemNode *node;
+
+	while (vaddr < end) {
+		pde = PageGetPde(vaddr);
+		/* 页表不存在，跳到下一个页表管理的地址 */
+		if (!(*pde & PAGE_P_1)) {
+			vaddr = (vaddr & 0xffc00000) + PAGE_SIZE * PAGE_ENTRY_NR;
+			continue;
+		}
+		pte = PageGetPte(vaddr);
+		if (*pte & PAGE_P_1) {
+			/* 子页目录中没有页表就创建一个 */
+			childPde = pgdir + PDE_IDX(vaddr);
+			if (!(*childPde & PAGE_P_1)) {
+				/* 和PageTableAdd一样，页表直接从页分配器分配 */
+				unsigned int tableAddr = AllocPage();
+				if (!tableAddr) {
+					printk(PART_ERROR "SharePagesCopyOnWrite: alloc page for page table failed!\n");
+					return -1;
+				}
+				memset(Phy2Vir(tableAddr), 0, PAGE_SIZE);
+				*childPde = tableAddr | PAGE_US_U | PAGE_RW_W | PAGE_P_1;
+			}
+			childTable = Phy2Vir(*childPde & PAGE_ADDR_MASK);
+
+			/* 可写的页变成只读的写时复制页 */
+			if (!shared && (*pte & PAGE_RW_W)) {
+				*pte = (*pte & ~PAGE_RW_W) | PAGE_COW;
+				X86Invlpg(vaddr);
+			}
+
+			node = Page2MemNode(*pte & PAGE_ADDR_MASK);
+			if (node != NULL)
+				node->reference++;
+			
+			childTable[PTE_IDX(vaddr)] = *pte;
+		}
+		vaddr += PAGE_SIZE;
+	}
+	return 0;
+}
+
+/**
+ * FreeUserPageTables - 释放页目录中用户空间的页表
+ * @pgdir: 页目录
+ * 
+ * 用户空间的页表都是用AllocPage分配的，页表中映射的页要已经取消映射，
+ * 内核空间的页表是所有页目录共享的，不能释放
+ */
+PUBLIC void FreeUserPageTables(pde_t *pgdir)
+{
+	unsigned int i;
+	for (i = 0; i < PDE_IDX(PAGE_OFFSET); i++) {
+		if (pgdir[i] & PAGE_P_1) {
+			FreePage(pgdir[i] & PAGE_ADDR_MASK);
+			pgdir[i] = 0;
+		}
+	}
+}
+
 /*
  * RemoveFromPageTable - 取消虚拟地址对应的物理链接
  * @virtualAddr: 虚拟地址
@@ -245,6 +374,8 @@ PUBLIC unsigned int RemoveFromPageTable(unsigned int virtualAddr)
  * UnmapPages - 取消页映射
  * @vaddr: 虚拟地址
  * @len: 内存长度
+ * 
+ * 和MapPages对应，每一个页都是单独分配的，所以要逐个释放
  */
 PUBLIC int UnmapPages(unsigned int vaddr, unsigned int len)
 {
@@ -253,25 +384,18 @@ PUBLIC int UnmapPages(unsigned int vaddr, unsigned int len)
 	
 	len = PAGE_ALIGN(len);
 	
-	/* 判断长度是否超过剩余内存大小 */
 	unsigned int end = vaddr + len;
 	unsigned int paddr;
 
-	paddr = Vir2PhyByTable(vaddr);
-
-	// 释放物理页
-	FreePages(paddr);
-
 	//printk("unmap pages:%x->%x len %x\n", vaddr, paddr, len);
 	while (vaddr < end)
 	{
-		//printk(">>>");
-		RemoveFromPageTable(vaddr);
-       	//clean_vir_page_table(vaddr);
-		
-		//更新tlb，把这个虚拟地址从页高速缓存中移除
-		X86Invlpg(vaddr);
-
+		/* 页表项存在的时候才释放物理页 */
+		if ((*PageGetPde(vaddr) & PAGE_P_1) && (*PageGetPte(vaddr) & PAGE_P_1)) {
+			paddr = RemoveFromPageTable(vaddr);
+			// 释放物理页
+			FreePage(paddr);
+		}
 		vaddr += PAGE_SIZE;
 	}
 	
@@ -342,13 +466,20 @@ PUBLIC int UnmapPagesFragment(unsigned int vaddr, unsigned int len)
 	unsigned int paddr;
 	while (vaddr < end)
 	{
-		paddr = RemoveFromPageTable(vaddr);
+		/* 没有页表就跳过这个页表管理的所有地址 */
+		if (!(*PageGetPde(vaddr) & PAGE_P_1)) {
+			vaddr = (vaddr & 0xffc00000) + PAGE_SIZE * PAGE_ENTRY_NR;
+			continue;
+		}
 
 		/* 检测每一个页的时候，尝试释放页
-		这样，再这个范围内的所有页都有可能会被释放掉
+		这样，再这个范围内的所有页都有可能会被释放掉。
+		页不存在时页表项中可能还残留着旧的地址，不能释放
 		*/
-		if (paddr != 0)
+		if (*PageGetPte(vaddr) & PAGE_P_1) {
+			paddr = RemoveFromPageTable(vaddr);
 			FreePages(paddr);
+		}
 
 		vaddr += PAGE_SIZE;
 	}
@@ -363,33 +494,10 @@ PRIVATE uint32_t ExpandStack(struct VMSpace* space, uint32_t addr)
 
 	// 修改为新的空间开始
 	space->start = addr;
+	UpdateVMSpace(space);
     return 0;
 }
 
-/**
- * MakePteWrite - 让pte有写属性
- * @addr: 要设置的虚拟地址
- */
-PRIVATE int MakePteWrite(unsigned int addr)
-{
-	if (addr > USER_VM_SIZE)
-		return -1;
-
-	pde_t *pde = PageGetPde(addr);
-	pte_t *pte = PageGetPte(addr);
-	
-	/* 虚拟地址的pde和pte都要存在才能去设置属性 */
-	if (!(*pde & PAGE_P_1))
-		return -1;
-
-	if (!(*pte & PAGE_P_1))
-		return -1;
-	
-	/* 标记写属性 */
-	*pte |= PAGE_RW_W;
-	return 0;
-}
-
 /**
  * DoVMAreaFault - 内核中的vmarea映射故障
  * @addr: 虚拟地址
@@ -430,6 +538,58 @@ PRIVATE int DoHandleNoPage(uint32_t addr)
 	return 0;
 }
 
+/**
+ * DoCopyOnWrite - 处理写时复制
+ * @addr: 写入的地址
+ * 
+ * 如果页只有自己在使用，就直接恢复写属性，不然就复制一个新的页
+ * 成功返回0，失败返回-1
+ */
+PRIVATE int DoCopyOnWrite(address_t addr)
+{
+	addr &= PAGE_MASK;
+	pte_t *pte = PageGetPte(addr);
+	unsigned int paddr = *pte & PAGE_ADDR_MASK;
+	struct MemNode *node = Page2MemNode(paddr);
+
+	unsigned long flags = InterruptSave();
+
+	/* 只有自己在使用这个页 */
+	if (node == NULL || node->reference <= 1) {
+		*pte = (*pte & ~PAGE_COW) | PAGE_RW_W;
+		X86Invlpg(addr);
+		InterruptRestore(flags);
+		return 0;
+	}
+
+	unsigned int newPage = AllocPage();
+	if (!newPage) {
+		InterruptRestore(flags);
+		printk(PART_ERROR "DoCopyOnWrite: alloc page failed!\n");
+		return -1;
+	}
+
+	/* 新页不一定在内核直接映射的区域，通过复制窗口来访问 */
+	pte_t *window = PageGetPte(copyWindow);
+	*window = newPage | PAGE_US_S | PAGE_RW_W | PAGE_P_1;
+	X86Invlpg(copyWindow);
+
+	memcpy((void *)copyWindow, (void *)addr, PAGE_SIZE);
+
+	*window = 0;
+	X86Invlpg(copyWindow);
+
+	/* 映射新页，属性和原来的一样，但是可写 */
+	*pte = newPage | (*pte & PAGE_INSIDE & ~PAGE_COW) | PAGE_RW_W;
+	X86Invlpg(addr);
+
+	/* 旧页少了一个使用者 */
+	node->reference--;
+
+	InterruptRestore(flags);
+	return 0;
+}
+
 /**
  * DoProtectionFault - 执行页保护异常
  * @space: 所在空间
@@ -440,24 +600,19 @@ PRIVATE int DoProtectionFault(struct VMSpace* space, address_t addr, uint32_t wr
 {
     //printk(PART_TIP "handle protection fault, addr: %x\n", addr);
 
-	/* 没有写标志，说明该段内存不支持内存写入，就直接返回吧 */
-	if (write) {
-		printk(PART_TIP "have write protection\n");
-		
-		/* 只有设置写属性正确才能返回 */
-		int ret = MakePteWrite(addr);
-		if (ret)
-			return -1;
-		
-		/* 虽然写入的写标志，但是还是会出现缺页故障，在此则处理一下缺页 */
-		if (DoHandleNoPage(addr))
-			return -1; 
-
+	/* 写入写时复制的页 */
+	if (write && (*PageGetPte(addr) & PAGE_COW)) {
+		if (DoCopyOnWrite(addr))
+			goto ToSignal;
 		return 0;
-	} else {
-		printk(PART_TIP "no write protection\n");
-		
 	}
+
+	if (write)
+		printk(PART_TIP "have write protection\n");
+	else
+		printk(PART_TIP "no write protection\n");
+
+ToSignal:
     printk(PART_ERROR "# protection fault!\n");
     ForceSignal(SIGSEGV, SysGetPid());
 	//Panic(PART_ERROR "# protection fault!\n");
@@ -573,12 +728,13 @@ PUBLIC int DoPageFault(struct TrapFrame *frame)
 		if (frame->errorCode & PAGE_ERR_PROTECT) {
 			//printk(PART_TIP "it is protection\n");
 
-			printk(PART_TIP "cs %x eip %x esp %x\n", frame->cs, frame->eip, frame->esp);
-			DumpTrapFrame(frame);
-                
-            //Panic("DoProtectionFault");
 			/* 执行保护故障操作 */
-			return DoProtectionFault(space, addr, (uint32_t)(frame->errorCode & PAGE_ERR_WRITE));
+			if (DoProtectionFault(space, addr, (uint32_t)(frame->errorCode & PAGE_ERR_WRITE))) {
+				printk(PART_TIP "cs %x eip %x esp %x\n", frame->cs, frame->eip, frame->esp);
+				DumpTrapFrame(frame);
+				return -1;
+			}
+			return 0;
 		}
 		
 		/* 没有映射物理页，
@@ -587,13 +743,42 @@ PUBLIC int DoPageFault(struct TrapFrame *frame)
 		 */
 		//printk(PART_TIP "handle no page, addr: %x\n", addr);
 
+		/* 映射了文件的空间，第一次访问时才映射页缓存中的页或者从文件读取 */
+		if (space->file >= 0) {
+			if (VMSpaceFillPage(space, addr)) {
+				ForceSignal(SIGBUS, SysGetPid());
+				return -1;
+			}
+			return 0;
+		}
+
 		if (DoHandleNoPage(addr))
 			return -1; 
-        
     }
     return 0;
 }
 
+/**
+ * InitCopyOnWrite - 初始化写时复制
+ * 
+ * 打开CR0的写保护，内核写入只读的用户页时也能触发写时复制。
+ * 复制窗口的页表在这里创建好，后面创建的页目录都会包含它。
+ */
+PUBLIC void InitCopyOnWrite()
+{
+	WriteCR0(ReadCR0() | CR0_WP);
+
+	copyWindow = AllocVaddress(PAGE_SIZE);
+	if (!copyWindow)
+		Panic(PART_ERROR "alloc copy window for copy on write failed!\n");
+	
+	/* 只需要创建页表，页表项等使用的时候再填写 */
+	if (PageTableAdd(copyWindow, 0, PAGE_US_S | PAGE_RW_W))
+		Panic(PART_ERROR "map copy window for copy on write failed!\n");
+	*PageGetPte(copyWindow) = 0;
+	X86Invlpg(copyWindow);
+}
+
 PUBLIC unsigned int Vir2PhyByTable(unsigned int vaddr)
 {
 	pte_t* pte = PageGetPte(vaddr);
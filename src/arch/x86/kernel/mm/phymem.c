@@ -13,6 +13,7 @@
 #include <mm/page.h>
 #include <mm/bootmem.h>
 #include <mm/phymem.h>
+#include <mm/area.h>
 #include <lib/string.h>
 #include <lib/math.h>
 
@@ -28,6 +29,14 @@ unsigned int memNodeBase;
 /* 物理内存总大小 */
 PRIVATE unsigned int totalPhysicMemorySize;
 
+/* 
+ * 内存区域：
+ * normal区域是内核直接映射的内存，user区域是内核没有直接映射的内存。
+ * 分配的时候优先从normal区域分配。
+ */
+PRIVATE struct MemZone normalZone;
+PRIVATE struct MemZone userZone;
+
 /*
  * MapDirectMemory - 物理地址和虚拟地址一对一映射
  * @start: 开始物理地址
@@ -118,24 +127,204 @@ PRIVATE int MapDirectMemory(unsigned int start, unsigned int end)
 	return 0;
 }
 
-PUBLIC struct MemNode *GetFreeMemNode()
+/**
+ * MemZoneFreeBlock - 把一个块释放到区域的空闲链表中
+ * @zone: 内存区域
+ * @index: 块的第一个节点的索引
+ * @order: 块的order
+ * 
+ * 释放的时候会尝试和伙伴块合并，直到伙伴不空闲或者到达最大的order
+ */
+PRIVATE void MemZoneFreeBlock(struct MemZone *zone, unsigned int index, unsigned int order)
 {
-    struct MemNode *node = memNodeTable;
-    
-    while (node < memNodeTable + memNodeCount)
-    {
-        /* 没有被分配就是我们需要的 */
-        if (!node->reference) {
-            return node;
-        }
-        /* 指向下一个节点位置 */
-        if (node->count) 
-            node += node->count;
-        else 
-            node++;
+    struct MemNode *buddy;
+    unsigned int buddyIndex;
+
+    while (order < MAX_ORDER - 1) {
+        buddyIndex = index ^ (1 << order);
+
+        /* 伙伴必须在区域内 */
+        if (buddyIndex < zone->startIndex || 
+            buddyIndex + (1 << order) > zone->endIndex)
+            break;
+        
+        buddy = memNodeTable + buddyIndex;
         
+        /* 伙伴必须是一个同样大小的空闲块 */
+        if (!(buddy->flags & MEM_NODE_FREE) || buddy->order != order)
+            break;
+        
+        /* 把伙伴从空闲链表中摘下来，合并成更大的块 */
+        ListDel(&buddy->list);
+        buddy->flags &= ~MEM_NODE_FREE;
+        zone->freeArea[order].freeBlocks--;
+
+        index &= ~(1 << order);
+        order++;
+    }
+
+    struct MemNode *node = memNodeTable + index;
+    node->flags = MEM_NODE_FREE;
+    node->order = order;
+    ListAdd(&node->list, &zone->freeArea[order].freeList);
+    zone->freeArea[order].freeBlocks++;
+}
+
+/**
+ * MemZoneFreeRange - 把一段节点释放到区域中
+ * @zone: 内存区域
+ * @index: 第一个节点的索引
+ * @count: 节点的数量
+ * 
+ * 把范围拆分成尽可能大的对齐的块，然后逐个释放
+ */
+PRIVATE void MemZoneFreeRange(struct MemZone *zone, unsigned int index, unsigned int count)
+{
+    unsigned int order;
+
+    while (count > 0) {
+        order = 0;
+        /* 找到和索引对齐，并且不超过剩余数量的最大的order */
+        while (order + 1 < MAX_ORDER && 
+            !(index & ((1 << (order + 1)) - 1)) && 
+            (1 << (order + 1)) <= count)
+            order++;
+        
+        MemZoneFreeBlock(zone, index, order);
+        index += 1 << order;
+        count -= 1 << order;
+    }
+}
+
+/**
+ * MemZoneAlloc - 从区域中分配连续的节点
+ * @zone: 内存区域
+ * @count: 节点的数量
+ * @order: 能容纳count的最小order
+ * 
+ * 成功返回第一个节点，失败返回NULL
+ */
+PRIVATE struct MemNode *MemZoneAlloc(struct MemZone *zone, unsigned int count, unsigned int order)
+{
+    unsigned int current;
+    struct FreeArea *area;
+    struct MemNode *node;
+
+    /* 从需要的order开始往上查找空闲块 */
+    for (current = order; current < MAX_ORDER; current++) {
+        area = &zone->freeArea[current];
+        if (!ListEmpty(&area->freeList))
+            break;
+    }
+    if (current >= MAX_ORDER)
+        return NULL;
+    
+    node = ListFirstOwner(&area->freeList, struct MemNode, list);
+    ListDel(&node->list);
+    node->flags &= ~MEM_NODE_FREE;
+    area->freeBlocks--;
+
+    unsigned int index = node - memNodeTable;
+
+    /* 把大块拆分，后面一半放回低一级的空闲链表 */
+    while (current > order) {
+        current--;
+        MemZoneFreeBlock(zone, index + (1 << current), current);
+    }
+
+    /* 只保留需要的页数，把块尾部多余的页还给区域 */
+    if (count < (1 << order))
+        MemZoneFreeRange(zone, index + count, (1 << order) - count);
+
+    zone->freePages -= count;
+    return node;
+}
+
+/**
+ * AllocMemNodes - 分配连续的内存节点
+ * @count: 节点的数量
+ * 
+ * 成功返回第一个节点，失败返回NULL
+ */
+PUBLIC struct MemNode *AllocMemNodes(unsigned int count)
+{
+    if (!count)
+        return NULL;
+    
+    unsigned int order = 0;
+    while ((1 << order) < count)
+        order++;
+
+    if (order >= MAX_ORDER) {
+        printk(PART_WARRING "alloc %d pages out of max order!\n", count);
+        return NULL;
+    }
+
+    unsigned long flags = InterruptSave();
+    
+    /* 优先从normal区域分配 */
+    struct MemNode *node = MemZoneAlloc(&normalZone, count, order);
+    if (node == NULL)
+        node = MemZoneAlloc(&userZone, count, order);
+    
+    InterruptRestore(flags);
+    return node;
+}
+
+/**
+ * FreeMemNodes - 释放连续的内存节点
+ * @node: 第一个节点，count记录了节点的数量
+ * 
+ * 释放后节点的count会被清0
+ */
+PUBLIC void FreeMemNodes(struct MemNode *node)
+{
+    unsigned int index = node - memNodeTable;
+    struct MemZone *zone;
+
+    if (index >= normalZone.startIndex && index < normalZone.endIndex)
+        zone = &normalZone;
+    else if (index >= userZone.startIndex && index < userZone.endIndex)
+        zone = &userZone;
+    else
+        return;
+    
+    unsigned long flags = InterruptSave();
+    
+    unsigned int count = node->count;
+    node->count = 0;
+
+    /* 不能越过区域 */
+    if (index + count > zone->endIndex)
+        count = zone->endIndex - index;
+
+    MemZoneFreeRange(zone, index, count);
+    zone->freePages += count;
+
+    InterruptRestore(flags);
+}
+
+/**
+ * MemZoneInit - 初始化内存区域
+ * @zone: 内存区域
+ * @start: 开始节点索引
+ * @end: 结束节点索引
+ */
+PRIVATE void MemZoneInit(struct MemZone *zone, unsigned int start, unsigned int end)
+{
+    int i;
+    for (i = 0; i < MAX_ORDER; i++) {
+        INIT_LIST_HEAD(&zone->freeArea[i].freeList);
+        zone->freeArea[i].freeBlocks = 0;
+    }
+    zone->startIndex = start;
+    zone->endIndex = end;
+    zone->freePages = 0;
+    
+    if (start < end) {
+        MemZoneFreeRange(zone, start, end - start);
+        zone->freePages = end - start;
     }
-    return NULL;
 }
 
 PUBLIC struct MemNode *Page2MemNode(unsigned int page)
@@ -171,16 +360,24 @@ PUBLIC void DumpMemNode(struct MemNode *node)
 }
 
 /* 
- * ZoneCutUesdMemory - 把已经使用的内存剪掉
+ * InitMemZones - 初始化内存区域
+ * @normalSize: 内核直接映射的内存大小
  * 
  * 因为内存管理器本身要占用一定内存，在这里把它从可分配中去掉
  */
-PRIVATE void CutUesdMemory()
+PRIVATE void InitMemZones(unsigned int normalSize)
 {
     /* 剪切掉引导分配的空间 */
-    unsigned int usedMem = BootMemSize();
-    unsigned int usedPages = DIV_ROUND_UP(usedMem, PAGE_SIZE);
-    AllocPages(usedPages);
+    unsigned int usedPages = DIV_ROUND_UP(BootMemSize(), PAGE_SIZE);
+    unsigned int normalPages = normalSize / PAGE_SIZE;
+    
+    /* 只管理实际存在的物理内存 */
+    unsigned int topPages = (totalPhysicMemorySize - NORMAL_MEM_ADDR) / PAGE_SIZE;
+    if (topPages > memNodeCount)
+        topPages = memNodeCount;
+    
+    MemZoneInit(&normalZone, usedPages, normalPages);
+    MemZoneInit(&userZone, normalPages, topPages);
 }
 
 /** 
@@ -190,22 +387,7 @@ PRIVATE void CutUesdMemory()
  */
 PUBLIC unsigned int GetPhysicMemoryFreeSize()
 {
-    struct MemNode *node = memNodeTable;
-    unsigned int freeNodes = 0;
-    while (node < memNodeTable + memNodeCount)
-    {
-        /* 没有被分配就是我们需要的 */
-        if (!node->reference) {
-            freeNodes++;
-        }
-        /* 指向下一个节点位置 */
-        if (node->count) 
-            node += node->count;
-        else 
-            node++;
-    }
-    /* 获取空闲节点数后，进行计算 */
-    return freeNodes * PAGE_SIZE;
+    return (normalZone.freePages + userZone.freePages) * PAGE_SIZE;
 }
 
 /** 
@@ -269,7 +451,7 @@ PUBLIC int InitPhysicMemory()
     
     memset(memNodeTable, 0, memNodeTableSize);
 
-    CutUesdMemory();
+    InitMemZones(normalSize);
 /*
     unsigned int a = AllocPages(1000);
     unsigned int b = AllocPages(2);
@@ -28,25 +28,11 @@ EXTERN void ExitRamdiskdDriver();
 /* ----驱动程序初始化文件导入完毕---- */
 
 //#define _DEBUG_TEST
+//#define _DEBUG_BENCH
 
 EXTERN struct List allDiskList;
 EXTERN struct List allBlockDeviceList;
 
-/**
- * BlockDiskSync - 把磁盘数据同步到磁盘上
- * 
- * 这个函数每秒被调用一次，在clock.c中的WorkForPerSecond工作中进行。
- */
-PUBLIC void BlockDiskSync()
-{
-    /* 执行块同步操作 */
-    int count = Bsync();
-    if (count) {
-        /* 显示同步信息，有助于调试 */
-        //printk(">>>sync disk for %d count.\n", count);
-    }
-}
-
 void ThreadReadTest(void *arg)
 {
     char *blkbuf = kmalloc(BLOCK_SIZE, GFP_KERNEL);
@@ -130,12 +116,66 @@ void ThreadReadTest3(void *arg)
     }
 }
 
+#ifdef _DEBUG_BENCH
+/* 测试读取的块数 */
+#define BENCH_BLOCKS    512
+
+/**
+ * BlockReadBenchmark - 顺序读取的性能测试
+ * @devno: 设备号
+ * 
+ * 分别用逐块读取（Bread）和批量读取（Breada）顺序读取两段不同的块，
+ * 比较用时和提交的请求，批量读取时相邻的请求会合并成多扇区的请求
+ */
+PRIVATE void BlockReadBenchmark(dev_t devno)
+{
+    struct BlockDevice *blkdev = GetBlockDeviceByDevno(devno);
+    struct RequestQueue *queue;
+    struct BufferHead *bh;
+    unsigned int requests, merges;
+    clock_t start;
+    sector_t i;
+
+    if (blkdev == NULL || blkdev->disk == NULL)
+        return;
+    queue = blkdev->disk->requestQueue;
+
+    /* 每次读取一个块 */
+    requests = queue->requests;
+    merges = queue->backMerges + queue->frontMerges;
+    start = systicks;
+    for (i = 0; i < BENCH_BLOCKS; i++) {
+        bh = Bread(devno, i);
+        if (bh)
+            Brelease(bh);
+    }
+    printk("bench: Bread %d blocks %d ticks, %d requests %d merges\n",
+        BENCH_BLOCKS, systicks - start, queue->requests - requests,
+        queue->backMerges + queue->frontMerges - merges);
+
+    /* 读取另外一段块，每次批量提交 */
+    requests = queue->requests;
+    merges = queue->backMerges + queue->frontMerges;
+    start = systicks;
+    for (i = BENCH_BLOCKS; i < BENCH_BLOCKS * 2; i += 32) {
+        Breada(devno, i, 32);
+    }
+    printk("bench: Breada %d blocks %d ticks, %d requests %d merges\n",
+        BENCH_BLOCKS, systicks - start, queue->requests - requests,
+        queue->backMerges + queue->frontMerges - merges);
+}
+#endif /* _DEBUG_BENCH */
+
 /**
  * BlockDeviceTest - 对块设备进行测试
  * 
  */
 PUBLIC void BlockDeviceTest()
 {
+    #ifdef _DEBUG_BENCH
+    BlockReadBenchmark(DEV_HDA);
+    #endif
+
     #ifdef _DEBUG_TEST
     ThreadStart("A", 3, ThreadReadTest, "NULL");
     ThreadStart("B", 3, ThreadReadTest2, "NULL");
@@ -208,6 +248,12 @@ PUBLIC void InitBlockDevice()
 {
 #ifdef CONFIG_BLOCK_DEVICE
     
+    /* 初始化块缓冲 */
+    InitBufferCache();
+
+    /* 初始化请求 */
+    InitBlockRequest();
+
     #ifdef CONFIG_DRV_RAMDISK
     /* 初始化ramdisk驱动 */
     if (InitRamdiskDriver()) {
@@ -222,8 +268,8 @@ PUBLIC void InitBlockDevice()
 	}
     #endif
     
-    /* 创建一个线程来同步磁盘 */
-    //ThreadStart("dflush", TASK_PRIORITY_BEST, ThreadDiskFlush, "NULL");
+    /* 创建一个线程来把脏缓冲写回磁盘 */
+    InitBufferWriteback();
     
     BlockDeviceTest();
     
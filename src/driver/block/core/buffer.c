@@ -6,14 +6,15 @@
  */
 
 #include <book/debug.h>
+#include <book/task.h>
 #include <lib/string.h>
+#include <lib/math.h>
 
 #include <block/block.h>
 #include <block/blk-buffer.h>
 #include <block/blk-request.h>
 #include <block/blk-disk.h>
-
-EXTERN struct List allDiskList;
+#include <clock/clock.h>
 
 /**
  * LockBuffer - 锁定缓冲区
@@ -23,18 +24,41 @@ EXTERN struct List allDiskList;
  */
 PUBLIC void LockBuffer(struct BufferHead *bh)
 {
+    unsigned long flags = InterruptSave();
+    /* 缓冲区正在读写时，等待读写完成 */
+    WaitEvent(&bh->waitQueue, !bh->locked);
     bh->locked = 1;
+    InterruptRestore(flags);
+}
+
+/**
+ * TryLockBuffer - 尝试锁定缓冲区
+ * @bh: 缓冲头
+ * 
+ * 不会等待，锁定成功返回1，缓冲区已经被锁定返回0
+ */
+PUBLIC int TryLockBuffer(struct BufferHead *bh)
+{
+    int ret = 0;
+    unsigned long flags = InterruptSave();
+    if (!bh->locked) {
+        bh->locked = 1;
+        ret = 1;
+    }
+    InterruptRestore(flags);
+    return ret;
 }
 
 /**
  * UnlockBuffer - 解除缓冲区的锁
  * @bh: 缓冲头
  * 
- * 解除缓冲区占用
+ * 解除缓冲区占用，并唤醒在缓冲区上等待的任务
  */
 PUBLIC void UnlockBuffer(struct BufferHead *bh)
 {
     bh->locked = 0;
+    WaitQueueWakeUpAll(&bh->waitQueue);
 }
 
 /**
@@ -44,47 +68,146 @@ PUBLIC void UnlockBuffer(struct BufferHead *bh)
  */
 PUBLIC void WaitOnBuffer(struct BufferHead *bh)
 {
-    while (bh->locked)
-    {
-        /* 让出CPU占用 */
-        TaskYield();
-    }
+    /* 在缓冲区的等待队列上休眠，解锁时被唤醒 */
+    WaitEvent(&bh->waitQueue, !bh->locked);
+}
+
+/* 块缓冲散列表，根据设备号和块号来查找缓冲 */
+PRIVATE struct List bufferHashTable[BUFFER_HASH_NR];
+
+/* 没有使用者的缓冲，按照释放的先后排列，最久没有使用的在最前面 */
+PRIVATE LIST_HEAD(bufferLruList);
+
+/* 已经创建的缓冲数量 */
+PRIVATE unsigned int bufferCount;
+
+/* 缓冲数量的上限，超过后回收最久未使用的干净缓冲 */
+PRIVATE unsigned int bufferLimit = CONFIG_BUFFER_CACHE_NR;
+
+/* 内存紧张时，kmshrink调用它来释放缓冲 */
+PRIVATE struct MemShrinker bufferShrinker;
+
+/* 脏缓冲变脏超过这个时间（ticks）后，由写回线程写回磁盘 */
+#define WRITEBACK_EXPIRE        (5 * HZ)
+
+/* 写回线程醒来检查的间隔 */
+#define WRITEBACK_INTERVAL      HZ
+
+/* 脏缓冲达到这个数量就马上唤醒写回线程，一直写回到一半以下 */
+#define WRITEBACK_THRESHOLD     (CONFIG_BUFFER_CACHE_NR / 8)
+
+/* 一批最多写回的缓冲数 */
+#define WRITEBACK_BATCH         64
+
+/* 脏缓冲链表，按照（设备号，块号）排序，写回时相邻的块可以合并成一个请求 */
+PRIVATE LIST_HEAD(dirtyBufferList);
+
+/* 脏缓冲的数量 */
+PRIVATE unsigned int dirtyCount;
+
+/* 写回线程，以及它是否在休眠等待下一次检查 */
+PRIVATE struct Task *writebackTask;
+PRIVATE char writebackSleeping;
+
+#define BufferHash(devno, lba) \
+        (&bufferHashTable[((devno) ^ (lba) ^ ((lba) >> 8)) & (BUFFER_HASH_NR - 1)])
+
+/* 缓冲所在的磁盘是否不保留块缓冲 */
+#define BufferNoCache(bh) \
+        ((bh)->device != NULL && ((bh)->device->disk->flags & DISK_FLAG_NOCACHE))
+
+/**
+ * GrabBuffer - 增加缓冲的引用
+ * @bh: 缓冲头
+ * 
+ * 调用者需要关闭中断，之前没有使用者的缓冲在LRU链表中，要移出来
+ */
+PRIVATE void GrabBuffer(struct BufferHead *bh)
+{
+    if (!AtomicGet(&bh->count))
+        ListDel(&bh->lruList);
+    GetBH(bh);
 }
 
 /**
- * GetBufferFromDisk - 从磁盘缓冲链表中获取一个缓冲
+ * GetBufferFromDisk - 从缓冲散列表中获取一个缓冲
  * @disk: 要获取的磁盘
  * @lba: 块对应的lba
  * @size: 块的大小
  * 
- * 根据条件返回一个一样的块，没有找到则返回空
+ * 根据条件返回一个一样的块，并增加引用，没有找到则返回空
  */
 PRIVATE struct BufferHead *GetBufferFromDisk(struct Disk *disk, sector_t lba, size_t size)
 {
     struct BufferHead *bh = NULL, *tmp;
 
-    /* 在磁盘对应的缓冲头中查找，是否和磁盘的设备号一致 */
     int devno = MKDEV(disk->major, disk->firstMinor);
-    char flags = 0;
-    ListForEachOwner(tmp , &disk->bufferHeadList, list) {
+    struct List *head = BufferHash(devno, lba);
+
+    unsigned long flags = InterruptSave();
+    
+    ListForEachOwner(tmp, head, hashList) {
         /* 如果条件满足就找到 */
         if (tmp->devno == devno &&
             tmp->lba == lba &&
             tmp->size == size
         ) {
             bh = tmp;
-            GetBH(bh);
-            flags = 1;
+            GrabBuffer(bh);
             break;
         }
     }
+
+    InterruptRestore(flags);
     return bh;
+}
 
-    /* 找到了标志才为1，没有则返回空 */
-    if (flags)
-        return bh;
-    else
-        return NULL;
+/**
+ * DestroyBuffer - 销毁一个缓冲
+ * @bh: 缓冲头
+ * 
+ * 调用者需要关闭中断，缓冲必须没有使用者，并且不是脏的
+ */
+PRIVATE void DestroyBuffer(struct BufferHead *bh)
+{
+    ListDel(&bh->lruList);
+    ListDel(&bh->hashList);
+    ListDel(&bh->list);
+    bufferCount--;
+
+    kfree(bh->data);
+    kfree(bh);
+}
+
+/**
+ * EvictBuffers - 回收最久未使用的缓冲
+ * @count: 要回收的数量，为0就回收全部可以回收的缓冲
+ * 
+ * 只回收没有使用者，没有上锁，也不是脏的缓冲
+ * 返回释放的字节数
+ */
+PRIVATE int EvictBuffers(unsigned int count)
+{
+    struct BufferHead *bh, *next;
+    int size = 0;
+    unsigned int evicted = 0;
+
+    unsigned long flags = InterruptSave();
+    
+    ListForEachOwnerSafe(bh, next, &bufferLruList, lruList) {
+        if (bh->dirty || bh->locked)
+            continue;
+        
+        size += bh->size + SIZEOF_BUFFER_HEAD;
+        DestroyBuffer(bh);
+        
+        evicted++;
+        if (count && evicted >= count)
+            break;
+    }
+    
+    InterruptRestore(flags);
+    return size;
 }
 
 /**
@@ -93,46 +216,71 @@ PRIVATE struct BufferHead *GetBufferFromDisk(struct Disk *disk, sector_t lba, si
  * @lba: 缓冲区的lba
  * @size: 缓冲区的大小
  * 
- * 成功返回0，失败返回-1
+ * 创建后就有一个使用者，如果其他任务已经抢先创建了同样的缓冲，
+ * 就返回已经存在的缓冲。失败返回NULL
  */
-PRIVATE int CreateBuffers(struct Disk *disk, sector_t lba, size_t size)
+PRIVATE struct BufferHead *CreateBuffers(struct Disk *disk, sector_t lba, size_t size)
 {
     if (size < SECTOR_SIZE || size > PAGE_SIZE)
         Panic("Bad block size!\n");
 
+    /* 达到上限就先回收一个最久未使用的缓冲 */
+    if (bufferCount >= bufferLimit)
+        EvictBuffers(1);
+
     /* 创建并添加到链表 */
-    struct BufferHead *bh;
+    struct BufferHead *bh, *old;
 
     char *data;
 
     data = kmalloc(size, GFP_KERNEL);
     if (data == NULL) {
-        return -1;
+        return NULL;
     }
     bh = kmalloc(SIZEOF_BUFFER_HEAD, GFP_KERNEL);
     if (bh == NULL) {
         kfree(data);
-        return -1;
+        return NULL;
     }
 
-    AtomicSet(&bh->count, 0);
+    AtomicSet(&bh->count, 1);
     bh->devno = MKDEV(disk->major, disk->firstMinor);
     bh->lba = lba;
     bh->size = size;
     bh->data = data;
     bh->private = NULL;
+    bh->device = NULL;
 
     bh->locked = 0;
     bh->uptodate = 0;
     bh->dirty = 0;
+    bh->dirtyTime = 0;
+    bh->owner = 0;
     
     /* 初始化信号量为1 */
     SemaphoreInit(&bh->sema, 1);
+    WaitQueueInit(&bh->waitQueue, NULL);
+    INIT_LIST_HEAD(&bh->lruList);
+    INIT_LIST_HEAD(&bh->dirtyList);
 
-    /* 添加到buffer list */
+    unsigned long flags = InterruptSave();
+
+    /* 分配内存的时候可能有其它任务创建了同样的缓冲 */
+    old = GetBufferFromDisk(disk, lba, size);
+    if (old != NULL) {
+        InterruptRestore(flags);
+        kfree(data);
+        kfree(bh);
+        return old;
+    }
+
+    /* 添加到散列表和buffer list */
+    ListAdd(&bh->hashList, BufferHash(bh->devno, lba));
     ListAddTail(&bh->list, &disk->bufferHeadList);
+    bufferCount++;
 
-    return 0;
+    InterruptRestore(flags);
+    return bh;
 }
 
 /**
@@ -140,7 +288,8 @@ PRIVATE int CreateBuffers(struct Disk *disk, sector_t lba, size_t size)
  * @devno: 设备号
  * @lba: 块号
  * 
- * 根据设备号获取一个块（缓冲区）
+ * 根据设备号获取一个块（缓冲区），获取后引用加1，
+ * 使用完后需要用Brelease释放
  */
 PRIVATE struct BufferHead *GetBlock(dev_t devno, sector_t lba)
 {
@@ -153,30 +302,34 @@ PRIVATE struct BufferHead *GetBlock(dev_t devno, sector_t lba)
 
     struct Disk *disk = blkdev->disk;
 
-    while (1) {
-        /* 从链表中获取块 */
-        struct BufferHead *bh;
-        bh = GetBufferFromDisk(disk, lba, blkdev->blockSize);
-        
-        /* 找到就返回 */
-        if (bh != NULL) {
-            return bh;
-        }
-        //printk("%d", lba);
-        /* 没找到，就添加一个新的buffer */
-        if (CreateBuffers(disk, lba, blkdev->blockSize)) {
-            /* 如果添加新buffer失败，就尝试释放更多内存，再进行添加 */
-            //FreeMoreMemory();
-            Panic("Create block buffer failed!\n");
-        }
+    /* 从散列表中获取块 */
+    struct BufferHead *bh;
+    bh = GetBufferFromDisk(disk, lba, blkdev->blockSize);
+    
+    /* 找到就返回 */
+    if (bh != NULL) {
+        return bh;
     }
+    //printk("%d", lba);
+    /* 没找到，就添加一个新的buffer */
+    bh = CreateBuffers(disk, lba, blkdev->blockSize);
+    if (bh == NULL) {
+        /* 如果添加新buffer失败，就释放所有可以释放的缓冲，再进行添加 */
+        kmshrink();
+        bh = CreateBuffers(disk, lba, blkdev->blockSize);
+    }
+    if (bh != NULL)
+        bh->device = blkdev;
+    return bh;
 }
 
 /**
  * Brelease - 释放一个块
  * @bh: 缓冲头
+ * 
+ * 减少引用计数，没有使用者后放到LRU链表的末尾
 */
-PRIVATE void Brelease(struct BufferHead *bh)
+PUBLIC void Brelease(struct BufferHead *bh)
 {
     if (bh == NULL)
         return;
@@ -184,11 +337,33 @@ PRIVATE void Brelease(struct BufferHead *bh)
     /* 等待上锁的缓冲解锁 */
     WaitOnBuffer(bh);
 
+    BufferPut(bh);
+}
+
+/**
+ * BufferPut - 释放缓冲的引用
+ * @bh: 缓冲头
+ * 
+ * 和Brelease一样，但是不等待缓冲解锁，可以在结束请求的中断中调用
+ */
+PUBLIC void BufferPut(struct BufferHead *bh)
+{
+    unsigned long flags = InterruptSave();
+
+    if (AtomicGet(&bh->count) <= 0)
+        Panic("Brelease: user count error!\n");
+    
     /* 减少引用计数 */
     PutBH(bh);
-    if (!AtomicGet(&bh->count))
-        Panic("Brelease: user count error!\n");
+    if (!AtomicGet(&bh->count)) {
+        ListAddTail(&bh->lruList, &bufferLruList);
 
+        /* 不保留缓冲的磁盘，干净的缓冲马上回收 */
+        if (BufferNoCache(bh) && !bh->dirty && !bh->locked)
+            DestroyBuffer(bh);
+    }
+
+    InterruptRestore(flags);
 }
 
 /**
@@ -218,8 +393,10 @@ PUBLIC struct BufferHead *Bread(dev_t devno, sector_t block)
 {
     struct BufferHead *bh;
     //printk("Bread:start\n");
-    if (!(bh = GetBlock(devno, block)))   // 获取一个buffer head
-        Panic("Bread: Get block failed!\n");
+    if (!(bh = GetBlock(devno, block))) {  // 获取一个buffer head
+        printk("Bread: Get block failed!\n");
+        return NULL;
+    }
     
     //printk("Bread:get a bh\n");
     //DumpBH(bh);
@@ -248,6 +425,161 @@ PUBLIC struct BufferHead *Bread(dev_t devno, sector_t block)
     return NULL;
 }
 
+/* Breada一次提交的最多块数 */
+#define BREADA_MAX  32
+
+/**
+ * PrefetchBlock - 提交一个块的读取，不等待读取完成
+ * @devno: 设备号
+ * @block: 块号
+ * 
+ * 已经有效或者正在读写的块不需要再提交，
+ * 在暂停的队列上也不能等待上锁的缓冲，所以只尝试锁定。
+ * 返回持有引用的缓冲头，失败返回NULL
+ */
+PRIVATE struct BufferHead *PrefetchBlock(dev_t devno, sector_t block)
+{
+    struct BufferHead *bh = GetBlock(devno, block);
+    
+    if (bh != NULL && TryLockBuffer(bh))
+        SubmitRequest(MAJOR(devno), BLOCK_READ, bh);
+    return bh;
+}
+
+/**
+ * Breada - 预读多个连续的块(Buffer Read Ahead)
+ * @devno: 设备号
+ * @block: 起始块号
+ * @count: 块数
+ * 
+ * 先暂停设备的请求队列，把所有无效的块一起提交，让相邻的请求合并成
+ * 多扇区的请求，然后恢复队列并等待读取完成。读取的块留在缓冲中，
+ * 之后的Bread可以直接命中。全部读取成功返回0，失败返回-1
+ */
+PUBLIC int Breada(dev_t devno, sector_t block, unsigned int count)
+{
+    struct BufferHead *bhs[BREADA_MAX];
+    struct RequestQueue *queue;
+    unsigned int i, n;
+    int ret = 0;
+
+    struct BlockDevice *blkdev = GetBlockDeviceByDevno(devno);
+    if (blkdev == NULL || blkdev->disk == NULL)
+        return -1;
+    
+    queue = blkdev->disk->requestQueue;
+
+    while (count > 0) {
+        n = min(count, BREADA_MAX);
+
+        /* 暂停执行请求，所有请求提交完后再一起执行 */
+        BlockPlugQueue(queue);
+        for (i = 0; i < n; i++)
+            bhs[i] = PrefetchBlock(devno, block + i);
+        BlockUnplugQueue(queue);
+
+        /* 等待读取完成 */
+        for (i = 0; i < n; i++) {
+            if (bhs[i] == NULL) {
+                ret = -1;
+                continue;
+            }
+            WaitOnBuffer(bhs[i]);
+            if (!bhs[i]->uptodate)
+                ret = -1;
+            Brelease(bhs[i]);
+        }
+        block += n;
+        count -= n;
+    }
+    return ret;
+}
+
+/**
+ * Bprefetch - 异步预读多个块(Buffer Prefetch)
+ * @devno: 设备号
+ * @blocks: 块号数组，不需要连续
+ * @count: 块数
+ * 
+ * 只提交读取请求，不等待读取完成，读取的块留在缓冲中。
+ * 磁盘上相邻的块会合并成多扇区的请求，之后的Bread会等待读取完成或者直接命中
+ */
+PUBLIC void Bprefetch(dev_t devno, sector_t *blocks, unsigned int count)
+{
+    struct BufferHead *bh;
+    struct RequestQueue *queue;
+    unsigned int i;
+
+    struct BlockDevice *blkdev = GetBlockDeviceByDevno(devno);
+    if (blkdev == NULL || blkdev->disk == NULL)
+        return;
+    
+    queue = blkdev->disk->requestQueue;
+
+    BlockPlugQueue(queue);
+    for (i = 0; i < count; i++) {
+        bh = PrefetchBlock(devno, blocks[i]);
+        /* 请求持有自己的引用，这里直接释放 */
+        if (bh != NULL)
+            BufferPut(bh);
+    }
+    BlockUnplugQueue(queue);
+}
+
+/**
+ * Bget - 获取一个块，不读取数据(Buffer Get)
+ * @devno: 设备号
+ * @block: 块号
+ * 
+ * 用于整个块都会被覆盖的写入，不需要先从磁盘读取。
+ * 返回的缓冲可能不是有效的，使用完后需要用Brelease释放
+ */
+PUBLIC struct BufferHead *Bget(dev_t devno, sector_t block)
+{
+    struct BufferHead *bh = GetBlock(devno, block);
+    if (bh == NULL)
+        printk("Bget: Get block failed!\n");
+    return bh;
+}
+
+/**
+ * BufferBeginWrite - 开始直接修改缓冲的数据
+ * @bh: 持有引用的缓冲头
+ * 
+ * 锁定缓冲，等待正在进行的读写完成，避免修改数据的时候写回线程
+ * 正在把它写入磁盘。之后可以直接修改bh->data，完成后调用BufferEndWrite
+ */
+PUBLIC void BufferBeginWrite(struct BufferHead *bh)
+{
+    SemaphoreDown(&bh->sema);
+    LockBuffer(bh);
+}
+
+/**
+ * BufferEndWrite - 结束修改缓冲的数据
+ * @bh: 缓冲头
+ * 
+ * 把缓冲标记为脏，并解除锁定。
+ * 不保留块缓冲的磁盘马上写回，释放后就可以回收
+ */
+PUBLIC void BufferEndWrite(struct BufferHead *bh)
+{
+    /* 标记块为脏 */
+    MarkBufferDirty(bh);
+
+    /* 标记为有效数据
+    如果不标记为有效，那么在读取数据的时候，就会到磁盘去读取数据
+    导致原有的写入磁盘的数据而未同步到磁盘的数据被覆盖（可能被空数据覆盖）
+     */
+    bh->uptodate = 1;
+    
+    UnlockBuffer(bh);
+    SemaphoreUp(&bh->sema);
+
+    if (BufferNoCache(bh))
+        BsyncOne(bh);
+}
+
 /**
  * Bwrite - 写入一个块到缓冲头(Buffer Write)
  * @devno: 设备号
@@ -261,29 +593,19 @@ PUBLIC struct BufferHead *Bwrite(dev_t devno, sector_t block, void *buffer)
 {
     struct BufferHead *bh;
     //printk("Bwrite:start\n");
-    if (!(bh = GetBlock(devno, block)))   // 获取一个buffer head
-        Panic("Bwrite: Get block failed!\n");
+    if (!(bh = GetBlock(devno, block))) {  // 获取一个buffer head
+        printk("Bwrite: Get block failed!\n");
+        return NULL;
+    }
     
     //printk("Bwrite:get a bh\n");
     //DumpBH(bh);
-    SemaphoreDown(&bh->sema);
-    
-    /* 如果上锁了，就需要等待解锁 */
-    WaitOnBuffer(bh);
+    BufferBeginWrite(bh);
     
     /* 把数据写入到缓冲头 */
     memcpy(bh->data, buffer, BLOCK_SIZE);
 
-    /* 标记块为脏 */
-    bh->dirty = 1;
-
-    /* 标记为有效数据
-    如果不标记为有效，那么在读取数据的时候，就会到磁盘去读取数据
-    导致原有的写入磁盘的数据而未同步到磁盘的数据被覆盖（可能被空数据覆盖）
-     */
-    bh->uptodate = 1;
-    
-    SemaphoreUp(&bh->sema);
+    BufferEndWrite(bh);
     
     return bh;
 }
@@ -292,7 +614,7 @@ PUBLIC struct BufferHead *Bwrite(dev_t devno, sector_t block, void *buffer)
  * BsyncOne - 把块同步到磁盘(Buffer Sync One)
  * @bh: 块缓冲头
  * 
- * 把一个缓冲头对应的数据同步回磁盘
+ * 把一个缓冲头对应的数据同步回磁盘，调用者需要持有缓冲的引用
  * 成功返回0，失败返回-1
  */
 PUBLIC int BsyncOne(struct BufferHead *bh)
@@ -316,59 +638,401 @@ PUBLIC int BsyncOne(struct BufferHead *bh)
         return 0;
     }
     printk("Bwrite: write block failed!");
-    /* 获取读取数据失败，释放掉buffer head */
-    Brelease(bh);
     return -1;
 }
 
 /**
- * Bsync - 同步所有脏缓冲(Buffer Sync)
- * 
- * 对所有磁盘中的所有缓冲进行一次同步
+ * MarkBufferDirty - 把缓冲标记为脏
+ * @bh: 缓冲头
+ *
+ * 第一次变脏时记录时间，并按照（设备号，块号）插入到脏缓冲链表。
+ * 新的脏缓冲一般在后面，所以从链表末尾往前查找插入的位置。
+ * 脏缓冲太多时唤醒写回线程
  */
-PUBLIC int Bsync()
+PUBLIC void MarkBufferDirty(struct BufferHead *bh)
+{
+    struct BufferHead *pos;
+
+    unsigned long flags = InterruptSave();
+
+    if (!bh->dirty) {
+        bh->dirty = 1;
+        bh->dirtyTime = systicks;
+
+        ListForEachOwnerReverse(pos, &dirtyBufferList, dirtyList) {
+            if (pos->devno < bh->devno ||
+                (pos->devno == bh->devno && pos->lba < bh->lba))
+                break;
+        }
+        /* 没有找到时pos->dirtyList就是链表头，插入到最前面 */
+        ListAdd(&bh->dirtyList, &pos->dirtyList);
+        dirtyCount++;
+
+        if (dirtyCount >= WRITEBACK_THRESHOLD && writebackSleeping)
+            TaskWakeUp(writebackTask);
+    }
+
+    InterruptRestore(flags);
+}
+
+/**
+ * ClearBufferDirty - 清除缓冲的脏标记
+ * @bh: 缓冲头
+ *
+ * 写入磁盘成功后调用，从脏缓冲链表中删除，可以在结束请求的中断中调用
+ */
+PUBLIC void ClearBufferDirty(struct BufferHead *bh)
+{
+    unsigned long flags = InterruptSave();
+
+    if (bh->dirty) {
+        bh->dirty = 0;
+        ListDel(&bh->dirtyList);
+        dirtyCount--;
+    }
+
+    InterruptRestore(flags);
+}
+
+/**
+ * CollectDirtyBuffers - 从脏缓冲链表中取出一批缓冲
+ * @bhs: 保存取出的缓冲
+ * @expire: 只取出变脏超过这个时间的缓冲，为0就不管时间
+ *
+ * 按照链表的顺序，只取出同一个设备上的缓冲，并持有它们的引用。
+ * 返回取出的数量
+ */
+PRIVATE unsigned int CollectDirtyBuffers(struct BufferHead **bhs, clock_t expire)
 {
-    struct Disk *disk = NULL;
     struct BufferHead *bh;
-    
-    /* 同步成功数 */
-    int count = 0; 
-    /* 获取磁盘 */
-    ListForEachOwner(disk, &allDiskList, list) {
-        bh = NULL;
-        /* 获取磁盘中的的缓冲 */
-        ListForEachOwner(bh ,&disk->bufferHeadList, list) {
-            //printk("%d ", bh->dirty);
-    
-            if (!BsyncOne(bh)) {
-                count++;
+    unsigned int n = 0;
+
+    unsigned long flags = InterruptSave();
+
+    ListForEachOwner(bh, &dirtyBufferList, dirtyList) {
+        if (n > 0 && bh->devno != bhs[0]->devno)
+            break;
+        if (expire && systicks - bh->dirtyTime < expire)
+            continue;
+
+        GrabBuffer(bh);
+        bhs[n++] = bh;
+        if (n >= WRITEBACK_BATCH)
+            break;
+    }
+
+    InterruptRestore(flags);
+    return n;
+}
+
+/**
+ * WriteBuffers - 写回一批缓冲并等待完成
+ * @bhs: 持有引用的缓冲，需要在同一个设备上
+ * @count: 缓冲数
+ *
+ * 先暂停设备的请求队列，全部提交后再恢复，相邻的块会合并成多扇区的请求。
+ * 已经上锁的缓冲正在读写，只等待它完成。最后释放缓冲的引用，
+ * 返回写回后不再是脏的缓冲数
+ */
+PRIVATE int WriteBuffers(struct BufferHead **bhs, unsigned int count)
+{
+    struct RequestQueue *queue = NULL;
+    unsigned int i;
+    int written = 0;
+
+    struct BlockDevice *blkdev = GetBlockDeviceByDevno(bhs[0]->devno);
+    if (blkdev != NULL && blkdev->disk != NULL)
+        queue = blkdev->disk->requestQueue;
+
+    if (queue)
+        BlockPlugQueue(queue);
+    for (i = 0; i < count; i++) {
+        if (TryLockBuffer(bhs[i]))
+            SubmitRequest(MAJOR(bhs[i]->devno), BLOCK_WRITE, bhs[i]);
+    }
+    if (queue)
+        BlockUnplugQueue(queue);
+
+    for (i = 0; i < count; i++) {
+        WaitOnBuffer(bhs[i]);
+        if (!bhs[i]->dirty)
+            written++;
+        Brelease(bhs[i]);
+    }
+    return written;
+}
+
+/**
+ * WritebackThread - 写回线程
+ * @arg: 没有使用
+ *
+ * 每隔一段时间醒来，把变脏超过WRITEBACK_EXPIRE的缓冲按块号顺序批量写回。
+ * 脏缓冲太多时会被提前唤醒，不管时间一直写回到阈值的一半以下。
+ * 一批缓冲都写回失败就不再重试，等到下一次醒来
+ */
+PRIVATE void WritebackThread(void *arg)
+{
+    struct BufferHead *bhs[WRITEBACK_BATCH];
+    unsigned int n;
+    clock_t expire;
+
+    while (1) {
+        writebackSleeping = 1;
+        TaskSleep(WRITEBACK_INTERVAL);
+        writebackSleeping = 0;
+
+        do {
+            expire = dirtyCount > WRITEBACK_THRESHOLD / 2 ? 0 : WRITEBACK_EXPIRE;
+            n = CollectDirtyBuffers(bhs, expire);
+        } while (n > 0 && WriteBuffers(bhs, n) > 0);
+    }
+}
+
+/**
+ * BsyncBlocks - 同步指定的块(Buffer Sync Blocks)
+ * @devno: 设备号
+ * @blocks: 块号数组，不需要连续
+ * @count: 块数
+ *
+ * 只写回这些块中的脏缓冲并等待完成，不在缓冲中的块直接跳过，
+ * 用于只关心一个文件的同步。全部写回成功返回0，失败返回-1
+ */
+PUBLIC int BsyncBlocks(dev_t devno, sector_t *blocks, unsigned int count)
+{
+    struct BufferHead *bhs[WRITEBACK_BATCH], *bh;
+    unsigned int i = 0, n;
+    int ret = 0;
+
+    struct BlockDevice *blkdev = GetBlockDeviceByDevno(devno);
+    if (blkdev == NULL || blkdev->disk == NULL)
+        return -1;
+
+    while (i < count) {
+        for (n = 0; i < count && n < WRITEBACK_BATCH; i++) {
+            bh = GetBufferFromDisk(blkdev->disk, blocks[i], blkdev->blockSize);
+            if (bh == NULL)
+                continue;
+            /* 干净并且没有在读写的缓冲不需要等待 */
+            if (!bh->dirty && !bh->locked) {
+                BufferPut(bh);
+                continue;
             }
+            bhs[n++] = bh;
         }
+        if (n > 0 && WriteBuffers(bhs, n) != (int)n)
+            ret = -1;
     }
-    return count;
+    return ret;
+}
+
+/**
+ * CollectMatchingBuffers - 取出一个设备上符合条件的脏缓冲
+ * @bhs: 保存取出的缓冲
+ * @devno: 设备号
+ * @owner: 所属文件的标识，为0表示不按文件查找
+ * @start: 块号范围的开始
+ * @end: 块号范围的结束（不包含）
+ *
+ * 属于owner或者块号在范围中的脏缓冲都会被取出，并持有它们的引用。
+ * 返回取出的数量
+ */
+PRIVATE unsigned int CollectMatchingBuffers(struct BufferHead **bhs, dev_t devno,
+    unsigned int owner, sector_t start, sector_t end)
+{
+    struct BufferHead *bh;
+    unsigned int n = 0;
+
+    unsigned long flags = InterruptSave();
+
+    ListForEachOwner(bh, &dirtyBufferList, dirtyList) {
+        if (bh->devno != devno)
+            continue;
+        if (!(owner && bh->owner == owner) && !(bh->lba >= start && bh->lba < end))
+            continue;
+
+        GrabBuffer(bh);
+        bhs[n++] = bh;
+        if (n >= WRITEBACK_BATCH)
+            break;
+    }
+
+    InterruptRestore(flags);
+    return n;
+}
+
+/**
+ * SyncMatchingBuffers - 写回一个设备上符合条件的脏缓冲
+ * @devno: 设备号
+ * @owner: 所属文件的标识，为0表示不按文件查找
+ * @start: 块号范围的开始
+ * @end: 块号范围的结束（不包含）
+ *
+ * 只遍历脏缓冲链表，和文件大小无关。全部写回成功返回0，失败返回-1
+ */
+PRIVATE int SyncMatchingBuffers(dev_t devno, unsigned int owner, sector_t start, sector_t end)
+{
+    struct BufferHead *bhs[WRITEBACK_BATCH];
+    unsigned int n;
+
+    while ((n = CollectMatchingBuffers(bhs, devno, owner, start, end)) > 0) {
+        /* 写回失败的缓冲还在链表中，不再重试 */
+        if (WriteBuffers(bhs, n) != (int)n)
+            return -1;
+    }
+    return 0;
+}
+
+/**
+ * BsyncOwner - 同步属于一个文件的脏缓冲(Buffer Sync Owner)
+ * @devno: 设备号
+ * @owner: 所属文件的标识，不能为0
+ *
+ * 成功返回0，失败返回-1
+ */
+PUBLIC int BsyncOwner(dev_t devno, unsigned int owner)
+{
+    if (!owner)
+        return -1;
+    return SyncMatchingBuffers(devno, owner, 0, 0);
+}
+
+/**
+ * BsyncRange - 同步一段块中的脏缓冲(Buffer Sync Range)
+ * @devno: 设备号
+ * @start: 第一个块
+ * @count: 块数
+ *
+ * 成功返回0，失败返回-1
+ */
+PUBLIC int BsyncRange(dev_t devno, sector_t start, sector_t count)
+{
+    return SyncMatchingBuffers(devno, 0, start, start + count);
 }
 
 /**
  * Bsync - 同步所有脏缓冲(Buffer Sync)
- * 
- * 对所有磁盘中的所有缓冲进行一次同步
+ *
+ * 按照脏缓冲链表的顺序批量写回，并等待完成。
+ * 返回写回的缓冲数
+ */
+PUBLIC int Bsync()
+{
+    struct BufferHead *bhs[WRITEBACK_BATCH];
+    unsigned int n;
+    int written, count = 0;
+
+    while ((n = CollectDirtyBuffers(bhs, 0)) > 0) {
+        written = WriteBuffers(bhs, n);
+        /* 写回失败的缓冲还在链表中，不再重试 */
+        if (!written)
+            break;
+        count += written;
+    }
+    return count;
+}
+
+/**
+ * Binvalidate - 作废一个设备上从某个扇区开始的缓冲(Buffer Invalidate)
+ * @devno: 设备号
+ * @sector: 起始扇区
+ *
+ * 设备变小时调用，覆盖了sector及之后扇区的缓冲不能再写回，也不能再使用里面的数据。
+ * 丢弃它们的脏标记，没有使用者的直接销毁，还有使用者的标记为无效，下次读取时重新读取
+ */
+PUBLIC void Binvalidate(dev_t devno, sector_t sector)
+{
+    struct BufferHead *bh, *next;
+    sector_t sectors;
+
+    struct BlockDevice *blkdev = GetBlockDeviceByDevno(devno);
+    if (blkdev == NULL || blkdev->disk == NULL)
+        return;
+
+    unsigned long flags = InterruptSave();
+
+    ListForEachOwnerSafe(bh, next, &blkdev->disk->bufferHeadList, list) {
+        if (bh->devno != devno)
+            continue;
+        /* 缓冲的lba以块为单位 */
+        sectors = bh->size / SECTOR_SIZE;
+        if ((bh->lba + 1) * sectors <= sector)
+            continue;
+        
+        ClearBufferDirty(bh);
+        bh->uptodate = 0;
+
+        if (!AtomicGet(&bh->count) && !bh->locked)
+            DestroyBuffer(bh);
+    }
+
+    InterruptRestore(flags);
+}
+
+/**
+ * DirtyCheck - 输出所有脏缓冲
+ *
+ * 返回脏缓冲的数量
  */
 PUBLIC int DirtyCheck()
 {
-    struct Disk *disk = NULL;
     struct BufferHead *bh;
-    
-    /* 获取磁盘 */
-    ListForEachOwner(disk, &allDiskList, list) {
-        bh = NULL;
-        /* 获取磁盘中的的缓冲 */
-        ListForEachOwner(bh ,&disk->bufferHeadList, list) {
-            if (bh->dirty) {
-                printk("%d ", bh->lba);
-            }
-        }
+
+    unsigned long flags = InterruptSave();
+    ListForEachOwner(bh, &dirtyBufferList, dirtyList) {
+        printk("%d ", bh->lba);
     }
-    return 0;
+    InterruptRestore(flags);
+    return dirtyCount;
+}
+
+/**
+ * BufferCacheSetLimit - 设置缓冲数量的上限
+ * @limit: 上限
+ */
+PUBLIC void BufferCacheSetLimit(unsigned int limit)
+{
+    bufferLimit = limit;
+
+    /* 超过新的上限，就回收多出来的缓冲 */
+    if (bufferCount > bufferLimit)
+        EvictBuffers(bufferCount - bufferLimit);
+}
+
+/**
+ * BufferCacheShrink - 收缩缓冲
+ * 
+ * 释放所有没有使用者的干净缓冲，返回释放的字节数
+ */
+PUBLIC int BufferCacheShrink()
+{
+    return EvictBuffers(0);
+}
+
+/**
+ * InitBufferCache - 初始化块缓冲
+ */
+PUBLIC void InitBufferCache()
+{
+    int i;
+    for (i = 0; i < BUFFER_HASH_NR; i++) {
+        INIT_LIST_HEAD(&bufferHashTable[i]);
+    }
+    bufferCount = 0;
+    dirtyCount = 0;
+
+    /* 注册收缩器，内存紧张时释放缓冲 */
+    bufferShrinker.shrink = BufferCacheShrink;
+    RegisterMemShrinker(&bufferShrinker);
+}
+
+/**
+ * InitBufferWriteback - 启动写回线程
+ * 
+ * 需要在任务初始化之后调用
+ */
+PUBLIC void InitBufferWriteback()
+{
+    writebackTask = ThreadStart("writeback", TASK_PRIORITY_RT, WritebackThread, NULL);
 }
 
 /**
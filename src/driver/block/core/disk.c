@@ -33,6 +33,7 @@ PUBLIC struct Disk *AllocDisk(int minors)
 
     /* 初始化基础信息 */
     disk->minors = minors;
+    disk->flags = 0;
 
     if (disk->minors > 0) {        
         /* 根据minors创建对应的分区指针 */
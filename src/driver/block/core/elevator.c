@@ -151,6 +151,10 @@ PUBLIC void ElevatorIoSchedule(struct RequestQueue *queue, struct Request *reque
     /* 如果队列是空的，那么就直接插入到链表头 */
     if (ListEmpty(queue->requestList)) {
         ListAdd(&request->queueList, queue->requestList);
+    } else if (queue->currentRequest == NULL) {
+        /* 通道被其它操作占用时，队列中可能有请求但还没有当前请求，
+        没有参照的位置，就排在最后 */
+        ListAddTail(&request->queueList, queue->requestList);
     } else {
         /* 进行调度 */
         /* 当前请求队列是上请求 */
@@ -162,3 +166,91 @@ PUBLIC void ElevatorIoSchedule(struct RequestQueue *queue, struct Request *reque
         }
     }
 }
+
+/**
+ * ElevatorKeepOrder - 修改请求的lba后是否还能保持链表的顺序
+ * @list: 请求链表
+ * @request: 链表中的请求
+ * @lba: 新的lba，比原来的小
+ * 
+ * 链表按照lba排序（上请求递增，下请求递减），只需要检查相邻的两个请求，
+ * 原来比请求小的相邻请求不能比新的lba大。能保持返回1，不能返回0
+ */
+PRIVATE int ElevatorKeepOrder(struct List *list, struct Request *request, sector_t lba)
+{
+    struct Request *near;
+
+    if (request->queueList.prev != list) {
+        near = ListOwner(request->queueList.prev, struct Request, queueList);
+        if (near->lba < request->lba && near->lba > lba)
+            return 0;
+    }
+    if (request->queueList.next != list) {
+        near = ListOwner(request->queueList.next, struct Request, queueList);
+        if (near->lba < request->lba && near->lba > lba)
+            return 0;
+    }
+    return 1;
+}
+
+/**
+ * ElevatorTryMerge - 尝试把请求合并到链表中的请求
+ * @queue: 请求队列
+ * @list: 请求链表
+ * @request: 新请求
+ * 
+ * 找到和新请求在磁盘上相邻的同类请求，把新请求的缓冲头连接到它的前面或者后面，
+ * 合并成一个多扇区的请求。合并成功返回1，失败返回0
+ */
+PRIVATE int ElevatorTryMerge(struct RequestQueue *queue, struct List *list,
+    struct Request *request)
+{
+    struct Request *tmp;
+
+    ListForEachOwner(tmp, list, queueList) {
+        if (tmp->cmd != request->cmd || tmp->devno != request->devno)
+            continue;
+        
+        /* 合并后不能超过队列的限制 */
+        if (tmp->count + request->count > queue->maxSectors ||
+            tmp->segments + request->segments > queue->maxSegments)
+            continue;
+        
+        if (tmp->lba + tmp->count == request->lba) {
+            /* 新请求紧跟在后面，连接到缓冲头链表的末尾 */
+            tmp->bhTail->reqNext = request->bh;
+            tmp->bhTail = request->bhTail;
+            queue->backMerges++;
+        } else if (request->lba + request->count == tmp->lba &&
+            ElevatorKeepOrder(list, tmp, request->lba)) {
+            /* 新请求刚好在前面，连接到缓冲头链表的开头，
+            lba变小后不能打乱链表的顺序 */
+            request->bhTail->reqNext = tmp->bh;
+            tmp->bh = request->bh;
+            tmp->buffer = request->buffer;
+            tmp->lba = request->lba;
+            queue->frontMerges++;
+        } else {
+            continue;
+        }
+        tmp->count += request->count;
+        tmp->segments += request->segments;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * ElevatorMergeRequest - 合并请求
+ * @queue: 队列
+ * @request: 请求
+ * 
+ * 在还没有执行的请求中查找可以合并的请求，合并成功后新请求就不再需要了，
+ * 需要在关闭中断的情况下调用。合并成功返回1，失败返回0
+ */
+PUBLIC int ElevatorMergeRequest(struct RequestQueue *queue, struct Request *request)
+{
+    if (ElevatorTryMerge(queue, &queue->upRequestList, request))
+        return 1;
+    return ElevatorTryMerge(queue, &queue->downRequestList, request);
+}
@@ -8,6 +8,7 @@
 #include <book/debug.h>
 #include <lib/string.h>
 #include <book/task.h>
+#include <book/memcache.h>
 
 #include <block/block.h>
 #include <block/blk-request.h>
@@ -15,28 +16,8 @@
 #include <block/blk-disk.h>
 #include <block/blk-elevator.h>
 
-/* 完成的请求的链表 */
-LIST_HEAD(doneRequestListHead);
-
-/**
- * GetRequestFromDoneList - 从完成请求队列中获取一个请求
- * 
- * 当一个请求被使用之后，就会把它添加到完成请求队列。这样可以将它重复利用
- */
-PRIVATE struct Request *GetRequestFromDoneList()
-{
-    struct Request *req;
-
-    if (ListEmpty(&doneRequestListHead)) {
-        return NULL;
-    }
-    /* 剩余则摘取一个并返回 */
-    req = ListFirstOwner(&doneRequestListHead, struct Request, queueList);
-    
-    ListDel(&req->queueList);
-
-    return req;
-}
+/* 请求的专用缓存，完成的请求释放回缓存，可以重复利用 */
+PRIVATE struct MemCache *requestCache;
 
 /**
  * SwitchRequestList - 切换请求链表指向
@@ -70,32 +51,107 @@ PRIVATE void SwitchRequestList(struct RequestQueue *queue)
  */
 PRIVATE void AddRequest(struct RequestQueue *queue, struct Request *req)
 {
-    struct Request *tmp;
+    char start = 0;
 
     /* 准备添加到请求队列的时候，不允许产生其它进程进行访问 */
     unsigned long flags = InterruptSave();
     
     /* 记录请求所在的队列 */
     req->queue = queue;
+    queue->requests++;
+
+    /* 先尝试合并到还没执行的相邻请求中，合并后这个请求就可以回收了 */
+    if (ElevatorMergeRequest(queue, req)) {
+        MemCacheFree(requestCache, req);
+        InterruptRestore(flags);
+        return;
+    }
 
     /* 把请求插入合适的位置 */
     ElevatorIoSchedule(queue, req);
     
-    /* 如果请求队列没有请求，就立即执行当前请求 */
-    tmp = queue->currentRequest;
-
-	InterruptRestore(flags);
-
-    if (tmp == NULL) {
+    /* 如果请求队列没有请求，并且没有暂停，就立即执行当前请求 */
+    if (queue->currentRequest == NULL && !queue->plugged) {
         /* 更新当前请求 */
         queue->currentRequest = req;
+        start = 1;
+    }
+	InterruptRestore(flags);
 
+    /* 
+     * 队列正在处理请求时，新请求会在之前的请求结束后被取出执行，
+     * 调用者在缓冲区上等待请求完成即可，这里不需要休眠
+     */
+    if (start)
         BlockStartRequeue(req);
-        return;
-    }
+}
+
+/**
+ * BlockPlugQueue - 暂停执行请求
+ * @queue: 请求队列
+ * 
+ * 在批量提交请求之前调用，暂停期间提交的请求只会排队，
+ * 这样相邻的请求就可以合并成一个多扇区的请求
+ */
+PUBLIC void BlockPlugQueue(struct RequestQueue *queue)
+{
+    unsigned long flags = InterruptSave();
+    queue->plugged++;
+    InterruptRestore(flags);
+}
+
+/**
+ * BlockUnplugQueue - 恢复执行请求
+ * @queue: 请求队列
+ * 
+ * 和BlockPlugQueue成对使用，恢复后如果队列空闲就开始执行排队的请求
+ */
+PUBLIC void BlockUnplugQueue(struct RequestQueue *queue)
+{
+    struct Request *req = NULL;
+
+    unsigned long flags = InterruptSave();
+    if (queue->plugged > 0)
+        queue->plugged--;
     
-    /* 如果需要等待请求队列，那么自己就先休眠 */
-    TaskSleepOn(CurrentTask());
+    if (!queue->plugged && queue->currentRequest == NULL) {
+        if (ListEmpty(queue->requestList))
+            SwitchRequestList(queue);
+        req = ListFirstOwnerOrNull(queue->requestList, struct Request, queueList);
+        queue->currentRequest = req;
+    }
+    InterruptRestore(flags);
+
+    if (req != NULL)
+        BlockStartRequeue(req);
+}
+
+/**
+ * BlockQueueLimits - 设置请求合并的限制
+ * @queue: 请求队列
+ * @maxSectors: 一个请求最多的扇区数
+ * @maxSegments: 一个请求最多的缓冲头数
+ * 
+ * 驱动根据自己一次命令能传输的数据量来设置
+ */
+PUBLIC void BlockQueueLimits(struct RequestQueue *queue,
+    unsigned int maxSectors, unsigned int maxSegments)
+{
+    queue->maxSectors = maxSectors;
+    queue->maxSegments = maxSegments;
+}
+
+/**
+ * BlockQueueMakeRequest - 设置直接处理缓冲的函数
+ * @queue: 请求队列
+ * @makeRequest: 处理函数
+ * 
+ * 数据已经在内存中的设备（ramdisk）不需要排序和合并请求，
+ * 提交缓冲时直接调用它完成读写，不会生成请求
+ */
+PUBLIC void BlockQueueMakeRequest(struct RequestQueue *queue, MakeRequestFunction_t makeRequest)
+{
+    queue->makeRequest = makeRequest;
 }
 
 /**
@@ -119,11 +175,44 @@ PUBLIC struct RequestQueue *BlockInitQueue(RequestFunction_t callback, void *que
     rq->currentRequest = NULL;
     rq->queuedata = queuedata;
 
+    rq->plugged = 0;
+    rq->maxSectors = BLOCK_MAX_SECTORS;
+    rq->maxSegments = BLOCK_MAX_SEGMENTS;
+    rq->requests = rq->backMerges = rq->frontMerges = 0;
+
     rq->requestFunction = callback;
+    rq->makeRequest = NULL;
 
     return rq;
 }
 
+/**
+ * BlockEndBuffer - 结束一个缓冲的读写
+ * @bh: 缓冲头
+ * @cmd: 读/写操作
+ * @errors: 发生的错误数
+ * 
+ * 设置缓冲的状态并解锁，调用者需要关闭中断
+ */
+PRIVATE void BlockEndBuffer(struct BufferHead *bh, int cmd, int errors)
+{
+    /* 只有传输成功了，缓冲区的数据才有效 */
+    if (!errors) {
+        bh->uptodate = 1;
+    } else if (cmd == BLOCK_READ) {
+        bh->uptodate = 0;
+    }
+
+    /* 写命令成功才清理脏位 */
+    if (cmd == BLOCK_WRITE && !errors) {
+        /* 把缓冲区的脏位去掉，因为已经写入到磁盘了 */
+        ClearBufferDirty(bh);
+    }
+    
+    /* 解除阻塞，唤醒等待缓冲的任务 */
+    UnlockBuffer(bh);
+}
+
 /**
  * MakeRequest - 生成一个请求
  * @major: 主设备号
@@ -140,6 +229,19 @@ PUBLIC void MakeRequest(int major, int rw, struct BufferHead *bh)
 
     LockBuffer(bh);
 
+    SubmitRequest(major, rw, bh);
+}
+
+/**
+ * SubmitRequest - 提交已经上锁的缓冲
+ * @major: 主设备号
+ * @rw: 读/写操作
+ * @bh: 缓冲头，调用者已经锁定
+ * 
+ * 不需要读写时直接解锁，否则生成请求，请求结束时解锁
+ */
+PUBLIC void SubmitRequest(int major, int rw, struct BufferHead *bh)
+{
     /* 如果是写，并且没有脏数据，就直接返回。
     如果是读，并且数据有效，就直接返回 */
     if ((rw == BLOCK_WRITE && !bh->dirty) ||
@@ -149,25 +251,33 @@ PUBLIC void MakeRequest(int major, int rw, struct BufferHead *bh)
         return;
     }
 
+    /* 通过major获取对应的设备的disk */
+    struct BlockDevice *dev = GetBlockDeviceByDevno(bh->devno);
+    if (dev == NULL) {
+        UnlockBuffer(bh);
+        return;
+    }
+
+    /* 设备可以直接处理缓冲，就不需要生成请求 */
+    struct RequestQueue *queue = dev->disk->requestQueue;
+    if (queue->makeRequest != NULL) {
+        int errors = queue->makeRequest(queue, rw, bh);
+        
+        unsigned long flags = InterruptSave();
+        BlockEndBuffer(bh, rw, errors);
+        InterruptRestore(flags);
+        return;
+    }
+
     /* 初始化请求信息 */
     struct Request *req;
     
-    req = GetRequestFromDoneList();
-    if (req == NULL) 
-        req = kmalloc(SIZEOF_REQUEST, GFP_KERNEL);
-    
+    req = MemCacheAlloc(requestCache, GFP_KERNEL);
     if (req == NULL) {
         UnlockBuffer(bh);
         return;
     }
     memset(req, 0, SIZEOF_REQUEST);
-
-    /* 通过major获取对应的设备的disk */
-    struct BlockDevice *dev = GetBlockDeviceByDevno(bh->devno);
-    if (dev == NULL) {
-        UnlockBuffer(bh);
-        return;
-    }
     
     req->buffer = bh->data;
     req->devno = bh->devno;
@@ -181,6 +291,9 @@ PUBLIC void MakeRequest(int major, int rw, struct BufferHead *bh)
     req->lba = bh->lba * req->count;
     req->errors = 0;
     req->bh = bh;
+    req->bhTail = bh;
+    req->segments = 1;
+    bh->reqNext = NULL;
 
     /* 绑定磁盘 */
     req->disk = dev->disk;
@@ -188,8 +301,11 @@ PUBLIC void MakeRequest(int major, int rw, struct BufferHead *bh)
     /* 当前任务就是等待者 */
     req->waiter = CurrentTask();    
 
+    /* 请求持有缓冲的引用，请求结束时释放 */
+    GetBH(bh);
+
     /* 把请求添加到磁盘的请求队列 */
-    AddRequest(dev->disk->requestQueue, req);
+    AddRequest(queue, req);
 }
 
 /**
@@ -261,6 +377,8 @@ ToEnd:
  */
 PUBLIC void BlockEndRequest(struct Request *request, int errors)
 {
+    struct BufferHead *bh, *next;
+
     if (request == NULL)
         return;
 
@@ -270,34 +388,27 @@ PUBLIC void BlockEndRequest(struct Request *request, int errors)
     /* 记录请求错误数，可以根据请求的错误数做一些设定 */
     request->errors += errors;
     
-    if (request->bh) {
-        request->bh->uptodate = 1;
-
-        /* 写命令才清理脏位 */
-        if (request->cmd == BLOCK_WRITE) {
-            /* 把缓冲区的脏位去掉，因为已经写入到磁盘了 */
-            request->bh->dirty = 0;
-        }
-        
-        /* 解除阻塞 */
-        UnlockBuffer(request->bh);
+    /* 合并后的请求有多个缓冲头，每一个都要结束 */
+    for (bh = request->bh; bh != NULL; bh = next) {
+        next = bh->reqNext;
+        bh->reqNext = NULL;
 
-        /* 释放对它的占用 */
-        PutBH(request->bh);
+        BlockEndBuffer(bh, request->cmd, errors);
 
-        if (!request->bh->uptodate) {
-            printk("device %d I/O error!\n", request->devno);
-        }
+        /* 释放对它的占用，可能是最后一个引用（异步预读） */
+        BufferPut(bh);
+    }
+    request->bh = request->bhTail = NULL;
+    
+    if (errors) {
+        printk("device %d I/O error!\n", request->devno);
     }
-
-    /* 唤醒等待请求中的任务 */
-    TaskWakeUp(request->waiter);
 
     /* 结束请求的时候设置当前请求为空 */
     request->queue->currentRequest = NULL;
     
-    /* 把request添加到完成队列，以便重复利用 */
-    ListAdd(&request->queueList, &doneRequestListHead);
+    /* 把request释放回缓存，以便重复利用 */
+    MemCacheFree(requestCache, request);
 
     InterruptRestore(flags);
 }
@@ -314,13 +425,26 @@ PUBLIC void BlockCleanUpQueue(struct RequestQueue *queue)
         kfree(queue);
 }
 
+/**
+ * InitBlockRequest - 初始化请求
+ * 
+ * 在初始化块设备驱动之前调用
+ */
+PUBLIC void InitBlockRequest()
+{
+    requestCache = CreateMemCache("block request", SIZEOF_REQUEST, 0, 0, NULL);
+    if (requestCache == NULL)
+        Panic("create block request cache failed!\n");
+}
+
 PUBLIC void DumpRequest(struct Request *request)
 {
     printk(PART_TIP "----Request----\n");
     printk(PART_TIP "queue:%x disk:%x bh:%x data:%x \n",
         request->queue, request->disk, request->bh, request->buffer);
-    printk(PART_TIP "devno:%x cmd:%d errors:%d lba:%d count:%d\n", 
-        request->devno, request->cmd, request->errors, request->lba, request->count);
+    printk(PART_TIP "devno:%x cmd:%d errors:%d lba:%d count:%d segments:%d\n", 
+        request->devno, request->cmd, request->errors, request->lba, request->count,
+        request->segments);
 }
 
 PUBLIC void DumpRequestQueue(struct RequestQueue *queue)
@@ -328,4 +452,6 @@ PUBLIC void DumpRequestQueue(struct RequestQueue *queue)
     printk(PART_TIP "----Request Queue----\n");
     printk(PART_TIP "function:%x current:%x data:%x \n",
         queue->requestFunction, queue->currentRequest, queue->queuedata);
+    printk(PART_TIP "requests:%d back merges:%d front merges:%d\n",
+        queue->requests, queue->backMerges, queue->frontMerges);
 }
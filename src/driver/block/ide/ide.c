@@ -12,6 +12,8 @@
 #include <book/ioqueue.h>
 #include <book/device.h>
 #include <book/task.h>
+#include <book/waitqueue.h>
+#include <book/timer.h>
 
 #include <lib/stddef.h>
 #include <lib/string.h>
@@ -26,6 +28,9 @@
 #include <block/block.h>
 #include <block/ide/ide.h>
 
+#include <clock/clock.h>
+#include <pci/pci.h>
+
 /* 配置开始 */
 //#define _DEBUG_IDE_INFO
 //#define _DEBUG_IDE
@@ -119,6 +124,49 @@
 /* 设备寄存器的位 */
 #define BIT_DEV_MBS		0xA0	//bit 7 and 5 are 1
 
+/* PCI IDE控制器的类型码（大容量存储控制器，IDE控制器） */
+#define IDE_PCI_CLASS		0x0101
+
+/* 总线主控（Bus Master）DMA寄存器，第二个通道在基地址+8的位置 */
+#define BM_REG_CMD(channel)		(channel->bmBase + 0)
+#define BM_REG_STATUS(channel)	(channel->bmBase + 2)
+#define BM_REG_PRDT(channel)	(channel->bmBase + 4)
+
+/* 总线主控命令寄存器的位 */
+#define BM_CMD_START		0x01	/* 开始传输 */
+#define BM_CMD_READ			0x08	/* 1表示写入内存，也就是读磁盘 */
+
+/* 总线主控状态寄存器的位 */
+#define BM_STATUS_ACTIVE	0x01	/* 正在传输 */
+#define BM_STATUS_ERR		0x02	/* 传输出错，写1清除 */
+#define BM_STATUS_IRQ		0x04	/* 产生了中断，写1清除 */
+
+/* 物理区域描述符（PRD）的数量，每个通道一个表 */
+#define IDE_PRD_NR			32
+
+/* PRD表的最后一项 */
+#define IDE_PRD_EOT			0x8000
+
+/* 一个PRD项最多传输64KB，并且不能跨越64KB边界 */
+#define IDE_PRD_BOUNDARY	0x10000
+
+/* DMA传输超时时间 */
+#define IDE_DMA_TIMEOUT		(HZ * 5)
+
+/* 物理区域描述符 */
+struct IdePrd {
+	unsigned int addr;			/* 数据的物理地址 */
+	unsigned short count;		/* 字节数，0表示64KB */
+	unsigned short flags;		/* 最高位表示最后一项 */
+} __attribute__((packed));
+
+/* 每个通道的PRD表，按照表的大小对齐，保证不会跨越64KB边界 */
+PRIVATE struct IdePrd idePrdTable[2][IDE_PRD_NR] 
+	__attribute__((aligned(IDE_PRD_NR * sizeof(struct IdePrd))));
+
+/* 总线主控寄存器基地址，为0表示不支持DMA */
+PRIVATE unsigned short ideBusMasterBase;
+
 /* 生存ATA设备寄存器的值 */
 #define ATA_MKDEV_REG(lbaMode, slave, head) (BIT_DEV_MBS | \
 		0x40 | \
@@ -133,6 +181,18 @@ struct IdeChannel {
    	struct IdeDevice *devices;	// 通道上面的设备
 	char who;		/* 通道上主磁盘在活动还是从磁盘在活动 */
 	char what;		/* 执行的是什么操作 */
+	
+	unsigned short bmBase;	/* 总线主控寄存器基地址，为0表示不支持DMA */
+	char busy;		/* 通道上正在进行传输 */
+	struct WaitQueue waitQueue;	/* 等待通道空闲的任务 */
+	struct Request *dmaRequest;	/* 正在进行DMA传输的请求 */
+	struct IdeDevice *dmaDevice;	/* 正在进行DMA传输的设备 */
+	struct Timer dmaTimer;		/* DMA传输超时定时器 */
+	struct IdePrd *prdTable;	/* PRD表 */
+	char needReset;		/* DMA传输出错，需要重置驱动器 */
+	struct Request *pioRequest;	/* DMA启动失败，改用PIO传输的请求 */
+	struct IdeDevice *pioDevice;	/* PIO传输请求所在的设备 */
+	struct Work serviceWork;	/* 在任务上下文中重置驱动器和PIO传输 */
 } channels[2];
 
 /* IDE块设备结构体 */
@@ -148,6 +208,7 @@ PRIVATE struct IdeDevice {
 	unsigned int capabilities;// Features.
 	unsigned int commandSets; // Command Sets Supported.
 	unsigned int size;		// Size in Sectors.
+	unsigned char dma;		/* 是否使用DMA传输 */
 	/* 状态信息 */
 	unsigned int rdSectors;	// 读取了多少扇区
 	unsigned int wrSectors;	// 写入了多少扇区
@@ -776,8 +837,8 @@ PRIVATE void SelectSector(struct IdeDevice* dev,
 	if (mode == 2) {
 		Out8(ATA_REG_FEATURE(channel), 0); // PIO mode.
 
-		/* 写入要读写的扇区数*/
-		Out8(ATA_REG_SECTOR_CNT(channel), 0);
+		/* 写入要读写的扇区数的高8位 */
+		Out8(ATA_REG_SECTOR_CNT(channel), (count >> 8) & 0xff);
 
 		/* 写入lba地址24~47位(即扇区号) */
 		Out8(ATA_REG_SECTOR_LOW(channel), lbaIO[3]);
@@ -788,7 +849,7 @@ PRIVATE void SelectSector(struct IdeDevice* dev,
 	Out8(ATA_REG_FEATURE(channel), 0); // PIO mode.
 
 	/* 写入要读写的扇区数*/
-	Out8(ATA_REG_SECTOR_CNT(channel), count);
+	Out8(ATA_REG_SECTOR_CNT(channel), count & 0xff);
 
 	/* 写入lba地址0~23位(即扇区号) */
 	Out8(ATA_REG_SECTOR_LOW(channel), lbaIO[0]);
@@ -918,14 +979,107 @@ PRIVATE int PioDataTransfer(struct IdeDevice *dev,
 			buf += SECTOR_SIZE;
             //printk("write success! ");
 		}
-		/* 刷新写缓冲区 */
-		Out8(ATA_REG_CMD(dev->channel), mode > 1 ?
-			ATA_CMD_CACHE_FLUSH_EXT : ATA_CMD_CACHE_FLUSH);
-		IdePolling(dev->channel, 0);
 	}
 	return 0;
 }
 
+/**
+ * PioFlushCache - 刷新磁盘的写缓冲区
+ * @dev: 设备
+ * @mode: 传输模式（CHS和LBA模式）
+ * 
+ * 一次写命令的数据全部传输完后调用
+ */
+PRIVATE void PioFlushCache(struct IdeDevice *dev, unsigned char mode)
+{
+	Out8(ATA_REG_CMD(dev->channel), mode > 1 ?
+		ATA_CMD_CACHE_FLUSH_EXT : ATA_CMD_CACHE_FLUSH);
+	IdePolling(dev->channel, 0);
+}
+
+/**
+ * AtaSendCommand - 发送ATA读写命令
+ * @dev: 设备
+ * @rw: 传输方向（读，写）
+ * @dma: 是否使用DMA
+ * @lba: 逻辑扇区地址
+ * @count: 扇区数，最多256个
+ * 
+ * 选择设备，设置扇区，然后发送命令，返回使用的寻址模式
+ */
+PRIVATE unsigned char AtaSendCommand(struct IdeDevice *dev,
+	unsigned char rw,
+	unsigned char dma,
+	unsigned int lba,
+	unsigned int count)
+{
+	unsigned char mode;	/* 0: CHS, 1:LBA28, 2: LBA48 */
+	unsigned char cmd, head;
+	unsigned char lbaIO[6];	/* 由于最大是48位，所以这里数组的长度为6 */
+	struct IdeChannel *channel = dev->channel;
+
+	/* 选择寻址模式 */
+	// (I) Select one from LBA28, LBA48 or CHS;
+	SelectAddressingMode(dev, lba, &mode, &head, lbaIO);
+
+	/* 等待驱动不繁忙 */
+	// (III) Wait if the drive is busy;
+	while (In8(ATA_REG_STATUS(channel)) & ATA_STATUS_BUSY) CpuNop();// Wait if busy.
+	/* 从控制器中选择设备 */
+	SelectDevice(dev, mode, head);
+
+	/* 填写参数，扇区和扇区数 */
+	SelectSector(dev, mode, lbaIO, count);
+
+	/* 等待磁盘控制器处于准备状态 */
+	while (!(In8(ATA_REG_STATUS(channel)) & ATA_STATUS_READY)) CpuNop();
+
+	/* 选择并发送命令 */
+	SelectCmd(rw, mode, dma, &cmd);
+
+	#ifdef _DEBUG_IDE	
+		printk("lba mode %d num %d io %d %d %d %d %d %d->",
+			mode, lba, lbaIO[0], lbaIO[1], lbaIO[2], lbaIO[3], lbaIO[4], lbaIO[5]);
+		printk("rw %d dma %d cmd %x head %d\n",
+			rw, dma, cmd, head);
+	#endif
+	/* 发送命令 */
+	SendCmd(channel, cmd);
+	return mode;
+}
+
+PRIVATE void IdeDmaKick(struct IdeChannel *channel);
+PRIVATE void IdeDmaTimeout(uint32_t data);
+
+/**
+ * IdeChannelAcquire - 占用通道
+ * @channel: 通道
+ * 
+ * 如果通道上正在进行DMA传输，就等待传输完成
+ */
+PRIVATE void IdeChannelAcquire(struct IdeChannel *channel)
+{
+	unsigned long flags = InterruptSave();
+	WaitEvent(&channel->waitQueue, !channel->busy);
+	channel->busy = 1;
+	InterruptRestore(flags);
+}
+
+/**
+ * IdeChannelRelease - 释放通道
+ * @channel: 通道
+ * 
+ * 唤醒等待通道的任务，并启动等待中的DMA请求
+ */
+PRIVATE void IdeChannelRelease(struct IdeChannel *channel)
+{
+	unsigned long flags = InterruptSave();
+	channel->busy = 0;
+	WaitQueueWakeUpAll(&channel->waitQueue);
+	IdeDmaKick(channel);
+	InterruptRestore(flags);
+}
+
 /**
  * AtaTypeTransfer - ATA类型数据传输
  * @dev: 设备
@@ -943,15 +1097,11 @@ PRIVATE int AtaTypeTransfer(struct IdeDevice *dev,
 	void *buf)
 {
 	unsigned char mode;	/* 0: CHS, 1:LBA28, 2: LBA48 */
-	unsigned char dma; /* 0: No DMA, 1: DMA */
-	unsigned char cmd;	
 	unsigned char *_buf = (unsigned char *)buf;
 
-	unsigned char lbaIO[6];	/* 由于最大是48位，所以这里数组的长度为6 */
-
 	struct IdeChannel *channel = dev->channel;
 
-   	unsigned char head, err;
+   	unsigned char err = 0;
 
 	/* 要去操作的扇区数 */
 	unsigned int todo;
@@ -961,6 +1111,9 @@ PRIVATE int AtaTypeTransfer(struct IdeDevice *dev,
     /* 同步锁加锁 */
 	SyncLock(&channel->lock);
 
+	/* 等待通道上的DMA传输完成 */
+	IdeChannelAcquire(channel);
+
 	/* 保存读写操作 */
 	channel->what = rw;
 	
@@ -974,61 +1127,292 @@ PRIVATE int AtaTypeTransfer(struct IdeDevice *dev,
 			todo = count - done;
 		}
 
-		/* 选择传输模式（PIO或DMA） */
-		dma = 0; // We don't support DMA
+		/* 发送命令，这里只使用PIO模式，DMA在请求中使用 */
+		mode = AtaSendCommand(dev, rw, 0, lba + done, todo);
 
-		/* 选择寻址模式 */
-		// (I) Select one from LBA28, LBA48 or CHS;
-		SelectAddressingMode(dev, lba + done, &mode, &head, lbaIO);
+		/* PIO模式数据传输 */
+		if ((err = PioDataTransfer(dev, rw, mode, _buf, todo))) {
+			break;
+		}
+		if (rw == IDE_WRITE)
+			PioFlushCache(dev, mode);
+		_buf += todo * SECTOR_SIZE;
+		done += todo;
+	}
 
-		/* 等待驱动不繁忙 */
-		// (III) Wait if the drive is busy;
-		while (In8(ATA_REG_STATUS(channel)) & ATA_STATUS_BUSY) CpuNop();// Wait if busy.
-		/* 从控制器中选择设备 */
-		SelectDevice(dev, mode, head);
+	IdeChannelRelease(channel);
+	SyncUnlock(&channel->lock);
+	return err;
+}
 
-		/* 填写参数，扇区和扇区数 */
-		SelectSector(dev, mode, lbaIO, count);
+/**
+ * AtaRequestPio - 用PIO模式传输一个请求
+ * @dev: 设备
+ * @rq: 请求
+ * 
+ * 合并后的请求有多个缓冲区，只发送一次多扇区命令，再依次传输每个缓冲区。
+ * 调用者需要占用通道，传输成功返回0，失败返回非0
+ */
+PRIVATE int AtaRequestPio(struct IdeDevice *dev, struct Request *rq)
+{
+	struct BufferHead *bh;
+	unsigned char mode, err = 0;
+	unsigned char rw = rq->cmd == BLOCK_READ ? IDE_READ : IDE_WRITE;
 
-		/* 等待磁盘控制器处于准备状态 */
-		while (!(In8(ATA_REG_STATUS(channel)) & ATA_STATUS_READY)) CpuNop();
+	/* 一次命令最多传输256个扇区 */
+	if (rq->count == 0 || rq->count > 256)
+		return -1;
 
-		/* 选择并发送命令 */
-		SelectCmd(rw, mode, dma, &cmd);
+	dev->channel->what = rw;
 
-		#ifdef _DEBUG_IDE	
-			printk("lba mode %d num %d io %d %d %d %d %d %d->",
-				mode, lba, lbaIO[0], lbaIO[1], lbaIO[2], lbaIO[3], lbaIO[4], lbaIO[5]);
-			printk("rw %d dma %d cmd %x head %d\n",
-				rw, dma, cmd, head);
-		#endif
-		/* 等待磁盘控制器处于准备状态 */
-		while (!(In8(ATA_REG_STATUS(channel)) & ATA_STATUS_READY)) CpuNop();
+	mode = AtaSendCommand(dev, rw, 0, rq->lba, rq->count);
+	RequestForEachBuffer(rq, bh) {
+		if ((err = PioDataTransfer(dev, rw, mode, (unsigned char *)bh->data,
+			bh->size / SECTOR_SIZE))) {
+			break;
+		}
+	}
+	if (!err && rw == IDE_WRITE)
+		PioFlushCache(dev, mode);
+	return err;
+}
 
-		/* 发送命令 */
-		SendCmd(channel, cmd);
+/**
+ * AtaRequestTransfer - 用一次命令传输一个请求
+ * @dev: 设备
+ * @rq: 请求
+ * 
+ * 传输成功返回0，失败返回非0
+ */
+PRIVATE int AtaRequestTransfer(struct IdeDevice *dev, struct Request *rq)
+{
+	struct IdeChannel *channel = dev->channel;
+	int err;
 
-		/* 根据不同的模式传输数据 */
-		if (dma) {	/* DMA模式 */
-			if (rw == IDE_READ) {
-				// DMA Read.
-			} else {
-				// DMA Write.
-			}
-		} else {
-			/* PIO模式数据传输 */
-			if ((err = PioDataTransfer(dev, rw, mode, _buf, todo))) {
-				return err;
-			}
-			_buf += todo * SECTOR_SIZE;
-			done += todo;
+	SyncLock(&channel->lock);
+	IdeChannelAcquire(channel);
+	err = AtaRequestPio(dev, rq);
+	IdeChannelRelease(channel);
+	SyncUnlock(&channel->lock);
+	return err;
+}
+
+/**
+ * IdeDmaPrepare - 准备DMA传输的PRD表
+ * @channel: 通道
+ * @rq: 请求
+ * 
+ * 请求中的每个缓冲区都填写到PRD表中，每一项都不能跨越64KB的物理边界，
+ * 成功返回0，失败返回-1
+ */
+PRIVATE int IdeDmaPrepare(struct IdeChannel *channel, struct Request *rq)
+{
+	struct BufferHead *bh;
+	unsigned int addr, size, chunk;
+	int i = 0;
+
+	RequestForEachBuffer(rq, bh) {
+		addr = Vir2Phy(bh->data);
+		size = bh->size;
+
+		/* 缓冲区必须是2字节对齐的 */
+		if (addr & 1)
+			return -1;
+
+		while (size > 0) {
+			if (i >= IDE_PRD_NR)
+				return -1;
+			
+			/* 到下一个64KB边界的长度 */
+			chunk = IDE_PRD_BOUNDARY - (addr & (IDE_PRD_BOUNDARY - 1));
+			if (chunk > size)
+				chunk = size;
+			
+			channel->prdTable[i].addr = addr;
+			channel->prdTable[i].count = chunk & 0xffff;	/* 64KB时为0 */
+			channel->prdTable[i].flags = 0;
+			addr += chunk;
+			size -= chunk;
+			i++;
 		}
 	}
+	if (i == 0)
+		return -1;
+	channel->prdTable[i - 1].flags = IDE_PRD_EOT;
+	return 0;
+}
 
-	SyncUnlock(&channel->lock);
+/**
+ * IdeDmaStart - 启动一个请求的DMA传输
+ * @dev: 设备
+ * @rq: 请求
+ * 
+ * 只负责启动，传输完成后会产生中断，在中断中结束请求
+ * 成功返回0，失败返回-1
+ */
+PRIVATE int IdeDmaStart(struct IdeDevice *dev, struct Request *rq)
+{
+	struct IdeChannel *channel = dev->channel;
+	unsigned char rw = rq->cmd == BLOCK_READ ? IDE_READ : IDE_WRITE;
+
+	/* 一次命令最多传输256个扇区 */
+	if (rq->count == 0 || rq->count > 256 || IdeDmaPrepare(channel, rq))
+		return -1;
+	
+	/* 停止之前的传输，设置PRD表，清除错误和中断状态 */
+	Out8(BM_REG_CMD(channel), 0);
+	Out32(BM_REG_PRDT(channel), Vir2Phy(channel->prdTable));
+	Out8(BM_REG_STATUS(channel), In8(BM_REG_STATUS(channel)) | BM_STATUS_ERR | BM_STATUS_IRQ);
+	/* 设置传输方向 */
+	Out8(BM_REG_CMD(channel), rw == IDE_READ ? BM_CMD_READ : 0);
+	
+	channel->what = rw;
+	channel->dmaRequest = rq;
+	channel->dmaDevice = dev;
+
+	AtaSendCommand(dev, rw, 1, rq->lba, rq->count);
+	/* 开始传输 */
+	Out8(BM_REG_CMD(channel), In8(BM_REG_CMD(channel)) | BM_CMD_START);
+
+	/* 防止中断丢失，超时后结束请求 */
+	TimerInit(&channel->dmaTimer, IDE_DMA_TIMEOUT, (uint32_t)channel, IdeDmaTimeout);
+	AddTimer(&channel->dmaTimer);
 	return 0;
 }
 
+/**
+ * IdeDmaKick - 启动通道上等待中的DMA请求
+ * @channel: 通道
+ * 
+ * 通道空闲时，从通道上的磁盘的请求队列中取出一个请求开始传输，
+ * 需要在关闭中断的情况下调用
+ */
+PRIVATE void IdeDmaKick(struct IdeChannel *channel)
+{
+	struct IdeDevice *dev;
+	struct Request *rq;
+	int i;
+
+	if (channel->busy || !channel->bmBase || channel->devices == NULL)
+		return;
+	
+	for (i = 0; i < 2; i++) {
+		dev = channel->devices + i;
+		/* 块设备创建后才有请求队列 */
+		if (!dev->reserved || !dev->dma || dev->requestQueue == NULL)
+			continue;
+		
+		if ((rq = BlockFetchRequest(dev->requestQueue)) != NULL) {
+			channel->busy = 1;
+			if (IdeDmaStart(dev, rq)) {
+				/* 这里可能在中断中，交给工作队列用PIO模式传输 */
+				printk("ide dma start error, use pio!\n");
+				channel->pioRequest = rq;
+				channel->pioDevice = dev;
+				ScheduleWork(&channel->serviceWork);
+			}
+			return;
+		}
+	}
+}
+
+/**
+ * IdeDmaFinish - 结束DMA传输
+ * @channel: 通道
+ * @error: 是否出错
+ * 
+ * 结束当前请求，然后启动下一个请求，需要在关闭中断的情况下调用。
+ * 出错时通道保持占用，由工作队列重置驱动器后再启动下一个请求
+ */
+PRIVATE void IdeDmaFinish(struct IdeChannel *channel, int error)
+{
+	struct Request *rq = channel->dmaRequest;
+	struct IdeDevice *dev = channel->dmaDevice;
+
+	RemoveTimer(&channel->dmaTimer);
+
+	/* 停止传输，并清除状态 */
+	Out8(BM_REG_CMD(channel), 0);
+	Out8(BM_REG_STATUS(channel), BM_STATUS_ERR | BM_STATUS_IRQ);
+	
+	channel->dmaRequest = NULL;
+	channel->dmaDevice = NULL;
+
+	if (error) {
+		IdePrintError(dev, 2);
+	} else if (rq->cmd == BLOCK_READ) {
+		dev->rdSectors += rq->count;
+	} else {
+		dev->wrSectors += rq->count;
+	}
+	BlockEndRequest(rq, error);
+
+	/* 在中断或者定时器中不能重置驱动器 */
+	if (error) {
+		channel->needReset = 1;
+		ScheduleWork(&channel->serviceWork);
+		return;
+	}
+
+	/* 唤醒等待通道的任务，然后继续下一个请求 */
+	channel->busy = 0;
+	WaitQueueWakeUpAll(&channel->waitQueue);
+	IdeDmaKick(channel);
+}
+
+/**
+ * IdeChannelService - 在任务上下文中处理通道
+ * @work: 通道的工作
+ * 
+ * DMA出错后重置驱动器，DMA启动失败的请求改用PIO模式传输。
+ * 通道在调度工作之前已经被占用，处理完后释放通道，继续下一个请求
+ */
+PRIVATE void IdeChannelService(struct Work *work)
+{
+	struct IdeChannel *channel = (struct IdeChannel *)work->data;
+	struct Request *rq;
+	struct IdeDevice *dev;
+	char reset;
+	int error;
+
+	unsigned long flags = InterruptSave();
+	reset = channel->needReset;
+	rq = channel->pioRequest;
+	dev = channel->pioDevice;
+	channel->needReset = 0;
+	channel->pioRequest = NULL;
+	channel->pioDevice = NULL;
+	InterruptRestore(flags);
+
+	if (reset)
+		SoftResetDriver(channel);
+
+	if (rq != NULL) {
+		if ((error = AtaRequestPio(dev, rq))) {
+			printk("ide %s error!\n", rq->cmd == BLOCK_READ ? "read" : "write");
+		}
+		BlockEndRequest(rq, error ? 1 : 0);
+	}
+
+	IdeChannelRelease(channel);
+}
+
+/**
+ * IdeDmaTimeout - DMA传输超时
+ * @data: 通道
+ */
+PRIVATE void IdeDmaTimeout(uint32_t data)
+{
+	struct IdeChannel *channel = (struct IdeChannel *)data;
+
+	unsigned long flags = InterruptSave();
+	if (channel->dmaRequest) {
+		printk("ide dma timeout!\n");
+		IdeDmaFinish(channel, 1);
+	}
+	InterruptRestore(flags);
+}
+
 /**
  * IdeReadSector - 读扇区
  * @dev: 设备
@@ -1149,6 +1533,15 @@ PRIVATE void DoBlockRequest(struct RequestQueue *q)
 {
 	struct Request *rq;
 	struct IdeDevice *dev = q->queuedata;
+	int error;
+
+	/* DMA模式下只启动传输，由中断结束请求 */
+	if (dev->dma) {
+		unsigned long flags = InterruptSave();
+		IdeDmaKick(dev->channel);
+		InterruptRestore(flags);
+		return;
+	}
 
 	rq = BlockFetchRequest(q);
 	while (rq != NULL)
@@ -1160,18 +1553,13 @@ PRIVATE void DoBlockRequest(struct RequestQueue *q)
 			rq->waiter->name, rq->cmd == BLOCK_READ ? "read" : "write", rq->lba);
 		#endif
 
-		if (rq->cmd == BLOCK_READ) {
-            if (IdeReadSector(dev, rq->lba, rq->buffer, rq->count)) {
-                printk("ide write error!\n");   
-            }
-		} else {
-			if (IdeWriteSector(dev, rq->lba, rq->buffer, rq->count)) {
-                printk("ide write error!\n");   
-            }
+		/* 合并后的请求也只需要一次多扇区命令 */
+		if ((error = AtaRequestTransfer(dev, rq))) {
+			printk("ide %s error!\n", rq->cmd == BLOCK_READ ? "read" : "write");
 		}
         
 		/* 结束当前请求 */
-		BlockEndRequest(rq, 0);
+		BlockEndRequest(rq, error ? 1 : 0);
 
 		/* 获取一个新情求 */
 		rq = BlockFetchRequest(q);
@@ -1287,6 +1675,8 @@ PRIVATE int IdeBlockDeviceCreate(struct IdeDevice *dev, int major, int idx)
 	if (dev->requestQueue == NULL) {
 		return -1;
 	}
+	/* 一次命令最多256个扇区，每个缓冲区最多占用2个PRD项 */
+	BlockQueueLimits(dev->requestQueue, 256, IDE_PRD_NR / 2);
 	
 	/* 设置磁盘相关 */
 	char name[DISK_NAME_LEN];
@@ -1409,11 +1799,46 @@ PRIVATE void IdeAssistHandler(unsigned int data)
  */
 PRIVATE void IdeHandler(unsigned int irq, unsigned int data)
 {
+	struct IdeChannel *channel = (struct IdeChannel *)data;
+
+	/* DMA传输完成，直接在中断中结束请求 */
+	if (channel->dmaRequest) {
+		unsigned char bmStatus = In8(BM_REG_STATUS(channel));
+		if (bmStatus & BM_STATUS_IRQ) {
+			/* 读取状态寄存器，清除磁盘的中断 */
+			unsigned char status = In8(ATA_REG_STATUS(channel));
+			IdeDmaFinish(channel, (bmStatus & BM_STATUS_ERR) || (status & ATA_STATUS_ERR));
+			return;
+		}
+	}
+
 	ideAssist.data = data;
 	/* 调度协助 */
 	TaskAssistSchedule(&ideAssist);
 }
 
+/**
+ * IdeDmaProbe - 探测总线主控DMA
+ * 
+ * 在PCI总线上查找IDE控制器，获取总线主控寄存器的地址
+ */
+PRIVATE void IdeDmaProbe()
+{
+	struct PciDevice *pciDev = GetPciDeviceByClass(IDE_PCI_CLASS);
+	
+	ideBusMasterBase = 0;
+	if (pciDev == NULL)
+		return;
+	
+	/* BAR4是总线主控寄存器的地址 */
+	if (pciDev->bar[4].type != PCI_BAR_TYPE_IO || !pciDev->bar[4].baseAddr)
+		return;
+	
+	ideBusMasterBase = pciDev->bar[4].baseAddr;
+	EnablePciBusMastering(pciDev);
+	printk("IDE bus master DMA at %x\n", ideBusMasterBase);
+}
+
 /**
  * IdeProbe - 探测设备
  * @diskFound: 找到的磁盘数
@@ -1449,6 +1874,21 @@ PRIVATE void IdeProbe(char diskFound)
 		channel->what = 0;
 		SynclockInit(&channel->lock);	
 
+		/* 总线主控DMA相关 */
+		channel->bmBase = ideBusMasterBase ? ideBusMasterBase + channelno * 8 : 0;
+		channel->busy = 0;
+		WaitQueueInit(&channel->waitQueue, NULL);
+		channel->dmaRequest = NULL;
+		channel->dmaDevice = NULL;
+		TimerInit(&channel->dmaTimer, 0, 0, NULL);
+		channel->prdTable = idePrdTable[channelno];
+		channel->needReset = 0;
+		channel->pioRequest = NULL;
+		channel->pioDevice = NULL;
+		WorkInit(&channel->serviceWork, IdeChannelService);
+		channel->serviceWork.data = (unsigned int)channel;
+		channel->devices = (channelno == ATA_SECONDARY) ? &devices[2] : &devices[0];
+
 		/* 初始化任务协助 */
 		TaskAssistInit(&ideAssist, IdeAssistHandler, 0);
         
@@ -1520,6 +1960,8 @@ PRIVATE void IdeProbe(char diskFound)
 
 			dev->capabilities = dev->info->Capabilities0;
 			dev->signature = dev->info->General_Config;
+			/* 控制器支持总线主控并且磁盘支持DMA才使用DMA */
+			dev->dma = (channel->bmBase && (dev->capabilities & 0x100)) ? 1 : 0;
 			dev->reserved = 1;	/* 设备存在 */
 			#ifdef _DEBUG_IDE_INFO
 			DumpIdeDevice(dev);
@@ -1601,6 +2043,8 @@ PUBLIC int InitIdeDriver()
 
 	/* 有磁盘才初始化磁盘 */
 	if (ideDiskFound > 0) {
+		/* 查找支持总线主控DMA的IDE控制器，没有就使用PIO模式 */
+		IdeDmaProbe();
 		
         /* 驱动本身的初始化 */
 		IdeProbe(ideDiskFound);
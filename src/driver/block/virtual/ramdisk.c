@@ -12,7 +12,6 @@
 #include <book/ioqueue.h>
 #include <book/device.h>
 #include <book/task.h>
-#include <book/vmarea.h>
 
 #include <lib/vsprintf.h>
 #include <lib/string.h>
@@ -32,18 +31,170 @@
 //#define _DEBUG_RAMDISK
 /* 配置结束 */
 
-#define MAX_SECTORS			10240
-
 #define MAX_RAMDISK_NR			1
 
+/* 一个页可以存放的扇区数 */
+#define RAMDISK_PAGE_SECTORS	(PAGE_SIZE / SECTOR_SIZE)
 
+/**
+ * 磁盘的数据保存在一个个物理页中，通过页表数组查找，
+ * 页在内核中是直接映射的，读写时直接复制，不需要连续的虚拟地址。
+ * 页在第一次写入时才分配，没有分配的页读取出来都是0
+ */
 PRIVATE struct RamdiskDevice {
 	struct Disk *disk;
 	struct RequestQueue *requestQueue;
-	unsigned char *data;
-	unsigned int size;
+	unsigned char **pages;		/* 页表数组 */
+	unsigned int pageCount;		/* 页表数组的长度 */
+	unsigned int size;			/* 扇区数 */
 }devices[MAX_RAMDISK_NR];
 
+/**
+ * RamdiskFreePages - 释放一段页
+ * @dev: 设备
+ * @start: 起始页
+ * @end: 结束页（不包括）
+ */
+PRIVATE void RamdiskFreePages(struct RamdiskDevice *dev, unsigned int start, unsigned int end)
+{
+	unsigned int i;
+
+	for (i = start; i < end; i++) {
+		if (dev->pages[i] != NULL) {
+			FreePage(Vir2Phy(dev->pages[i]));
+			dev->pages[i] = NULL;
+		}
+	}
+}
+
+/**
+ * RamdiskResize - 调整磁盘大小
+ * @dev: 设备
+ * @sectors: 新的扇区数
+ * 
+ * 只重新分配页表数组，变小时先写回脏缓冲，作废超出新大小的缓冲，
+ * 再释放多出来的页，并清空最后一页中超出部分，变大后读取到的都是0。
+ * 成功返回0，失败返回-1
+ */
+PRIVATE int RamdiskResize(struct RamdiskDevice *dev, unsigned int sectors)
+{
+	unsigned char **pages, **old;
+	unsigned int count = DIV_ROUND_UP(sectors, RAMDISK_PAGE_SECTORS);
+	unsigned int oldCount, offset;
+	dev_t devno;
+
+	if (!sectors)
+		return -1;
+
+	/* 变小前先把缓冲写回，这时磁盘还覆盖所有的块 */
+	if (sectors < dev->size)
+		Bsync();
+
+	pages = kmalloc(count * sizeof(unsigned char *), GFP_KERNEL);
+	if (pages == NULL)
+		return -1;
+	memset(pages, 0, count * sizeof(unsigned char *));
+
+	unsigned long flags = InterruptSave();
+
+	if (sectors < dev->size) {
+		/* 超出新大小的缓冲不能再写回，也不能在变大后读到旧的数据 */
+		devno = MKDEV(dev->disk->major, dev->disk->firstMinor);
+		Binvalidate(devno, sectors);
+	}
+
+	old = dev->pages;
+	oldCount = dev->pageCount;
+	if (old != NULL) {
+		if (count < oldCount)
+			RamdiskFreePages(dev, count, oldCount);
+		memcpy(pages, old, min(count, oldCount) * sizeof(unsigned char *));
+
+		/* 清空保留的最后一页中超出新大小的部分 */
+		offset = (sectors % RAMDISK_PAGE_SECTORS) * SECTOR_SIZE;
+		if (sectors < dev->size && offset && pages[count - 1] != NULL)
+			memset(pages[count - 1] + offset, 0, PAGE_SIZE - offset);
+	}
+	dev->pages = pages;
+	dev->pageCount = count;
+	dev->size = sectors;
+
+	/* 更新磁盘容量 */
+	SetCapacity(dev->disk, sectors);
+	dev->disk->part0.sectorCounts = sectors;
+
+	InterruptRestore(flags);
+
+	if (old != NULL)
+		kfree(old);
+	return 0;
+}
+
+/**
+ * RamdiskTransfer - 在磁盘和缓冲区之间复制数据
+ * @dev: 设备
+ * @lba: 逻辑扇区地址
+ * @buf: 缓冲区
+ * @count: 扇区数
+ * @write: 为1表示写入磁盘
+ * 
+ * 按页复制，写入还没有分配的页时才分配。
+ * 成功返回0，失败返回-1
+ */
+PRIVATE int RamdiskTransfer(struct RamdiskDevice *dev,
+	unsigned int lba,
+	unsigned char *buf,
+	unsigned int count,
+	int write)
+{
+	unsigned int index, offset, chunk, page;
+	unsigned int bytes = count * SECTOR_SIZE;
+	unsigned char *data;
+
+	if (lba + count > dev->size || lba + count < lba)
+		return -1;
+	
+	index = lba / RAMDISK_PAGE_SECTORS;
+	offset = (lba % RAMDISK_PAGE_SECTORS) * SECTOR_SIZE;
+
+	while (bytes > 0) {
+		chunk = min(bytes, PAGE_SIZE - offset);
+		data = dev->pages[index];
+
+		if (write) {
+			if (data == NULL) {
+				page = AllocPage();
+				if (!page)
+					return -1;
+				data = Phy2Vir(page);
+				memset(data, 0, PAGE_SIZE);
+
+				/* 分配的时候其它任务可能已经分配了这个页 */
+				unsigned long flags = InterruptSave();
+				if (dev->pages[index] == NULL) {
+					dev->pages[index] = data;
+				} else {
+					FreePage(page);
+					data = dev->pages[index];
+				}
+				InterruptRestore(flags);
+			}
+			memcpy(data + offset, buf, chunk);
+		} else {
+			if (data != NULL)
+				memcpy(buf, data + offset, chunk);
+			else
+				memset(buf, 0, chunk);
+		}
+
+		buf += chunk;
+		bytes -= chunk;
+		offset = 0;
+		index++;
+	}
+	return 0;
+}
+
 /**
  * RamdiskReadSector - 读扇区
  * @dev: 设备
@@ -61,13 +212,8 @@ PRIVATE int RamdiskReadSector(struct RamdiskDevice *dev,
 	/* 检查设备是否正确 */
 	if (dev < devices || dev >= &devices[MAX_RAMDISK_NR]) {
 		return -1;
-	} else if (lba + count > dev->size) {
-		return -1;
-	} else {
-		/* 进行磁盘访问 */
-		memcpy(buf, dev->data + lba * SECTOR_SIZE, count * SECTOR_SIZE);
 	}
-	return 0;
+	return RamdiskTransfer(dev, lba, buf, count, 0);
 }
 
 /**
@@ -87,14 +233,53 @@ PRIVATE int RamdiskWriteSector(struct RamdiskDevice *dev,
 	/* 检查设备是否正确 */
 	if (dev < devices || dev >= &devices[MAX_RAMDISK_NR]) {
 		return -1;
-	} else if (lba + count > dev->size) {
+	}
+	return RamdiskTransfer(dev, lba, buf, count, 1);
+}
+
+/**
+ * RamdiskTransferRequest - 传输一个请求
+ * @dev: 设备
+ * @rq: 请求
+ * 
+ * 合并后的请求有多个缓冲区，先检查整个请求的范围，再依次复制每个缓冲区
+ * 成功返回0，失败返回-1
+ */
+PRIVATE int RamdiskTransferRequest(struct RamdiskDevice *dev, struct Request *rq)
+{
+	struct BufferHead *bh;
+	unsigned int lba = rq->lba;
+
+	if (rq->lba + rq->count > dev->size)
 		return -1;
-	} else {
-		/* 进行磁盘访问 */
-		memcpy(dev->data + lba * SECTOR_SIZE, buf, count * SECTOR_SIZE);
+	
+	RequestForEachBuffer(rq, bh) {
+		if (RamdiskTransfer(dev, lba, (unsigned char *)bh->data,
+			bh->size / SECTOR_SIZE, rq->cmd == BLOCK_WRITE))
+			return -1;
+		lba += bh->size / SECTOR_SIZE;
 	}
 	return 0;
 }
+
+/**
+ * RamdiskMakeRequest - 直接读写一个缓冲
+ * @q: 请求队列
+ * @rw: 读/写操作
+ * @bh: 缓冲头
+ * 
+ * 数据已经在内存中，不需要经过请求队列排序和合并，
+ * 提交缓冲时直接复制。返回错误数
+ */
+PRIVATE int RamdiskMakeRequest(struct RequestQueue *q, int rw, struct BufferHead *bh)
+{
+	struct RamdiskDevice *dev = q->queuedata;
+	unsigned int count = bh->size / SECTOR_SIZE;
+
+	return RamdiskTransfer(dev, bh->lba * count, (unsigned char *)bh->data,
+		count, rw == BLOCK_WRITE) ? 1 : 0;
+}
+
 /**
  * DoBlockRequest - 执行请求
  * @q: 请求队列
@@ -105,6 +290,7 @@ PRIVATE void DoBlockRequest(struct RequestQueue *q)
 {
 	struct Request *rq;
 	struct RamdiskDevice *dev = q->queuedata;
+	int error;
 
 	//printk("DoBlockRequest: start\n");
 
@@ -117,15 +303,11 @@ PRIVATE void DoBlockRequest(struct RequestQueue *q)
 			q->requestList == &q->upRequestList ? "up" : "down", rq->waiter->name, rq->cmd == BLOCK_READ ? "read" : "write", rq->lba);
 		#endif
 
-		/* 执行单个扇区操作 */
-		if (rq->cmd == BLOCK_READ) {
-			RamdiskReadSector(dev, rq->lba, rq->buffer, rq->count);
-		} else {
-			RamdiskWriteSector(dev, rq->lba, rq->buffer, rq->count);
-		}
+		/* 执行整个请求的扇区操作 */
+		error = RamdiskTransferRequest(dev, rq);
 
 		/* 结束当前请求 */
-		BlockEndRequest(rq, 0);
+		BlockEndRequest(rq, error ? 1 : 0);
 
 		/* 获取一个新情求 */
 		rq = BlockFetchRequest(q);
@@ -143,31 +325,24 @@ PRIVATE void DoBlockRequest(struct RequestQueue *q)
  */
 PRIVATE int RamdiskCleanDisk(struct RamdiskDevice *dev, sector_t count)
 {
-	if (count == 0)
+	unsigned int full;
+
+	if (count == 0 || count > dev->size)
 		count = dev->size;
 
-	sector_t todo, done = 0;
-	
-	/* 每次写入10个扇区 */
-	char *buffer = kmalloc(SECTOR_SIZE *10, GFP_KERNEL);
-	if (!buffer) {
-		printk("kmalloc for Ramdisk buf failed!\n");
-		return -1;
-	}
+	printk(PART_TIP "Ramdisk clean: count%d\n", count);
 
-	memset(buffer, 0, SECTOR_SIZE *10);
+	unsigned long flags = InterruptSave();
 
-	printk(PART_TIP "Ramdisk clean: count%d\n", count);
-	while (done < count) {
-		/* 获取要去操作的扇区数这里用10作为分界 */
-		if ((done + 10) <= count) {
-			todo = 10;
-		} else {
-			todo = count - done;
-		}
-		RamdiskWriteSector(dev, done, buffer, todo);
-		done += 10;
-	}
+	/* 整页的直接释放，之后读取出来就是0 */
+	full = count / RAMDISK_PAGE_SECTORS;
+	RamdiskFreePages(dev, 0, full);
+
+	/* 剩下不足一页的部分清零 */
+	if ((count % RAMDISK_PAGE_SECTORS) && dev->pages[full] != NULL)
+		memset(dev->pages[full], 0, (count % RAMDISK_PAGE_SECTORS) * SECTOR_SIZE);
+
+	InterruptRestore(flags);
 	return 0;
 }
 
@@ -207,6 +382,21 @@ PRIVATE int RamdiskIoctl(struct Device *device, int cmd, int arg)
     case RAMDISK_IO_BLKZE:	/* 获取块大小 */
         *((sector_t *)arg) = blkdev->blockSize;
 		break;
+	case RAMDISK_IO_RESIZE:	/* 调整磁盘大小 */
+		if (RamdiskResize(dev, arg)) {
+			retval = -1;
+		}
+		break;
+	case RAMDISK_IO_NOCACHE:	/* 设置是否保留块缓冲 */
+		if (arg) {
+			dev->disk->flags |= DISK_FLAG_NOCACHE;
+			/* 已经缓存的块先写回，再回收 */
+			Bsync();
+			BufferCacheShrink();
+		} else {
+			dev->disk->flags &= ~DISK_FLAG_NOCACHE;
+		}
+		break;
 	default:
 		/* 失败 */
 		retval = -1;
@@ -277,6 +467,8 @@ PRIVATE int RamdiskCreateDevice(struct RamdiskDevice *dev, int major, int idx)
 	if (dev->requestQueue == NULL) {
 		return -1;
 	}
+	/* 读写直接复制，不经过请求队列 */
+	BlockQueueMakeRequest(dev->requestQueue, RamdiskMakeRequest);
 	
 	/* 设置磁盘相关 */
 	char name[DISK_NAME_LEN];
@@ -297,8 +489,10 @@ PRIVATE int RamdiskCreateDevice(struct RamdiskDevice *dev, int major, int idx)
 	sprintf(name, "rd%c", devname);
 	DiskIdentity(dev->disk, name, major, RAMDISK_MINOR(idx));
 	DiskBind(dev->disk, dev->requestQueue, dev);
-	dev->size = MAX_SECTORS;
-	SetCapacity(dev->disk, dev->size);
+	
+	/* 分配页表数组，并设置磁盘容量 */
+	if (RamdiskResize(dev, CONFIG_RAMDISK_SECTORS))
+		return -1;
 	
 	AddDisk(dev->disk);
 
@@ -356,14 +550,6 @@ PUBLIC int InitRamdiskDriver()
 		status = RamdiskCreateDevice(&devices[i], RAMDISK_MAJOR, i);
 		if (status < 0)
 			return status;
-
-		/* 磁盘数据 */
-		devices[i].data = vmalloc(devices[i].disk->capacity * SECTOR_SIZE);
-		if (devices[i].data == NULL) {
-			printk("vmalloc for ramdisk failed!\n");
-			return -1;
-		}
-		memset(devices[i].data, i+1, devices[i].disk->capacity * SECTOR_SIZE);
 	}
 	return 0;
 }
@@ -374,9 +560,13 @@ PUBLIC int InitRamdiskDriver()
 PUBLIC void ExitRamdiskdDriver()
 {
 	int i;
-	for (i = 0; i < 2; i++) {
+	for (i = 0; i < MAX_RAMDISK_NR; i++) {
 		RamdiskDelDevice(&devices[i]);
-		vfree(devices[i].data);
+		if (devices[i].pages != NULL) {
+			RamdiskFreePages(&devices[i], 0, devices[i].pageCount);
+			kfree(devices[i].pages);
+			devices[i].pages = NULL;
+		}
 	}
 	
 }
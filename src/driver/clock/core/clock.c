@@ -14,7 +14,6 @@
 #include <book/interrupt.h>
 #include <book/alarm.h>
 #include <book/kgc.h>
-#include <block/block.h>
 #include <clock/clock.h>
 #include <lib/time.h>
 #include <lib/math.h>
@@ -157,14 +156,10 @@ PUBLIC void ClockChangeSystemDate()
  */
 PRIVATE void SleepByTicks(uint32_t sleepTicks)
 {
-	/* 获取起始ticks，后面进行差值运算 */
-	uint32_t startTicks = systicks;
-
-	/* 如果最新ticks和开始ticks差值小于要休眠的ticks，就继续休眠 */
-	while (systicks - startTicks < sleepTicks) {
-		/* 让出cpu占用，相当于休眠 */
-		TaskYield();
-        //CpuNop();
+	/* 由定时器来唤醒，休眠期间不占用cpu。
+	如果被信号提前唤醒，就继续休眠剩余的ticks */
+	while (sleepTicks > 0) {
+		sleepTicks = TaskSleep(sleepTicks);
 	}
 }
 
@@ -189,7 +184,6 @@ PRIVATE void WorkForPerSecond(Work_t *work)
 {
     ClockChangeSystemDate();
     KGC_TimerOccur();
-    BlockDiskSync();
 }
 
 PRIVATE DECLEAR_WORK(perSecondWork, WorkForPerSecond);
@@ -203,9 +197,6 @@ PROTECT void TimerSoftirqHandler(struct SoftirqAction *action)
         ScheduleWork(&perSecondWork);
     }
 	
-	/* 更新闹钟 */
-    UpdateAlarmSystem();
-
 	/* 更新定时器 */
 	UpdateTimerSystem();
     //printk("s");
@@ -172,6 +172,27 @@ PUBLIC struct PciDevice* GetPciDevice(uint16 vendorID, uint16 deviceID)
     return NULL;
 }
 
+/**
+ * GetPciDeviceByClass - 根据类型获取pci设备
+ * @classCode: 类型码和子类型码，不包括编程接口
+ * 
+ * 返回第一个匹配的设备，没有就返回NULL
+ */
+PUBLIC struct PciDevice* GetPciDeviceByClass(uint16 classCode)
+{
+	int i;
+	struct PciDevice* device;
+	
+	for (i = 0; i < PCI_MAX_DEVICE_NR; i++) {
+		device = &pciDeviceTable[i];
+		if (device->status == PCI_DEVICE_STATUS_USING &&
+			(device->classCode >> 8) == classCode) {
+			return device;
+		}
+	}
+    return NULL;
+}
+
 PUBLIC void EnablePciBusMastering(struct PciDevice *device)
 {
     uint32 val = PciRead(device->bus, device->dev, device->function, PCI_STATUS_COMMAND);
@@ -9,6 +9,7 @@
 #define _BLOCK_BUFFER_H
 
 #include <lib/types.h>
+#include <lib/time.h>
 #include <book/atomic.h>
 #include <book/list.h>
 #include <book/semaphore.h>
@@ -26,6 +27,9 @@
  */
 struct BufferHead {
     struct List list;
+    struct List hashList;   // 散列表中的链表
+    struct List lruList;    // 没有使用者时，位于LRU链表中
+    struct List dirtyList;  // 是脏的时，位于按块号排序的脏缓冲链表中
     char uptodate;      // 读取了新的数据
     char dirty;         // 写入了新数据
     char locked;       // 上锁
@@ -41,19 +45,45 @@ struct BufferHead {
     void *private;  // 私有数据
     Atomic_t count; // 使用者计数
     struct Semaphore sema;
+    struct WaitQueue waitQueue; // 等待缓冲解锁的任务
+    struct BufferHead *reqNext; /* 同一个请求中的下一个缓冲头 */
+    clock_t dirtyTime;          /* 变脏的时间，用来判断是否需要写回 */
+    unsigned int owner;         /* 所属文件的标识，由文件系统设置，0表示没有 */
 };
 
 #define SIZEOF_BUFFER_HEAD sizeof(struct BufferHead)
 
+/* 块缓冲散列表的大小，需要是2的n次方 */
+#define BUFFER_HASH_NR  256
+
+PUBLIC void InitBufferCache();
+PUBLIC void BufferCacheSetLimit(unsigned int limit);
+PUBLIC int BufferCacheShrink();
+
 PUBLIC struct BufferHead *Bread(dev_t dev, sector_t block);
+PUBLIC int Breada(dev_t devno, sector_t block, unsigned int count);
+PUBLIC void Bprefetch(dev_t devno, sector_t *blocks, unsigned int count);
+PUBLIC struct BufferHead *Bget(dev_t devno, sector_t block);
 PUBLIC struct BufferHead *Bwrite(dev_t dev, sector_t block, void *buffer);
+PUBLIC void BufferBeginWrite(struct BufferHead *bh);
+PUBLIC void BufferEndWrite(struct BufferHead *bh);
 PUBLIC int BsyncOne(struct BufferHead *bh);
+PUBLIC int BsyncBlocks(dev_t devno, sector_t *blocks, unsigned int count);
+PUBLIC int BsyncOwner(dev_t devno, unsigned int owner);
+PUBLIC int BsyncRange(dev_t devno, sector_t start, sector_t count);
 PUBLIC int Bsync();
+PUBLIC void Binvalidate(dev_t devno, sector_t sector);
+PUBLIC void MarkBufferDirty(struct BufferHead *bh);
+PUBLIC void ClearBufferDirty(struct BufferHead *bh);
+PUBLIC void InitBufferWriteback();
 PUBLIC int DirtyCheck();
+PUBLIC void Brelease(struct BufferHead *bh);
+PUBLIC void BufferPut(struct BufferHead *bh);
 
 PUBLIC void DumpBH(struct BufferHead *bh);
 
 PUBLIC void LockBuffer(struct BufferHead *bh);
+PUBLIC int TryLockBuffer(struct BufferHead *bh);
 PUBLIC void UnlockBuffer(struct BufferHead *bh);
 
 
@@ -80,6 +110,7 @@ STATIC INLINE int BlockRead(dev_t devno, sector_t block,void *buffer)
     struct BufferHead *bh = Bread(devno, block);
     if (bh) {
         memcpy(buffer, bh->data, bh->size);
+        Brelease(bh);
         return 0;
     }
     return -1;
@@ -98,13 +129,60 @@ STATIC INLINE int BlockWrite(dev_t devno, sector_t block, void *buffer, char syn
     struct BufferHead *bh = Bwrite(devno, block, buffer);
     
     if (bh) {
+        int ret = 0;
         if (sync) 
-            return BsyncOne(bh);
+            ret = BsyncOne(bh);
+        Brelease(bh);
+        return ret;
+    }
+    return -1;
+}
+
+/**
+ * BlockWriteOwner - 块设备写入，并记录块所属的文件
+ * @devno: 设备号
+ * @block: 块
+ * @buffer: 要写入的缓冲区
+ * @owner: 所属文件的标识
+ * 
+ * 同步文件时用BsyncOwner只写回属于这个文件的脏块。
+ * 成功返回0，失败返回-1
+ */
+STATIC INLINE int BlockWriteOwner(dev_t devno, sector_t block, void *buffer, unsigned int owner)
+{
+    struct BufferHead *bh = Bwrite(devno, block, buffer);
+    
+    if (bh) {
+        bh->owner = owner;
+        Brelease(bh);
         return 0;
     }
     return -1;
 }
 
+/**
+ * BlockGet - 获取一个块，并固定在块缓冲中
+ * @devno: 设备号
+ * @block: 块
+ * 
+ * 和BlockRead不同，不会把数据复制出来，调用者直接访问bh->data。
+ * 修改数据需要放在BufferBeginWrite和BufferEndWrite之间。
+ * 成功返回缓冲头，使用完后用BlockPut释放，失败返回NULL
+ */
+STATIC INLINE struct BufferHead *BlockGet(dev_t devno, sector_t block)
+{
+    return Bread(devno, block);
+}
+
+/**
+ * BlockPut - 释放BlockGet获取的块
+ * @bh: 缓冲头
+ */
+STATIC INLINE void BlockPut(struct BufferHead *bh)
+{
+    Brelease(bh);
+}
+
 #define BlockSync  Bsync
 
 
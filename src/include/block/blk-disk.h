@@ -56,6 +56,9 @@ struct Disk {
 
 #define SIZEOF_DISK     sizeof(struct Disk)
 
+/* 磁盘的标志 */
+#define DISK_FLAG_NOCACHE   0x01    /* 不保留块缓冲，写入后马上写回，释放后马上回收 */
+
 void AddPartition(struct Disk *disk, int partno, sector_t start, sector_t count);
 
 /* 设置磁盘大小 */
@@ -12,5 +12,6 @@
 #include <block/blk-request.h>
 
 PUBLIC void ElevatorIoSchedule(struct RequestQueue *queue, struct Request *request);
+PUBLIC int ElevatorMergeRequest(struct RequestQueue *queue, struct Request *request);
 
 #endif   /* _BLOCK_ELEVATOR_H */
@@ -29,13 +29,26 @@ struct Request {
     sector_t lba;    //逻辑块地址
     unsigned long count;    // 操作的块数
     char *buffer;       // 读写用到的buffer
-    struct BufferHead *bh;
+    struct BufferHead *bh;      /* 第一个缓冲头，合并进来的缓冲头通过reqNext连接 */
+    struct BufferHead *bhTail;  /* 最后一个缓冲头 */
+    unsigned int segments;      /* 缓冲头的数量 */
     struct Task *waiter;
 };
 #define SIZEOF_REQUEST sizeof(struct Request)
 
+/* 遍历请求中的每一个缓冲头，每个缓冲头都是一段独立的数据缓冲区 */
+#define RequestForEachBuffer(request, _bh) \
+        for ((_bh) = (request)->bh; (_bh) != NULL; (_bh) = (_bh)->reqNext)
+
+/* 合并后的请求默认最多的扇区数和缓冲头数 */
+#define BLOCK_MAX_SECTORS   128
+#define BLOCK_MAX_SEGMENTS  16
+
 typedef void (*RequestFunction_t)(struct RequestQueue *);
 
+/* 直接处理一个缓冲的读写，不经过请求队列，返回错误数 */
+typedef int (*MakeRequestFunction_t)(struct RequestQueue *, int, struct BufferHead *);
+
 /**
  * 请求队列是每一个块设备都应该有的
  * 
@@ -46,10 +59,20 @@ struct RequestQueue {
     struct List *requestList;
 
     RequestFunction_t requestFunction;     // 执行请求函数
+    MakeRequestFunction_t makeRequest;     /* 不为NULL时直接处理缓冲，跳过请求队列和电梯 */
 
     struct Request *currentRequest;    /* 当前的请求 */
 
     void *queuedata;
+
+    unsigned int plugged;       /* 不为0时暂不执行请求，让请求有机会合并 */
+    unsigned int maxSectors;    /* 合并后的请求最多的扇区数 */
+    unsigned int maxSegments;   /* 合并后的请求最多的缓冲头数 */
+
+    /* 统计信息 */
+    unsigned int requests;      /* 提交的请求数 */
+    unsigned int backMerges;    /* 合并到已有请求后面的次数 */
+    unsigned int frontMerges;   /* 合并到已有请求前面的次数 */
 };
 
 PUBLIC void DumpRequest(struct Request *request);
@@ -60,7 +83,19 @@ PUBLIC struct RequestQueue *BlockInitQueue(RequestFunction_t callback, void *que
 /* 清除请求队列 */
 PUBLIC void BlockCleanUpQueue(struct RequestQueue *request);
 
+/* 设置请求合并的限制 */
+PUBLIC void BlockQueueLimits(struct RequestQueue *queue,
+    unsigned int maxSectors, unsigned int maxSegments);
+
+/* 设置直接处理缓冲的函数 */
+PUBLIC void BlockQueueMakeRequest(struct RequestQueue *queue, MakeRequestFunction_t makeRequest);
+
+/* 暂停和恢复执行请求，用于批量提交请求 */
+PUBLIC void BlockPlugQueue(struct RequestQueue *queue);
+PUBLIC void BlockUnplugQueue(struct RequestQueue *queue);
+
 PUBLIC void MakeRequest(int major, int rw, struct BufferHead *bh);
+PUBLIC void SubmitRequest(int major, int rw, struct BufferHead *bh);
 
 /* 提取请求队列 */
 PUBLIC struct Request *BlockFetchRequest(struct RequestQueue *queue);
@@ -73,4 +108,6 @@ PUBLIC void BlockEndRequest(struct Request *request, int errors);
 
 PUBLIC void DumpRequestQueue(struct RequestQueue *queue);
 
+PUBLIC void InitBlockRequest();
+
 #endif   /* _BLOCK_REQUEST_H */
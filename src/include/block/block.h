@@ -18,7 +18,6 @@
 
 #define BLOCK_SIZE (SECTOR_SIZE * BLOCK_SECTORS)
 
-PUBLIC void BlockDiskSync();
 PUBLIC void InitBlockDevice();
 
 #endif   /* _DRIVER_BLOCK_H */
@@ -16,6 +16,8 @@ enum {
     RAMDISK_IO_SECTORS,
     RAMDISK_IO_BLKZE,
 	RAMDISK_IO_IDENTIFY,
+	RAMDISK_IO_RESIZE,		/* 调整磁盘的扇区数 */
+	RAMDISK_IO_NOCACHE,		/* 参数不为0时不保留块缓冲 */
 };
 
 #define VENDOR_CHAR_LEN 24
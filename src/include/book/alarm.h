@@ -10,8 +10,16 @@
 
 #include <lib/stdint.h>
 #include <lib/types.h>
+#include <lib/time.h>
+
+struct Task;
+
+PUBLIC void AlarmInit(struct Task *task);
+PUBLIC uint32_t AlarmSet(struct Task *task, uint32_t ticks, uint32_t interval);
+PUBLIC void AlarmCancel(struct Task *task);
 
-PUBLIC void UpdateAlarmSystem();
 PUBLIC unsigned int SysAlarm(unsigned int seconds);
+PUBLIC int SysGetITimer(int which, struct itimerval *value);
+PUBLIC int SysSetITimer(int which, struct itimerval *value, struct itimerval *oldValue);
 
 #endif   /* _BOOK_ALARM_H */
@@ -16,11 +16,13 @@ struct Bitmap {
    unsigned int btmpBytesLen;
    /* 在遍历位图时,整体上以字节为单位,细节上是以位为单位,所以此处位图的指针必须是单字节 */
    unsigned char* bits;
+   unsigned int hint;   /* 下一次扫描的开始位置 */
 };
 
 PUBLIC void BitmapInit(struct Bitmap* btmp);
 PUBLIC bool BitmapScanTest(struct Bitmap* btmp, unsigned int bitIdx);
 PUBLIC int BitmapScan(struct Bitmap* btmp, unsigned int cnt);
+PUBLIC int BitmapFindZero(struct Bitmap *btmp, unsigned int start);
 PUBLIC void BitmapSet(struct Bitmap* btmp, unsigned int bitIdx, char value);
 PUBLIC int BitmapChange(struct Bitmap *btmp, unsigned int bitIdx);
 PUBLIC int BitmapTestAndChange(struct Bitmap *btmp, unsigned int bitIdx);
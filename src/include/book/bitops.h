@@ -105,4 +105,16 @@ PRIVATE INLINE unsigned int TestAndSetBit(int nr, unsigned int *addr)
    return old;  
 }
 
+/**
+ * FindFirstSetBit - 查找第一个为1的位
+ * @word: 要查找的字，不能为0
+ * 
+ * 返回最低的为1的位的位置
+ */
+PRIVATE INLINE unsigned int FindFirstSetBit(unsigned int word)
+{
+   __asm__ ("bsfl %1, %0" : "=r" (word) : "rm" (word));
+   return word;
+}
+
 #endif   /*_BOOK_BITOPS_H*/
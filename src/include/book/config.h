@@ -56,12 +56,7 @@
 
 #define CONFIG_FILE_SYSTEM      /* 配置文件系统 */
 
-/**
- * ------------------------
- * 内存管理配置
- * ------------------------
- */
-#define CONFIG_LARGE_ALLOCS /* 如果想要用kmalloc分配128KB~4MB之间大小的内存，就需要配置此项 */
+#define CONFIG_BUFFER_CACHE_NR  2048    /* 块缓冲最多缓存的块数，超过后回收最久未使用的干净块 */
 
 /**
  * ------------------------
@@ -72,6 +67,7 @@
 #define CONFIG_DRV_MOUSE        /* 鼠标驱动配置 */
 #define CONFIG_DRV_IDE          /* IDE驱动配置 */
 #define CONFIG_DRV_RAMDISK      /* RAMDISK驱动配置 */
+#define CONFIG_RAMDISK_SECTORS  32768   /* RAMDISK默认的扇区数，用到的页才分配，可以通过ioctl调整 */
 #define CONFIG_DRV_SERIAL       /* 串口驱动配置 */
 #define CONFIG_DRV_VESA         /* VESA图形驱动配置 */
 #define CONFIG_DRV_TTY          /* TTY驱动配置 */
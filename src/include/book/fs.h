@@ -80,6 +80,13 @@ PUBLIC int SysMakeDev(const char *pathname, char type,
         int major, int minor, size_t size);
 PUBLIC int SysMakeTsk(const char *pathname, pid_t pid);
 
+/* 文件映射，缺页时从文件读取数据或者映射页缓存中的页 */
+PUBLIC int FileMapGet(int fd, int write);
+PUBLIC void FileMapDup(int file);
+PUBLIC void FileMapPut(int file);
+PUBLIC int FileMapRead(int file, void *buffer, unsigned int offset, unsigned int size);
+PUBLIC unsigned int FileMapPage(int file, unsigned int offset, int dirty);
+
 /* 初始化文件系统 */
 PUBLIC void InitFileSystem();
 
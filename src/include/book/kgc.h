@@ -22,6 +22,7 @@ PUBLIC void KGC_MouseInput(InputBufferMouse_t *packet);
 PUBLIC void KGC_TimerOccur();
 
 PUBLIC void *KGC_AllocBuffer(size_t size);
+PUBLIC void KGC_FreeBuffer(void *buffer, size_t size);
 PUBLIC void SysGraphWrite(int offset, int size, void *buffer);
 PUBLIC void KGC_CoreDraw(uint32_t position, uint32_t area, void *buffer, uint32_t color);
 
@@ -14,34 +14,40 @@
 #include <book/config.h>
 #include <book/bitmap.h>
 #include <book/list.h>
+#include <lib/mman.h>
 
 /*
 当内存对象大小小于1024时，储存在一个页中。
 +-----------+
 | group     | 
-| bitmap    |
 | objects   |
 +-----------+
 当内存对象大于1024时，对象和纪律信息分开存放。记录信息存放在一个页中，
 对象存放在其他页中。
+大于一个页的kmalloc不使用cache，直接从页分配器分配连续的页，页数记录在
+第一个页的内存节点的count中。
 +-----------+
 | group     | 
-| bitmap    |
 +-----------+
 | objects   |
 +-----------+
+空闲的对象通过对象开头保存的指针串成空闲链表，分配和释放只需要
+从链表头取出和放回一个对象。有构造函数的cache要保留对象构造后的
+状态，所以空闲链表的指针放在对象数据的后面。
 */
 
-/* 最大的mem的对象的大小 */
-#ifdef CONFIG_LARGE_ALLOCS 
-	#define MAX_MEM_CACHE_SIZE (4*MB)
-#else
-	#define MAX_MEM_CACHE_SIZE (128*KB)
-#endif
+/* 最大的mem的对象的大小，更大的kmalloc直接分配页 */
+#define MAX_MEM_CACHE_SIZE PAGE_SIZE
+
+/* kmalloc能分配的最大大小，也就是伙伴系统最大order的块的大小 */
+#define MAX_KMALLOC_SIZE (4*MB)
+
+/* 大于1024的对象，每个group的对象占用的页数 */
+#define MEM_GROUP_OBJECT_PAGES 8
 
 struct MemGroup {
     struct List list;           // 指向cache中的某个链表（full, partial, free）
-    struct Bitmap map;          // 管理对象分配状态的位图
+    void *freeList;             // 空闲对象链表，每个空闲对象开头保存下一个空闲对象的地址
     unsigned char *objects;     // 指向对象群的指针
     unsigned int usingCount;    // 正在使用中的对象数量
     unsigned int freeCount;     // 空闲的对象数量
@@ -52,7 +58,11 @@ struct MemGroup {
 
 #define MEM_CACHE_NAME_LEN 24
 
+/* 对象默认的对齐 */
+#define MEM_CACHE_MIN_ALIGN 8
+
 struct MemCache {
+    struct List list;            // 所有cache组成的链表
     struct List fullGroups;      // group对象都被使用了，就放在这个链表
     struct List partialGroups;   // group对象一部分被使用了，就放在这个链表
     struct List freeGroups;      // group对象都未被使用了，就放在这个链表
@@ -60,6 +70,14 @@ struct MemCache {
     unsigned int objectSize;    // group中每个对象的大小
     flags_t flags;              // cache的标志位
     unsigned int objectNumber;  // 每个group中有多少个对象
+
+    unsigned int size;          // 创建cache时要求的对象大小
+    unsigned int align;         // 对象的对齐
+    unsigned int freeOffset;    // 空闲链表指针在对象中的偏移
+    unsigned int groupPages;    // 每个group占用的页数
+    unsigned int groups;        // 已经创建的group数量
+    unsigned int usingObjects;  // 正在使用中的对象数量
+    void (*ctor)(void *);       // 对象的构造函数，创建group时对每个对象调用一次
     
     char name[MEM_CACHE_NAME_LEN];     // cache的名字
 };
@@ -69,10 +87,28 @@ struct CacheSize {
     struct MemCache *memCache;      // 指向对应cache的指针
 };
 
+/**
+ * 内存收缩器，kmshrink时先调用收缩器释放其它模块缓存的对象，
+ * 然后再收缩cache，把空闲的内存页还给系统
+ */
+struct MemShrinker {
+    struct List list;
+    int (*shrink)();            // 收缩函数，返回释放的字节数
+};
+
 PUBLIC int InitMemCaches();
+PUBLIC void MemCacheTest();
+PUBLIC void RegisterMemShrinker(struct MemShrinker *shrinker);
 
 PUBLIC void *kmalloc(size_t size, unsigned int flags);
 PUBLIC void kfree(void *objcet);
 PUBLIC int kmshrink();
 
+PUBLIC struct MemCache *CreateMemCache(char *name, size_t size, size_t align,
+    flags_t flags, void (*ctor)(void *));
+PUBLIC int DestroyMemCache(struct MemCache *cache);
+PUBLIC void *MemCacheAlloc(struct MemCache *cache, unsigned int flags);
+PUBLIC void MemCacheFree(struct MemCache *cache, void *object);
+PUBLIC int SysMemCacheScan(memcache_status_t *ms, unsigned int *idx);
+
 #endif   /* _BOOK_MEMCACHE_H */
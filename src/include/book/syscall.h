@@ -70,6 +70,9 @@ enum {
     SYS_REDIRECT,           /* 55 */
     SYS_REBOOT,             /* 56 */
     SYS_GETVER,             /* 57 */
+    SYS_GETITIMER,          /* 58 */
+    SYS_SETITIMER,          /* 59 */
+    SYS_MEMCACHESCAN,       /* 60 */
     MAX_SYSCALL_NR,
 };
 
@@ -85,6 +85,14 @@ typedef struct Task {
     uint32_t timeslice;             /* 时间片，可以动态调整 */
 
     uint32_t elapsedTicks;
+
+    /* 就绪队列统计信息 */
+    uint32_t readyStamp;            /* 进入就绪队列时的ticks */
+    uint32_t waitTicks;             /* 在就绪队列中等待的总ticks */
+    uint32_t maxWaitTicks;          /* 在就绪队列中等待的最长ticks */
+    uint32_t switches;              /* 被调度运行的次数 */
+    uint8_t onRunQueue;             /* 是否处于就绪队列中，由队列操作维护 */
+
     int exitStatus;                 // 退出时的状态
     char name[MAX_TASK_NAMELEN];
     
@@ -106,9 +114,8 @@ typedef struct Task {
     Spinlock_t signalMaskLock;  /* 信号屏蔽锁 */
 
     /* alarm闹钟 */
-    char alarm;                     /* 闹钟是否有效 */
-    uint32_t alarmTicks;            /* 闹钟剩余的ticks计数 */
-    uint32_t alarmSeconds;          /* 闹钟剩余的秒数 */
+    struct Timer alarmTimer;        /* 闹钟定时器 */
+    uint32_t alarmInterval;         /* 闹钟周期ticks，为0时只触发一次 */
 
     struct Timer *sleepTimer;       /* 休眠的时候的定时器 */
 
@@ -142,6 +149,8 @@ PUBLIC void InitSignalInTask(struct Task *task);
 
 PUBLIC void TaskPriorityQueueAddTail(struct Task *task);
 PUBLIC void TaskPriorityQueueAddHead(struct Task *task);
+PUBLIC void TaskPriorityQueueDel(struct Task *task);
+PUBLIC struct Task *TaskPriorityQueueFetchFirst();
 PUBLIC void TaskGloablListAdd(struct Task *task);
 
 PUBLIC int IsTaskInPriorityQueue(struct Task *task);
@@ -27,7 +27,7 @@
  */
 typedef struct Timer {
     struct List list;   // 链表
-    uint64_t expires;   // 到期时间
+    uint64_t expires;   // 到期时间，添加后是到期的绝对ticks
     uint64_t lastExpires;   // 上一个到期时间
     uint32_t data;      // 传递的数据
     void (*function)(uint32_t);     // 到期后要调用的函数
@@ -41,8 +41,6 @@ PUBLIC void InitTimer();
 PUBLIC void TimerInit(struct Timer *timer, uint64_t expires, uint32_t data,
         void (*function)(uint32_t));
 
-PUBLIC bool TimerUpdate(struct Timer *timer);
-
 PUBLIC void UpdateTimerSystem();
 
 PUBLIC void AddTimer(struct Timer *timer);
@@ -51,5 +49,6 @@ PUBLIC void StopTimer(struct Timer *timer);
 PUBLIC void ResumeTimer(struct Timer *timer);
 PUBLIC void CancelTimer(struct Timer *timer);
 PUBLIC void DoTimerHandler(struct Timer *timer);
+PUBLIC uint32_t TimerLeftTicks(struct Timer *timer);
 
 #endif  /* _BOOK_TIMER_H */
@@ -26,6 +26,8 @@
 
 /* map flags */
 #define MAP_FIXED        0x10      /* Interpret addr exactly */
+#define MAP_SHARED       0x20      /* 映射文件时，修改写回文件并且和其它映射共享 */
+#define MAP_PRIVATE      0x40      /* 映射文件时，修改只对自己可见（写时复制） */
 
 #define VMS_STACK        0x01      /* 空间是栈类型 */
 #define VMS_HEAP            0x02      /* 空间是堆类型 */
@@ -48,11 +50,23 @@ struct VMSpace {
     address_t               end;    // 空间结束地址
     unsigned int            pageProt;   //页保护
     flags_t                 flags;  // 空间的标志
+    int                     file;   // 映射的文件（全局描述符），-1表示没有映射文件
+    unsigned int            fileOffset; // 空间开始地址对应的文件偏移
+    unsigned int            fileSize;   // 从空间开始地址算起，文件中数据的大小
     struct VMSpace          *next;  // 指向下一个空间
+
+    /* 按开始地址排序的AVL树 */
+    struct VMSpace          *left, *right, *parent;
+    int                     height;     // 子树的高度
+    address_t               subStart;   // 子树中最小的开始地址
+    address_t               subEnd;     // 子树中最大的结束地址
+    uint32_t                maxGap;     // 子树中相邻空间之间最大的空闲长度
 };
 
 struct MemoryManager {
-    struct VMSpace *spaceMap;   // 管理所有的空间 
+    struct VMSpace *spaceMap;   // 管理所有的空间，按地址排序的链表
+    struct VMSpace *spaceRoot;  // 索引所有空间的AVL树
+    struct VMSpace *spaceCache; // 上一次查找到的空间
 
     // 空间中的各种地址
     address_t      codeStart, codeEnd;
@@ -66,6 +80,8 @@ struct MemoryManager {
 
 
 PUBLIC void InitVMSpace();
+PUBLIC struct VMSpace *AllocVMSpace();
+PUBLIC void FreeVMSpace(struct VMSpace *space);
 PUBLIC void InitMemoryManager(struct MemoryManager *mm);
 PUBLIC void ReleaseVMSpace(struct MemoryManager *mm, unsigned int flags);
 PUBLIC struct VMSpace *FindVMSpacePrev(struct MemoryManager *mm, 
@@ -74,8 +90,17 @@ PUBLIC struct VMSpace *FindVMSpace(struct MemoryManager *mm, address_t addr);
 PUBLIC int InsertVMSpace(struct MemoryManager *mm, struct VMSpace* space);
 PUBLIC void RemoveVMSpace(struct MemoryManager *mm, struct VMSpace *space, 
         struct VMSpace *prev);
+PUBLIC void UpdateVMSpace(struct VMSpace *space);
+
+PUBLIC int32 DoMmap(struct MemoryManager *mm, address_t addr, uint32_t len, 
+        uint32_t prot, uint32_t flags);
+PUBLIC int32 DoMmapFile(struct MemoryManager *mm, address_t addr, uint32_t len, 
+        uint32_t prot, uint32_t flags, int fd, uint32_t offset, uint32_t fileSize);
+PUBLIC int VMSpaceFillPage(struct VMSpace *space, address_t addr);
 
-PUBLIC void *SysMmap(uint32_t addr, uint32_t len, uint32_t prot, uint32_t flags);
+struct TrapFrame;
+PUBLIC void *SysMmap(uint32_t addr, uint32_t len, uint32_t prot, uint32_t flags,
+        struct TrapFrame *frame);
 PUBLIC int SysMunmap(uint32_t addr, uint32_t len);
 
 PUBLIC unsigned int SysBrk(unsigned int brk);
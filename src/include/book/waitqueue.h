@@ -98,5 +98,66 @@ PRIVATE INLINE void WaitQueueWakeUp(struct WaitQueue *waitQueue)
 	InterruptRestore(flags);
 }
 
+/**
+ * WaitQueueSleepOn - 在等待队列上休眠
+ * @waitQueue: 等待队列
+ * 
+ * 用一个栈上的等待者挂到队列上，然后阻塞自己，调用者需要关闭中断。
+ * 被信号等其它方式唤醒时，等待者可能还在队列中，需要自己脱离队列
+ */
+PRIVATE INLINE void WaitQueueSleepOn(struct WaitQueue *waitQueue)
+{
+	struct WaitQueue waiter;
+	
+	/* 把当前进程设置成一个等待者 */
+	WaitQueueInit(&waiter, CurrentTask());
+
+	/* 添加到等待队列的最后 */
+	ListAddTail(&waiter.waitList, &waitQueue->waitList);
+
+	TaskBlock(TASK_BLOCKED);
+
+	/* 不是被等待队列唤醒的，就自己脱离队列 */
+	if (!ListEmpty(&waiter.waitList))
+		ListDel(&waiter.waitList);
+}
+
+/**
+ * WaitQueueWakeUpAll - 唤醒等待队列中的所有等待者
+ * @waitQueue: 等待队列
+ * 
+ * 只用于通过WaitQueueSleepOn（WaitEvent）等待的队列
+ */
+PRIVATE INLINE void WaitQueueWakeUpAll(struct WaitQueue *waitQueue)
+{
+	unsigned long flags = InterruptSave();
+    
+	struct WaitQueue *waiter, *next;
+	ListForEachOwnerSafe(waiter, next, &waitQueue->waitList, waitList) {
+		/* 从队列删除，等待者醒来后就知道是被队列唤醒的 */
+		ListDelInit(&waiter->waitList);
+		TaskWakeUp(waiter->task);
+	}
+    
+	InterruptRestore(flags);
+}
+
+/**
+ * WaitEvent - 等待条件满足
+ * @waitQueue: 等待队列
+ * @condition: 等待的条件
+ * 
+ * 条件不满足时就在等待队列上休眠，不占用CPU，
+ * 改变条件的一方需要调用WaitQueueWakeUpAll来唤醒。
+ * 醒来后重新检测条件，条件满足才返回
+ */
+#define WaitEvent(waitQueue, condition) \
+	do { \
+		unsigned long __flags = InterruptSave(); \
+		while (!(condition)) { \
+			WaitQueueSleepOn(waitQueue); \
+		} \
+		InterruptRestore(__flags); \
+	} while (0)
 
 #endif   /*_BOOK_WAITQUEUE_H*/
@@ -26,6 +26,11 @@ PUBLIC int BOFS_AllocBitmap(struct BOFS_SuperBlock *sb, enum BOFS_BM_TYPE bmType
 PUBLIC int BOFS_FreeBitmap(struct BOFS_SuperBlock *sb, enum BOFS_BM_TYPE bmType, unsigned int idx);
 PUBLIC int BOFS_SyncBitmap(struct BOFS_SuperBlock *sb, enum BOFS_BM_TYPE bmType, unsigned int idx);
 
+PUBLIC int BOFS_AllocBlocks(struct BOFS_SuperBlock *sb, unsigned int goal,
+    unsigned int want, unsigned int *count);
+PUBLIC void BOFS_FreeBlocks(struct BOFS_SuperBlock *sb, unsigned int idx, unsigned int count);
+PUBLIC void BOFS_DumpBlockStat(struct BOFS_SuperBlock *sb);
+
 /* 扇区位图idx和lba的转换 */
 #define BOFS_IDX_TO_LBA(sb, idx) ((sb)->dataStartLba + (idx))
 #define BOFS_LBA_TO_IDX(sb, lba) ((lba) - (sb)->dataStartLba)
@@ -0,0 +1,54 @@
+/*
+ * file:		include/fs/bofs/dcache.h
+ * auther:		Jason Hu
+ * time:		2020/4/22
+ * copyright:	(C) 2018-2020 by Book OS developers. All rights reserved.
+ */
+
+#ifndef _BOFS_DCACHE_H
+#define _BOFS_DCACHE_H
+
+#include <lib/stdint.h>
+#include <lib/types.h>
+#include <book/list.h>
+#include <fs/bofs/dir_entry.h>
+#include <fs/bofs/super_block.h>
+
+/* 目录项缓存的数量 */
+#define BOFS_DCACHE_NR          128
+
+/* 目录项缓存散列表的大小，需要是2的n次方 */
+#define BOFS_DCACHE_HASH_NR     64
+
+/**
+ * 目录项缓存，通过（超级块，父目录节点号，名字）查找目录项，
+ * 路径查找时不需要每次都去读取父目录的数据。
+ * 没有找到的名字也会缓存，作为负目录项。
+ */
+struct BOFS_Dentry {
+    struct List hashList;           /* 散列表中的链表 */
+    struct List lruList;            /* LRU链表，最久未使用的在最前面 */
+    struct BOFS_SuperBlock *sb;     /* 所在的超级块，为NULL表示没有使用 */
+    unsigned int parent;            /* 父目录的节点号 */
+    char negative;                  /* 负目录项：父目录中没有这个名字 */
+    struct BOFS_DirEntry entry;     /* 目录项 */
+};
+
+/* 查找结果 */
+#define BOFS_DCACHE_MISS        -1  /* 缓存中没有 */
+#define BOFS_DCACHE_NEGATIVE    0   /* 缓存中记录了不存在 */
+#define BOFS_DCACHE_HIT         1   /* 找到目录项 */
+
+PUBLIC int BOFS_DcacheLookup(struct BOFS_SuperBlock *sb, unsigned int parent,
+    char *name, struct BOFS_DirEntry *entry);
+PUBLIC unsigned int BOFS_DcacheGeneration();
+PUBLIC void BOFS_DcacheAdd(struct BOFS_SuperBlock *sb, unsigned int parent,
+    char *name, struct BOFS_DirEntry *entry, unsigned int generation);
+PUBLIC void BOFS_DcacheUpdate(struct BOFS_SuperBlock *sb, unsigned int parent,
+    struct BOFS_DirEntry *entry);
+PUBLIC void BOFS_DcachePurge(struct BOFS_SuperBlock *sb);
+
+PUBLIC void BOFS_DumpDcache();
+PUBLIC void BOFS_InitDcache();
+
+#endif	/* _BOFS_DCACHE_H */
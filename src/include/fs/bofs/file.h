@@ -58,8 +58,23 @@ struct BOFS_FileDescriptor
 	struct BOFS_DirEntry *parentEntry;	/* parent dir entry */
 	struct BOFS_Inode *inode;			/* file inode */
     struct BOFS_Pipe *pipe;			    /* pipe file */
+
+    /* 顺序读取的预读状态 */
+    unsigned int raPrev;    /* 上一次读取的最后一个块 */
+    unsigned int raStart;   /* 预读窗口的起始块 */
+    unsigned int raEnd;     /* 预读窗口的结束块（不包含） */
+    unsigned int raSize;    /* 预读窗口的大小，0表示没有预读 */
+    unsigned int raReads;   /* 读取的块数 */
+    unsigned int raHits;    /* 读取时已经被预读的块数 */
 };
 
+/* 预读窗口的最小和最大块数 */
+#define BOFS_RA_MIN     4
+#define BOFS_RA_MAX     32
+
+/* 还没有读取过，下一次从0块读取也算顺序读取 */
+#define BOFS_RA_NONE    0xffffffff
+
 /* 记录一些重要信息 */
 struct BOFS_Stat
 {
@@ -108,6 +123,12 @@ PUBLIC long BOFS_IsFoot(int fd);
 PUBLIC int BOFS_Dup(int oldfd);
 PUBLIC int BOFS_Dup2(int oldfd, int target_fd);
 
+PUBLIC int BOFS_FileMapGet(int fd, int write);
+PUBLIC void BOFS_FileMapDup(int globalFd);
+PUBLIC void BOFS_FileMapPut(int globalFd);
+PUBLIC int BOFS_FileMapRead(int globalFd, void *buf, unsigned int offset, unsigned int count);
+PUBLIC unsigned int BOFS_FileMapPage(int globalFd, unsigned int offset, int dirty);
+
 PUBLIC int BOFS_Stat(const char *pathname,
     struct BOFS_Stat *buf,
     struct BOFS_SuperBlock *sb);
@@ -0,0 +1,108 @@
+/*
+ * file:		include/fs/bofs/icache.h
+ * auther:		Jason Hu
+ * time:		2020/4/23
+ * copyright:	(C) 2018-2020 by Book OS developers. All rights reserved.
+ */
+
+#ifndef _BOFS_ICACHE_H
+#define _BOFS_ICACHE_H
+
+#include <lib/stdint.h>
+#include <lib/types.h>
+#include <book/list.h>
+#include <fs/bofs/inode.h>
+#include <fs/bofs/super_block.h>
+
+/* 没有被引用的节点缓存最多保留的数量，超过后淘汰最久未使用的 */
+#define BOFS_ICACHE_NR          64
+
+/* 节点缓存散列表的大小，需要是2的n次方 */
+#define BOFS_ICACHE_HASH_NR     64
+
+/* 每个节点缓存的块映射区间数量 */
+#define BOFS_BMAP_NR            8
+
+/* 文件增长时一次预分配的连续块数 */
+#define BOFS_PREALLOC_NR        16
+
+/* 页缓存散列表的大小，需要是2的n次方 */
+#define BOFS_PCACHE_HASH_NR     128
+
+/**
+ * 块映射区间，记录间接块中已经解析过的逻辑块到磁盘块的映射，
+ * 逻辑块和磁盘块都连续的合并成一个区间
+ */
+struct BOFS_BlockExtent {
+    unsigned int index;             /* 起始逻辑块 */
+    unsigned int block;             /* 起始磁盘块 */
+    unsigned int count;             /* 块数，为0表示没有使用 */
+};
+
+/**
+ * 节点缓存，通过（设备号，节点号）查找内存中的节点，
+ * 打开同一个文件的多个文件描述符共享同一个节点。
+ * 修改后只标记为脏，在同步，淘汰或者卸载的时候才写回磁盘。
+ */
+struct BOFS_CachedInode {
+    struct BOFS_Inode inode;        /* 节点，需要放在最前面 */
+    struct List hashList;           /* 散列表中的链表 */
+    struct List lruList;            /* 没有被引用时在LRU链表上 */
+    struct BOFS_SuperBlock *sb;     /* 所在的超级块 */
+    dev_t devno;                    /* 所在的设备号 */
+    unsigned int id;                /* 节点号 */
+    int count;                      /* 引用计数 */
+    char dirty;                     /* 修改后还没有写回磁盘 */
+    unsigned char nextExtent;       /* 下一个被替换的块映射区间 */
+    struct BOFS_BlockExtent extents[BOFS_BMAP_NR];  /* 块映射缓存 */
+    unsigned int allocGoal;         /* 下一次分配期望的位置，在上一次分配的后面 */
+    unsigned int preallocStart;     /* 预分配还没有使用的第一个块 */
+    unsigned int preallocCount;     /* 预分配还没有使用的块数 */
+    struct List pageList;           /* 页缓存中属于这个节点的页 */
+    unsigned int pageCount;         /* 页缓存中的页数 */
+};
+
+/**
+ * 页缓存中的页，映射文件时按照（节点，页号）查找，
+ * 映射同一个文件的进程共享同一个物理页。节点被淘汰时才释放。
+ */
+struct BOFS_CachedPage {
+    struct List hashList;           /* 散列表中的链表 */
+    struct List list;               /* 节点的页链表 */
+    struct BOFS_CachedInode *owner; /* 所在的节点缓存 */
+    unsigned int index;             /* 文件中的页号 */
+    unsigned int page;              /* 物理页地址 */
+    char dirty;                     /* 可能被共享的可写映射修改过 */
+};
+
+PUBLIC struct BOFS_Inode *BOFS_IcacheGet(struct BOFS_SuperBlock *sb,
+    unsigned int id, struct BOFS_Inode *init);
+PUBLIC void BOFS_IcachePut(struct BOFS_Inode *inode);
+PUBLIC void BOFS_IcacheMarkDirty(struct BOFS_Inode *inode);
+PUBLIC int BOFS_IcacheWriteBack(struct BOFS_Inode *inode);
+PUBLIC int BOFS_IcacheSync(struct BOFS_SuperBlock *sb);
+PUBLIC void BOFS_IcachePurge(struct BOFS_SuperBlock *sb);
+
+PUBLIC int BOFS_IcacheMapLookup(struct BOFS_SuperBlock *sb, unsigned int id,
+    unsigned int index, unsigned int *block);
+PUBLIC void BOFS_IcacheMapAdd(struct BOFS_SuperBlock *sb, unsigned int id,
+    unsigned int index, unsigned int block);
+PUBLIC void BOFS_IcacheMapInvalidate(struct BOFS_SuperBlock *sb, unsigned int id);
+
+PUBLIC int BOFS_IcacheAllocBlock(struct BOFS_SuperBlock *sb, unsigned int id);
+PUBLIC void BOFS_IcacheDiscardPrealloc(struct BOFS_SuperBlock *sb, unsigned int id);
+
+PUBLIC unsigned int BOFS_IcachePageGet(struct BOFS_SuperBlock *sb, unsigned int id,
+    unsigned int index, char dirty);
+PUBLIC unsigned int BOFS_IcachePageAdd(struct BOFS_SuperBlock *sb, unsigned int id,
+    unsigned int index, unsigned int page, char dirty);
+PUBLIC void BOFS_IcachePageCopy(struct BOFS_SuperBlock *sb, unsigned int id,
+    unsigned int offset, void *buf, unsigned int count, char write);
+PUBLIC int BOFS_IcachePageSync(struct BOFS_SuperBlock *sb, unsigned int id);
+PUBLIC int BOFS_IcacheIsDirty(struct BOFS_SuperBlock *sb, unsigned int id);
+PUBLIC void BOFS_IcachePageInvalidate(struct BOFS_SuperBlock *sb, unsigned int id);
+
+PUBLIC void BOFS_DumpIcache();
+PUBLIC void BOFS_InitIcache();
+
+#endif	/* _BOFS_ICACHE_H */
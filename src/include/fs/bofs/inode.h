@@ -39,6 +39,9 @@
 #define BOFS_IMODE_D 0X20 /*directory type mode*/
 #define BOFS_IMODE_V 0X20 /* device mode*/
 
+/* 节点的数据块和间接块在块缓冲中的所属标识，0表示没有所属，所以要加1 */
+#define BOFS_BUFFER_OWNER(inode) ((inode)->id + 1)
+
 /*
 we assume a inode is 128 bytes
 */
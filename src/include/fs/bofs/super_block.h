@@ -44,6 +44,13 @@ struct BOFS_SuperBlock
 	struct Bitmap sectorBitmap;	/*sector manager bitmap*/
 	struct Bitmap inodeBitmap;		/*inode manager bitmap*/
 	struct BOFS_Dir *rootDir;   /* 根目录指针，每一个文件系统都有一个自己的根目录 */
+
+	/* 数据块分配的信息，只在内存中使用 */
+	unsigned int allocHint;		/* 下一次从这个位置开始查找空闲块 */
+	unsigned int allocCount;	/* 从位图中分配的次数 */
+	unsigned int allocBlocks;	/* 从位图中分配的块数 */
+	unsigned int allocGoalHits;	/* 刚好分配到期望位置的次数 */
+	unsigned int allocPrealloc;	/* 从预分配中取得的块数 */
 } PACKED;
 
 #define BOFS_HAD_FS(sb) ((sb)->magic == BOFS_SUPER_BLOCK_MAGIC) ? 1: 0
@@ -133,6 +140,14 @@ PUBLIC int BOFS_ReleaseInodeData(struct BOFS_SuperBlock *sb,
 int BOFS_EmptyInode(struct BOFS_Inode *inode,
 	struct BOFS_SuperBlock *sb);
 
+PUBLIC int BOFS_ReadInode(struct BOFS_Inode *inode, 
+    unsigned int id, 
+    struct BOFS_SuperBlock *sb);
+PUBLIC int BOFS_WriteInode(struct BOFS_Inode *inode,
+	struct BOFS_SuperBlock *sb);
+PUBLIC struct BOFS_Inode *BOFS_OpenInode(struct BOFS_SuperBlock *sb,
+	unsigned int id);
+
 
 #endif
 
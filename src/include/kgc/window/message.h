@@ -24,6 +24,7 @@ typedef struct KGC_MessageNode {
 PUBLIC int KGC_SendMessage(KGC_Message_t *message);
 PUBLIC int KGC_RecvMessage(KGC_Message_t *message);
 PUBLIC int SysKGC_Message(int operate, KGC_Message_t *message);
+PUBLIC int KGC_InitMessage();
 PUBLIC KGC_MessageNode_t *KGC_CreateMessageNode();
 PUBLIC void KGC_AddMessageNode(KGC_MessageNode_t *node, KGC_Window_t *window);
 PUBLIC void KGC_FreeMessageList(KGC_Window_t *window);
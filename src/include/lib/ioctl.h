@@ -12,4 +12,15 @@
 #define GTTY_IOCTL_CLEAR    1       /* 清屏 */
 #define GTTY_IOCTL_HOLD     2       /* 设置持有者 */
 
+/* 普通文件 */
+#define FILE_IOCTL_RASTAT   0x100   /* 获取预读统计，参数是struct rastat的地址 */
+#define FILE_IOCTL_FSSTAT   0x101   /* 在内核中输出文件所在文件系统的缓存统计，没有参数 */
+
+/* 文件的预读统计信息 */
+struct rastat {
+    unsigned int ra_reads;      /* 读取的块数 */
+    unsigned int ra_hits;       /* 已经被预读的块数 */
+    unsigned int ra_window;     /* 当前的预读窗口大小（块） */
+};
+
 #endif  /* _LIB_IOCTL_H */
@@ -25,6 +25,12 @@ void* memmove(void* dst,const void* src,uint32_t count);
 
 #define bzero(str, n) memset(str, 0, n) 
 
+/* 超过这个大小的复制才使用加速函数 */
+#define MEMCPY_LARGE_MIN    512
+
+/* 大块内存复制的加速函数，由体系结构在启动时设置 */
+extern void (*memcpyLarge)(void* dst_, const void* src_, uint32_t size);
+
 char* strcpy(char* dst_, const char* src_);
 uint32_t strlen(const char* str);
 int8_t strcmp (const char *a, const char *b); 
@@ -20,6 +20,9 @@ typedef struct taskscan_status {
     uint32_t ts_priority;  /* 优先级 */
     uint32_t ts_ticks;     /* 剩余ticks数 */
     uint32_t ts_runticks;  /* 运行的ticks数 */
+    uint32_t ts_waitticks; /* 在就绪队列中等待的ticks数 */
+    uint32_t ts_maxwait;   /* 在就绪队列中等待的最长ticks数 */
+    uint32_t ts_switches;  /* 被调度运行的次数 */
     char ts_name[32];      /* 任务名字 */
 } taskscan_status_t;
 
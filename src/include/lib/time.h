@@ -26,7 +26,27 @@ struct tm
   int tm_isdst;			/* DST.		[-1/0/1]*/
 };
 
+#ifndef _STRUCT_TIMEVAL
+#define _STRUCT_TIMEVAL 1
+struct timeval
+{
+  long tv_sec;			/* Seconds.  */
+  long tv_usec;			/* Microseconds.  */
+};
+#endif  /* _STRUCT_TIMEVAL */
+
+/* 间隔定时器，目前只支持ITIMER_REAL */
+#define ITIMER_REAL     0
+
+struct itimerval
+{
+  struct timeval it_interval;	/* 周期，为0时只触发一次 */
+  struct timeval it_value;		/* 距离下一次到期的时间 */
+};
+
 unsigned int time(struct tm *tm);
+int getitimer(int which, struct itimerval *value);
+int setitimer(int which, const struct itimerval *value, struct itimerval *ovalue);
 char *asctime_r(const struct tm *tp, char *buf);
 char *asctime(const struct tm *tp);
 
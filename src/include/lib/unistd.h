@@ -39,6 +39,7 @@ void *sbrk(int increment);
 int access(const char *filenpath, int mode);
 
 unsigned int alarm(unsigned int seconds);
+unsigned int ualarm(unsigned int usecs, unsigned int interval);
 
 int dup(int old);
 int dup2(int oldfd, int newfd);
@@ -138,5 +138,6 @@ PUBLIC struct PciDevice *AllocPciDevice();
 PUBLIC uint32 GetPciDeviceConnected();
 PUBLIC void EnablePciBusMastering(struct PciDevice *device);
 PUBLIC struct PciDevice* GetPciDevice(uint16 vendorID, uint16 deviceID);
+PUBLIC struct PciDevice* GetPciDeviceByClass(uint16 classCode);
 
 #endif	/* _DRIVER__PCI_H */
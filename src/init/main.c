@@ -14,6 +14,7 @@
 #include <book/cpu.h>
 #include <book/fs.h>
 #include <book/mmu.h>
+#include <book/memcache.h>
 #include <book/power.h>
 #include <net/network.h>
 #include <pci/pci.h>
@@ -58,6 +59,9 @@ PUBLIC int main()
 	
     /* 打开中断标志 */
 	EnableInterrupt();
+
+	/* 时钟可用后再测试内存缓存 */
+	MemCacheTest();
 	
 	/* 初始化字符设备 */	
 	InitCharDevice();
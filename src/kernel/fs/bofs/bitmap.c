@@ -9,6 +9,7 @@
 #include <book/memcache.h>
 #include <book/debug.h>
 #include <book/vmarea.h>
+#include <book/interrupt.h>
 #include <lib/string.h>
 #include <lib/string.h>
 #include <fs/bofs/bitmap.h>
@@ -70,6 +71,13 @@ PUBLIC int BOFS_LoadBitmap(struct BOFS_SuperBlock *sb)
 			return -1;
 		}
 	}
+
+    /* 块分配的信息只在内存中使用，挂载时重新开始 */
+    sb->allocHint = 0;
+    sb->allocCount = 0;
+    sb->allocBlocks = 0;
+    sb->allocGoalHits = 0;
+    sb->allocPrealloc = 0;
     return 0;
 }
 
@@ -206,4 +214,118 @@ PUBLIC int BOFS_SyncBitmap(struct BOFS_SuperBlock *sb,
 		return true;
 	}
 	return false;
-}
\ No newline at end of file
+}
+
+/**
+ * BOFS_AllocBlocks - 分配连续的数据块
+ * @sb: 超级块
+ * @goal: 期望的起始位置，为0表示从上一次分配的后面开始
+ * @want: 最多分配多少块
+ * @count: 实际分配的块数
+ * 
+ * 下一次适应：从期望的位置开始查找空闲块，到末尾后再从头开始，
+ * 找到后尽量往后多分配连续的块，最多want块，至少1块。
+ * 这样同一个文件的块在磁盘上尽量连续，顺序读写可以合并成大请求。
+ * @return 成功返回第一个块的索引，失败返回-1
+ */
+PUBLIC int BOFS_AllocBlocks(struct BOFS_SuperBlock *sb, unsigned int goal,
+    unsigned int want, unsigned int *count)
+{
+	/* 超级块是紧凑的结构，复制一份位图再使用，位数据还是同一份 */
+	struct Bitmap sectorBitmap = sb->sectorBitmap;
+	struct Bitmap *bitmap = &sectorBitmap;
+	unsigned int bits = bitmap->btmpBytesLen * 8;
+	unsigned int n;
+	int idx;
+
+	unsigned long flags = InterruptSave();
+	
+	if (!goal || goal >= bits)
+		goal = sb->allocHint;
+	
+	idx = BitmapFindZero(bitmap, goal);
+	if (idx == -1 && goal) {
+		idx = BitmapFindZero(bitmap, 0);
+	}
+	if (idx == -1) {
+		InterruptRestore(flags);
+		printk("alloc sector bitmap failed!\n");
+		return -1;
+	}
+
+	/* 尽量往后多分配连续的块 */
+	n = 0;
+	do {
+		BitmapSet(bitmap, idx + n, 1);
+		n++;
+	} while (n < want && idx + n < bits && !BitmapScanTest(bitmap, idx + n));
+
+	sb->allocHint = idx + n;
+	sb->allocCount++;
+	sb->allocBlocks += n;
+	if (idx == goal)
+		sb->allocGoalHits++;
+
+	InterruptRestore(flags);
+	
+	*count = n;
+	return idx;
+}
+
+/**
+ * BOFS_FreeBlocks - 释放连续的数据块
+ * @sb: 超级块
+ * @idx: 第一个块的索引
+ * @count: 块数
+ * 
+ * 释放后把位图同步到磁盘，每个位图扇区只同步一次
+ */
+PUBLIC void BOFS_FreeBlocks(struct BOFS_SuperBlock *sb, unsigned int idx, unsigned int count)
+{
+	struct Bitmap bitmap = sb->sectorBitmap;
+	unsigned int i;
+
+	unsigned long flags = InterruptSave();
+	for (i = 0; i < count; i++) {
+		BitmapSet(&bitmap, idx + i, 0);
+	}
+	InterruptRestore(flags);
+
+	for (i = 0; i < count; i++) {
+		if (i == 0 || (idx + i) % (8 * SECTOR_SIZE) == 0)
+			BOFS_SyncBitmap(sb, BOFS_BMT_SECTOR, idx + i);
+	}
+}
+
+/**
+ * BOFS_DumpBlockStat - 输出块分配和碎片的统计信息
+ * @sb: 超级块
+ * 
+ * 遍历扇区位图，统计空闲块被分成了多少段，以及最大的连续空闲段
+ */
+PUBLIC void BOFS_DumpBlockStat(struct BOFS_SuperBlock *sb)
+{
+	struct Bitmap bitmap = sb->sectorBitmap;
+	unsigned int bits = bitmap.btmpBytesLen * 8;
+	unsigned int freeBlocks = 0, freeExtents = 0, largest = 0, run = 0;
+	unsigned int i;
+
+	for (i = 0; i < bits; i++) {
+		if (!BitmapScanTest(&bitmap, i)) {
+			if (!run)
+				freeExtents++;
+			run++;
+			freeBlocks++;
+		} else {
+			run = 0;
+		}
+		if (run > largest)
+			largest = run;
+	}
+
+	printk(PART_TIP "----Block Allocation----\n");
+	printk(PART_TIP "allocs:%d blocks:%d goal hits:%d prealloc blocks:%d\n",
+		sb->allocCount, sb->allocBlocks, sb->allocGoalHits, sb->allocPrealloc);
+	printk(PART_TIP "free blocks:%d free extents:%d largest free extent:%d\n",
+		freeBlocks, freeExtents, largest);
+}
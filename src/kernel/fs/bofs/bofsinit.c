@@ -25,6 +25,8 @@
 #include <fs/bofs/dir.h>
 #include <fs/bofs/file.h>
 #include <fs/bofs/drive.h>
+#include <fs/bofs/dcache.h>
+#include <fs/bofs/icache.h>
 
 EXTERN struct List allBlockDeviceList;
 
@@ -123,6 +125,8 @@ PRIVATE int BOFS_MountFileSystem(struct BOFS_SuperBlock *sb)
 PRIVATE int BOFS_UnmountFileSystem(struct BOFS_SuperBlock *sb)
 {
     BOFS_CloseDir(sb->rootDir);
+    BOFS_DcachePurge(sb);
+    BOFS_IcachePurge(sb);
 
     if (BOFS_UnmountFS(sb)) {
         printk(PART_ERROR "mount bofs failed!\n");
@@ -137,6 +141,8 @@ PRIVATE int BOFS_UnmountFileSystem(struct BOFS_SuperBlock *sb)
 PUBLIC int InitBoFS()
 {
     BOFS_InitFdTable();
+    BOFS_InitDcache();
+    BOFS_InitIcache();
 
     /* 获取设备文件 */
     struct BlockDevice *device;
@@ -0,0 +1,274 @@
+/*
+ * file:		kernel/fs/bofs/dcache.c
+ * auther:		Jason Hu
+ * time:		2020/4/22
+ * copyright:	(C) 2018-2020 by Book OS developers. All rights reserved.
+ */
+
+#include <book/arch.h>
+#include <book/debug.h>
+#include <book/interrupt.h>
+#include <lib/string.h>
+#include <fs/bofs/dcache.h>
+
+/* 目录项缓存池，不需要动态分配 */
+PRIVATE struct BOFS_Dentry dentryTable[BOFS_DCACHE_NR];
+
+/* 目录项散列表 */
+PRIVATE struct List dentryHashTable[BOFS_DCACHE_HASH_NR];
+
+/* LRU链表，所有目录项都在上面，没有使用的在最前面 */
+PRIVATE LIST_HEAD(dentryLruList);
+
+/* 每次目录项写入磁盘后增加，用来判断查找磁盘期间目录有没有被修改 */
+PRIVATE unsigned int dcacheGeneration;
+
+/* 统计信息 */
+PRIVATE unsigned int dcacheLookups;
+PRIVATE unsigned int dcacheHits;
+PRIVATE unsigned int dcacheNegativeHits;
+
+/**
+ * DentryHash - 计算目录项的散列表
+ * @sb: 超级块
+ * @parent: 父目录节点号
+ * @name: 名字
+ */
+PRIVATE struct List *DentryHash(struct BOFS_SuperBlock *sb, unsigned int parent, char *name)
+{
+    unsigned int hash = (unsigned int)sb ^ parent;
+
+    while (*name)
+        hash = hash * 31 + *name++;
+
+    return &dentryHashTable[(hash ^ (hash >> 16)) & (BOFS_DCACHE_HASH_NR - 1)];
+}
+
+/**
+ * DentryFind - 查找目录项缓存
+ * @sb: 超级块
+ * @parent: 父目录节点号
+ * @name: 名字
+ *
+ * 需要在关闭中断的情况下调用，没找到返回NULL
+ */
+PRIVATE struct BOFS_Dentry *DentryFind(struct BOFS_SuperBlock *sb, unsigned int parent, char *name)
+{
+    struct BOFS_Dentry *dentry;
+
+    ListForEachOwner(dentry, DentryHash(sb, parent, name), hashList) {
+        if (dentry->sb == sb && dentry->parent == parent &&
+            !strcmp(dentry->entry.name, name))
+            return dentry;
+    }
+    return NULL;
+}
+
+/**
+ * DentryDrop - 丢弃一个目录项缓存
+ * @dentry: 目录项缓存
+ *
+ * 从散列表中删除，放到LRU链表的最前面，优先被重新使用
+ */
+PRIVATE void DentryDrop(struct BOFS_Dentry *dentry)
+{
+    ListDel(&dentry->hashList);
+    dentry->sb = NULL;
+    ListDel(&dentry->lruList);
+    ListAdd(&dentry->lruList, &dentryLruList);
+}
+
+/**
+ * BOFS_DcacheLookup - 查找目录项
+ * @sb: 超级块
+ * @parent: 父目录节点号
+ * @name: 名字
+ * @entry: 找到后复制目录项到这里
+ *
+ * 返回BOFS_DCACHE_HIT表示找到，BOFS_DCACHE_NEGATIVE表示记录了不存在，
+ * BOFS_DCACHE_MISS表示需要去磁盘上查找
+ */
+PUBLIC int BOFS_DcacheLookup(struct BOFS_SuperBlock *sb, unsigned int parent,
+    char *name, struct BOFS_DirEntry *entry)
+{
+    struct BOFS_Dentry *dentry;
+    int ret = BOFS_DCACHE_MISS;
+
+    unsigned long flags = InterruptSave();
+    dcacheLookups++;
+
+    dentry = DentryFind(sb, parent, name);
+    if (dentry != NULL) {
+        if (dentry->negative) {
+            dcacheNegativeHits++;
+            ret = BOFS_DCACHE_NEGATIVE;
+        } else {
+            dcacheHits++;
+            memcpy(entry, &dentry->entry, sizeof(struct BOFS_DirEntry));
+            ret = BOFS_DCACHE_HIT;
+        }
+        /* 最近使用的放到LRU链表末尾 */
+        ListDel(&dentry->lruList);
+        ListAddTail(&dentry->lruList, &dentryLruList);
+    }
+    InterruptRestore(flags);
+    return ret;
+}
+
+/**
+ * DentryInsert - 插入目录项
+ * @sb: 超级块
+ * @parent: 父目录节点号
+ * @name: 名字
+ * @entry: 目录项，为NULL表示父目录中没有这个名字
+ *
+ * 已经存在就更新，不存在就重新使用最久未使用的目录项缓存。
+ * 需要在关闭中断的情况下调用
+ */
+PRIVATE void DentryInsert(struct BOFS_SuperBlock *sb, unsigned int parent,
+    char *name, struct BOFS_DirEntry *entry)
+{
+    struct BOFS_Dentry *dentry;
+
+    /* 名字太长的不缓存 */
+    if (strlen(name) >= BOFS_NAME_LEN)
+        return;
+
+    dentry = DentryFind(sb, parent, name);
+    if (dentry == NULL) {
+        /* 取出最久未使用的 */
+        dentry = ListFirstOwner(&dentryLruList, struct BOFS_Dentry, lruList);
+        if (dentry->sb != NULL)
+            ListDel(&dentry->hashList);
+
+        dentry->sb = sb;
+        dentry->parent = parent;
+        ListAdd(&dentry->hashList, DentryHash(sb, parent, name));
+    }
+
+    if (entry != NULL) {
+        memcpy(&dentry->entry, entry, sizeof(struct BOFS_DirEntry));
+        dentry->negative = 0;
+    } else {
+        memset(&dentry->entry, 0, sizeof(struct BOFS_DirEntry));
+        dentry->negative = 1;
+    }
+    strcpy(dentry->entry.name, name);
+
+    ListDel(&dentry->lruList);
+    ListAddTail(&dentry->lruList, &dentryLruList);
+}
+
+/**
+ * BOFS_DcacheGeneration - 获取目录项缓存的版本
+ *
+ * 在磁盘上查找目录项之前获取，添加查找结果时传给BOFS_DcacheAdd
+ */
+PUBLIC unsigned int BOFS_DcacheGeneration()
+{
+    return dcacheGeneration;
+}
+
+/**
+ * BOFS_DcacheAdd - 添加在磁盘上查找到的目录项
+ * @sb: 超级块
+ * @parent: 父目录节点号
+ * @name: 名字
+ * @entry: 目录项，为NULL表示父目录中没有这个名字
+ * @generation: 查找磁盘之前获取的版本
+ *
+ * 查找磁盘的时候可能会阻塞，这期间如果有目录项写入了磁盘（比如同时创建了
+ * 这个文件），查找的结果可能已经过时了，版本不一样就不记录，避免覆盖新的目录项
+ */
+PUBLIC void BOFS_DcacheAdd(struct BOFS_SuperBlock *sb, unsigned int parent,
+    char *name, struct BOFS_DirEntry *entry, unsigned int generation)
+{
+    unsigned long flags = InterruptSave();
+    if (generation == dcacheGeneration)
+        DentryInsert(sb, parent, name, entry);
+    InterruptRestore(flags);
+}
+
+/**
+ * BOFS_DcacheUpdate - 目录项写入磁盘后更新缓存
+ * @sb: 超级块
+ * @parent: 父目录节点号
+ * @entry: 写入的目录项
+ *
+ * 创建，删除和重命名都会把目录项写入父目录，在这里保持缓存和磁盘一致。
+ * 重命名后旧名字指向同一个节点，需要丢弃；删除后记录为负目录项，
+ * 如果是目录，它下面的目录项也要丢弃，因为节点号可能被重新使用
+ */
+PUBLIC void BOFS_DcacheUpdate(struct BOFS_SuperBlock *sb, unsigned int parent,
+    struct BOFS_DirEntry *entry)
+{
+    struct BOFS_Dentry *dentry;
+    int i;
+    char invalid = (entry->type == BOFS_FILE_TYPE_INVALID);
+
+    unsigned long flags = InterruptSave();
+
+    for (i = 0; i < BOFS_DCACHE_NR; i++) {
+        dentry = &dentryTable[i];
+        if (dentry->sb != sb)
+            continue;
+
+        /* 同一个目录中指向同一个节点的旧名字 */
+        if (dentry->parent == parent && !dentry->negative &&
+            dentry->entry.inode == entry->inode) {
+            DentryDrop(dentry);
+        } else if (invalid && dentry->parent == entry->inode) {
+            /* 删除的目录下面的目录项 */
+            DentryDrop(dentry);
+        }
+    }
+
+    /* 正在查找磁盘的结果都作废 */
+    dcacheGeneration++;
+    DentryInsert(sb, parent, entry->name, invalid ? NULL : entry);
+    InterruptRestore(flags);
+}
+
+/**
+ * BOFS_DcachePurge - 丢弃超级块的所有目录项缓存
+ * @sb: 超级块
+ *
+ * 卸载文件系统时调用
+ */
+PUBLIC void BOFS_DcachePurge(struct BOFS_SuperBlock *sb)
+{
+    int i;
+
+    unsigned long flags = InterruptSave();
+    for (i = 0; i < BOFS_DCACHE_NR; i++) {
+        if (dentryTable[i].sb == sb)
+            DentryDrop(&dentryTable[i]);
+    }
+    InterruptRestore(flags);
+}
+
+PUBLIC void BOFS_DumpDcache()
+{
+    printk(PART_TIP "----Dentry Cache----\n");
+    printk(PART_TIP "lookups:%d hits:%d negative hits:%d\n",
+        dcacheLookups, dcacheHits, dcacheNegativeHits);
+}
+
+/**
+ * BOFS_InitDcache - 初始化目录项缓存
+ */
+PUBLIC void BOFS_InitDcache()
+{
+    int i;
+
+    for (i = 0; i < BOFS_DCACHE_HASH_NR; i++)
+        INIT_LIST_HEAD(&dentryHashTable[i]);
+
+    for (i = 0; i < BOFS_DCACHE_NR; i++) {
+        dentryTable[i].sb = NULL;
+        INIT_LIST_HEAD(&dentryTable[i].hashList);
+        ListAddTail(&dentryTable[i].lruList, &dentryLruList);
+    }
+    dcacheLookups = dcacheHits = dcacheNegativeHits = 0;
+    dcacheGeneration = 0;
+}
@@ -13,6 +13,7 @@
 #include <lib/math.h>
 #include <fs/bofs/dir_entry.h>
 #include <fs/bofs/bitmap.h>
+#include <fs/bofs/dcache.h>
 #include <clock/clock.h>
 #include <block/blk-buffer.h>
 
@@ -76,11 +77,15 @@ PUBLIC bool BOFS_SearchDirEntry(struct BOFS_SuperBlock *sb,
 {
     //printk("int BOFS_SearchDirEntry\n");
 
-    /* 分配IO缓冲区 */
-    buf8_t iobuf = kmalloc(sb->blockSize, GFP_KERNEL);
-    if (iobuf == NULL) {
-        return false;
-    }
+    /* 先在目录项缓存中查找，命中就不需要读取父目录 */
+    int cached = BOFS_DcacheLookup(sb, parentDir->inode, name, childDir);
+    if (cached != BOFS_DCACHE_MISS)
+        return cached == BOFS_DCACHE_HIT;
+
+    bool found = false;
+
+    /* 读取磁盘时可能阻塞，记下版本，期间有目录项写入就不记录结果 */
+    unsigned int generation = BOFS_DcacheGeneration();
 
 	/*1.read parent data*/
 	struct BOFS_Inode parentInode;
@@ -93,7 +98,8 @@ PUBLIC bool BOFS_SearchDirEntry(struct BOFS_SuperBlock *sb,
 	*/
 	uint32 lba;
 	uint32 blockID = 0;
-	struct BOFS_DirEntry *dirEntry = (struct BOFS_DirEntry *)iobuf;
+	struct BufferHead *bh;
+	struct BOFS_DirEntry *dirEntry;
 	int i;
 	
 	uint32 blocks = DIV_ROUND_UP(parentInode.size, sb->blockSize);
@@ -105,13 +111,14 @@ PUBLIC bool BOFS_SearchDirEntry(struct BOFS_SuperBlock *sb,
 		BOFS_GetInodeData(&parentInode, blockID, &lba, sb);
 		//printk("inode data: id:%d lba:%d\n", blockID, lba);
 		
-		memset(iobuf, 0, sb->blockSize);
-		//sector_read(lba, sb->iobuf, 1);
-		if (BlockRead(sb->devno, lba, iobuf)) {
+		/* 直接在块缓冲中查找，不复制出来 */
+		bh = BlockGet(sb->devno, lba);
+		if (bh == NULL) {
 			printk(PART_ERROR "device %d read failed!\n", sb->devno);
+			/* 读取失败不能记录为不存在 */
 			return false;
 		}
-		
+		dirEntry = (struct BOFS_DirEntry *)bh->data;
 
 		/*scan a sector*/
 		for(i = 0; i < sb->direntryNrInSector; i++){
@@ -122,17 +129,24 @@ PUBLIC bool BOFS_SearchDirEntry(struct BOFS_SuperBlock *sb,
 					/*same dir entry*/
 					memcpy(childDir, &dirEntry[i], sizeof(struct BOFS_DirEntry));
 					//printk("search success!\n");
-					return true;
+					found = true;
+					BlockPut(bh);
+					goto ToEnd;
 				}
 			} else {
 				//printk("search failed!\n");
-				return false;
+				BlockPut(bh);
+				goto ToEnd;
 			}
 		}
+		BlockPut(bh);
 		blockID++;
 	}
-	
-	return false;
+ToEnd:
+
+	/* 记录到目录项缓存，没找到的也记录 */
+	BOFS_DcacheAdd(sb, parentDir->inode, name, found ? childDir : NULL, generation);
+	return found;
 }
 
 /*
@@ -264,6 +278,10 @@ PUBLIC int BOFS_SyncDirEntry(struct BOFS_DirEntry *parentDir,
 /* 结束的时候需要释放iobuf */
 ToEnd:
     kfree(iobuf);
+
+	/* 写入成功后更新目录项缓存 */
+	if (retval)
+		BOFS_DcacheUpdate(sb, parentDir->inode, childDir);
 	return retval;
 }
 
@@ -15,14 +15,31 @@
 #include <lib/math.h>
 
 #include <fs/bofs/file.h>
+#include <fs/bofs/icache.h>
+#include <fs/bofs/dcache.h>
 #include <fs/bofs/bitmap.h>
 #include <fs/bofs/pipe.h>
 #include <fs/bofs/fifo.h>
 
 #include <block/blk-buffer.h>
 
+#include <lib/ioctl.h>
+
 struct BOFS_FileDescriptor BOFS_GlobalFdTable[BOFS_MAX_FD_NR];
 
+/**
+ * BOFS_FileReadaheadReset - 重置文件的预读窗口
+ * @fdptr: 文件描述符
+ * 
+ * 打开文件和移动文件位置后，需要重新检测是否顺序读取
+ */
+PRIVATE void BOFS_FileReadaheadReset(struct BOFS_FileDescriptor *fdptr)
+{
+    fdptr->raPrev = BOFS_RA_NONE;
+    fdptr->raStart = fdptr->raEnd = 0;
+    fdptr->raSize = 0;
+}
+
 PUBLIC void BOFS_InitFdTable()
 {
 	int fdIdx = 0;
@@ -46,6 +63,9 @@ PUBLIC int BOFS_AllocFdGlobal()
 	while (fdIdx < BOFS_MAX_FD_NR) {
 		if (BOFS_GlobalFdTable[fdIdx].flags == BOFS_FD_FREE) {
 			BOFS_GlobalFdTable[fdIdx].flags = BOFS_FD_USING;
+			BOFS_FileReadaheadReset(&BOFS_GlobalFdTable[fdIdx]);
+			BOFS_GlobalFdTable[fdIdx].raReads = 0;
+			BOFS_GlobalFdTable[fdIdx].raHits = 0;
 			return fdIdx;
 		}
 		fdIdx++;
@@ -234,13 +254,7 @@ PRIVATE int BOFS_CreateFile(struct BOFS_DirEntry *parentDir,
 		return -1;
 	}
 	
-	struct BOFS_Inode *inode = (struct BOFS_Inode *)kmalloc(\
-		sizeof(struct BOFS_Inode), GFP_KERNEL);
-	if(inode == NULL){
-		printk("alloc memory for inode failed!\n");
-		kfree(dirEntry);
-		return -1;
-	}
+	struct BOFS_Inode newInode, *inode = &newInode;
 
 	/* 分配节点 */
 	unsigned int inodeID = BOFS_AllocBitmap(sb, BOFS_BMT_INODE, 1); 
@@ -283,10 +297,18 @@ PRIVATE int BOFS_CreateFile(struct BOFS_DirEntry *parentDir,
 			printk("alloc fd for failed!\n");
 
 			kfree(dirEntry);
-			kfree(inode);
 			return -1;
 		}
 		
+		/* 文件描述符使用节点缓存中的节点 */
+		inode = BOFS_OpenInode(sb, inodeID);
+		if (inode == NULL) {
+			printk("open inode %d failed!\n", inodeID);
+			BOFS_FreeFdGlobal(fd);
+			kfree(dirEntry);
+			return -1;
+		}
+
 		BOFS_GlobalFdTable[fd].parentEntry = parentDir;
 		BOFS_GlobalFdTable[fd].dirEntry = dirEntry;
 		
@@ -305,7 +327,6 @@ PRIVATE int BOFS_CreateFile(struct BOFS_DirEntry *parentDir,
 		return TaskInstallFD(fd);
 	}else{
 		kfree(dirEntry);
-		kfree(inode);
 		return -1;
 	}
 }
@@ -341,6 +362,7 @@ PUBLIC int BOFS_Trancate(int fd)
 
     /* 移动到最前面 */
     fdptr->pos = 0;
+    BOFS_FileReadaheadReset(fdptr);
 
     return 0;
 }
@@ -387,6 +409,9 @@ PUBLIC int BOFS_Lseek(int fd, int offset, unsigned char whence)
 			return -1;
 		}
 	}
+	/* 移动了位置，重新检测顺序读取 */
+	if (fdptr->pos != newPos)
+		BOFS_FileReadaheadReset(fdptr);
 	fdptr->pos = newPos;
 	//printk("seek: %d\n", fdptr->pos);
 	
@@ -523,13 +548,7 @@ PRIVATE int BOFS_OpenFile(struct BOFS_DirEntry *parentDir,
 		return -1;
 	}
 	
-	struct BOFS_Inode *inode = (struct BOFS_Inode *)kmalloc(\
-		sizeof(struct BOFS_Inode), GFP_KERNEL);
-	if(inode == NULL){
-		printk("alloc memory for inode failed!\n");
-		kfree(dirEntry);
-		return -1;
-	}
+	struct BOFS_Inode *inode;
 
 	//printk("open inode and dir entry ok!\n");
 	/*2.load dir entry to parent dir*/
@@ -541,15 +560,21 @@ PRIVATE int BOFS_OpenFile(struct BOFS_DirEntry *parentDir,
 			printk("alloc fd for failed!\n");
 
 			kfree(dirEntry);
-			kfree(inode);
 			return -1;
 		}
 		
+		/* 打开同一个文件的文件描述符共享节点缓存中的节点 */
+		inode = BOFS_OpenInode(sb, dirEntry->inode);
+		if (inode == NULL) {
+			printk("open inode %d failed!\n", dirEntry->inode);
+			BOFS_FreeFdGlobal(fd);
+			kfree(dirEntry);
+			return -1;
+		}
+
 		BOFS_GlobalFdTable[fd].parentEntry = parentDir;
 		BOFS_GlobalFdTable[fd].dirEntry = dirEntry;
 		
-		BOFS_LoadInodeByID(inode, dirEntry->inode, sb);
-		
 		BOFS_GlobalFdTable[fd].inode = inode;
 		
 		BOFS_GlobalFdTable[fd].pos = 0;
@@ -567,7 +592,6 @@ PRIVATE int BOFS_OpenFile(struct BOFS_DirEntry *parentDir,
 	}else{
 		printk("load dir entry failed!\n");
 		kfree(dirEntry);
-		kfree(inode);
 		return -1;
 	}
 }
@@ -774,17 +798,68 @@ int BOFS_CloseFile(struct BOFS_FileDescriptor *fdptr)
 	return 0;
 }
 
+/**
+ * BOFS_FileSync - 同步一个文件到磁盘
+ * @fdptr: 文件描述符
+ * 
+ * 先把页缓存中的脏页和节点写到块缓冲，然后写回属于这个文件的脏缓冲（数据块和各级间接块），
+ * 分配块时修改的位图，以及节点所在的块，不会同步其它文件的脏缓冲。
+ * 只遍历脏缓冲，不需要查找文件的每一个块，也不会给稀疏文件分配块。
+ * 成功返回0，失败返回-1
+ */
+PRIVATE int BOFS_FileSync(struct BOFS_FileDescriptor *fdptr)
+{
+    struct BOFS_SuperBlock *sb = fdptr->superBlock;
+    struct BOFS_Inode *inode = fdptr->inode;
+    sector_t lba;
+    int ret = 0;
+
+    /* 共享映射修改过的页先写到块缓冲 */
+    if (BOFS_IcachePageSync(sb, inode->id))
+        ret = -1;
+
+    if (BOFS_IcacheWriteBack(inode))
+        ret = -1;
+
+    if (BsyncOwner(sb->devno, BOFS_BUFFER_OWNER(inode)))
+        ret = -1;
+
+    /* 位图被所有文件共享，只写回其中的脏缓冲 */
+    if (BsyncRange(sb->devno, sb->sectorBitmapLba, sb->sectorBitmapSectors))
+        ret = -1;
+    if (BsyncRange(sb->devno, sb->inodeBitmapLba, sb->inodeBitmapSectors))
+        ret = -1;
+
+    lba = sb->inodeTableLba + inode->id / sb->inodeNrInSector;
+    if (BsyncBlocks(sb->devno, &lba, 1))
+        ret = -1;
+
+    return ret;
+}
+
 /**
  * BOFS_Fsync - 同步文件数据到磁盘
  * @fd: 文件描述符
+ * 
+ * 成功返回0，失败返回-1
  */
 PUBLIC int BOFS_Fsync(int fd)
 {
 	int ret = -1;   // defaut -1,error
 	if (fd >= 0 && fd < MAX_OPEN_FILES_IN_PROC) {
-        /* 简单起见，直接同步所有文件 */
-        BlockSync();
-
+        int globalFD = FdLocal2Global(fd);
+        if (globalFD >= 0) {
+            struct BOFS_FileDescriptor *fdec = &BOFS_GlobalFdTable[globalFD];
+            
+            /* 管道和设备文件没有需要同步的数据 */
+            if (IS_PIPE_FILE(fdec) ||
+                fdec->dirEntry->type == BOFS_FILE_TYPE_BLOCK ||
+                fdec->dirEntry->type == BOFS_FILE_TYPE_CHAR ||
+                fdec->dirEntry->type == BOFS_FILE_TYPE_FIFO)
+                ret = 0;
+            else
+                ret = BOFS_FileSync(fdec);
+        }
 	} else {
 		printk("fd:%d failed!\n", fd);
 	}
@@ -826,14 +901,20 @@ PUBLIC int BOFS_Close(int fd)
                     fdec->dirEntry->type == BOFS_FILE_TYPE_CHAR) {
                     //printk("close device %x\n", fdec->inode->blocks[0]);
                     DeviceClose(fdec->inode->blocks[0]);
+                    BOFS_CloseInode(fdec->inode);
                     
                 } else if (fdec->dirEntry->type == BOFS_FILE_TYPE_FIFO) {
                     if (BOFS_FifoClose((struct BOFS_Pipe *)fdec->inode->blocks[0]) == -1) {
                         printk("close fifo file failed!\n");    
                     }
+                    BOFS_CloseInode(fdec->inode);
                 } else {    /* 普通文件 */
-                    /* 文件关闭之前做一次强制同步，保证写入磁盘的数据能够在磁盘上 */
-                    BlockSync();
+                    /* 文件关闭之前做一次强制同步，保证写入磁盘的数据能够在磁盘上。
+                    只读打开并且没有修改过的文件不需要同步，避免遍历文件所有的数据块 */
+                    BOFS_IcacheDiscardPrealloc(fdec->superBlock, fdec->inode->id);
+                    if (fdec->flags & (BOFS_O_WRONLY | BOFS_O_RDWR) ||
+                        BOFS_IcacheIsDirty(fdec->superBlock, fdec->inode->id))
+                        BOFS_FileSync(fdec);
 
                     ret = BOFS_CloseFile(fdec);
                 }
@@ -999,12 +1080,11 @@ PRIVATE int BOFS_FileWrite(struct BOFS_FileDescriptor *fdptr,
 	uint32 sectorLeftBytes;   // bytes left in a sector
 	uint32 chunkSize;	      // every time will write chunk size to disk
 	
-	/*we will write data to a sector, but not every time we write is a whole sector.
-	maybe it is like this. a sector, we will write to half of it. so we will clear a
-	sector buf first, and then write data into sector buf, and write into disk.
-	if we don't judge whether it's first time to write sector, we may clean old data
-	in the disk. so we judge it use value firstWriteSector.*/
-	uint8 firstWriteSector = 1;
+	struct BufferHead *bh;
+
+	/* 写入之前的文件大小，在它后面的块没有旧数据 */
+	uint32 oldSize = fdptr->inode->size;
+	uint32 startPos = fdptr->pos;
 	
 	/*block id for get file data block.
 	we need set it by fd pos, we will start at a pos, not always 0.
@@ -1018,22 +1098,22 @@ PRIVATE int BOFS_FileWrite(struct BOFS_FileDescriptor *fdptr,
 	*/
     unsigned int blockSize = fdptr->superBlock->blockSize;
 
-    buf8_t iobuf = kmalloc(blockSize, GFP_KERNEL);
-    if (iobuf == NULL)
-        return -1;
-
 	uint32 blockID = fdptr->pos/blockSize;    
 
 	struct BOFS_SuperBlock *sb = fdptr->superBlock;
 
+	/* 用户的缓冲区可能是同一个文件的共享映射，缺页时会读取块缓冲，
+	所以要在锁定块缓冲之前先复制到内核的缓冲区，不然会死锁 */
+	uint8 *bounce = kmalloc(blockSize, GFP_KERNEL);
+	if (bounce == NULL)
+		return -1;
+
 	//printk(">>>start block id:%d\n", blockID);
 	while (bytesWritten < count) {
 		
 		BOFS_GetInodeData(fdptr->inode, blockID, &sectorLba, sb);
 		
         //printk("write block %d\n", sectorLba);
-
-        memset(iobuf, 0, blockSize);
 		
 		//get remainder of pos = pos/512
 		sectorOffsetBytes = fdptr->pos % blockSize;	
@@ -1043,21 +1123,26 @@ PRIVATE int BOFS_FileWrite(struct BOFS_FileDescriptor *fdptr,
 		
 		//printk("sector:%d off:%d left:%d chunk:%d\n", sectorLba, sectorOffsetBytes, sectorLeftBytes, chunkSize);
 		
-		if (firstWriteSector) {	//we need to keep first sector not
-			
-			if(BlockRead(sb->devno, sectorLba, iobuf)) {
-				goto ToFailed;
-			}
-			
-			firstWriteSector = 0;
-			//printk("first write, need to read old data!\n");
-		}
-        
-		memcpy(iobuf + sectorOffsetBytes, src, chunkSize);
-		//sector_write(sectorLba, iobuf, 1);
-		if(BlockWrite(sb->devno, sectorLba, iobuf, 0)) {
+		memcpy(bounce, src, chunkSize);
+
+		/* 整个块都被覆盖或者块在原来的文件末尾之后，就不需要读取旧数据，
+		否则要先读取，保留块中没有被覆盖的部分 */
+		if (chunkSize == blockSize || blockID * blockSize >= oldSize)
+			bh = Bget(sb->devno, sectorLba);
+		else
+			bh = BlockGet(sb->devno, sectorLba);
+		if (bh == NULL)
 			goto ToFailed;
-		}
+        
+		/* 直接把数据复制到块缓冲中 */
+		BufferBeginWrite(bh);
+		bh->owner = BOFS_BUFFER_OWNER(fdptr->inode);
+		if (chunkSize != blockSize && blockID * blockSize >= oldSize)
+			memset(bh->data, 0, blockSize);
+		memcpy(bh->data + sectorOffsetBytes, bounce, chunkSize);
+		BufferEndWrite(bh);
+		BlockPut(bh);
+
 		src += chunkSize;   // set src to next pos
 		fdptr->pos += chunkSize;   
 		if(changeFileSize){
@@ -1067,12 +1152,16 @@ PRIVATE int BOFS_FileWrite(struct BOFS_FileDescriptor *fdptr,
 		sizeLeft -= chunkSize;
 		blockID++;
 	}
+	kfree(bounce);
+
 	/*step 5:
 	updata inode size
 	*/
 	BOFS_SyncInode(fdptr->inode, sb);
+
+	/* 文件被映射的时候，缓存的页也要更新 */
+	BOFS_IcachePageCopy(sb, fdptr->inode->id, startPos, buf, bytesWritten, 1);
 	
-    kfree(iobuf);
     /* 如果写入0字节，那么表示出错 */
     if (!bytesWritten)
         bytesWritten = -1;
@@ -1080,7 +1169,10 @@ PRIVATE int BOFS_FileWrite(struct BOFS_FileDescriptor *fdptr,
 	return bytesWritten;
 
 ToFailed:
-    kfree(iobuf);
+    kfree(bounce);
+    /* 已经写入的部分改变了文件大小，也要同步节点 */
+    if (bytesWritten)
+        BOFS_SyncInode(fdptr->inode, sb);
     return -1;
 }
 
@@ -1174,8 +1266,21 @@ PUBLIC int BOFS_Ioctl(int fd, int cmd, int arg)
     struct BOFS_FileDescriptor* file = &BOFS_GlobalFdTable[globalFD];
 	
 	if (file->dirEntry->type == BOFS_FILE_TYPE_NORMAL) {
-		printk("ioctl: normal file not support ioctl!\n");
-		ret = -1;
+		if (cmd == FILE_IOCTL_RASTAT && arg) {
+			/* 获取预读统计 */
+			struct rastat *stat = (struct rastat *)arg;
+			stat->ra_reads = file->raReads;
+			stat->ra_hits = file->raHits;
+			stat->ra_window = file->raSize;
+		} else if (cmd == FILE_IOCTL_FSSTAT) {
+			/* 输出节点缓存，目录项缓存和块分配的统计 */
+			BOFS_DumpIcache();
+			BOFS_DumpDcache();
+			BOFS_DumpBlockStat(file->superBlock);
+		} else {
+			printk("ioctl: normal file not support ioctl!\n");
+			ret = -1;
+		}
 	} else if (file->dirEntry->type == BOFS_FILE_TYPE_BLOCK || 
             file->dirEntry->type == BOFS_FILE_TYPE_CHAR) {
         
@@ -1186,113 +1291,142 @@ PUBLIC int BOFS_Ioctl(int fd, int cmd, int arg)
 	return ret;
 }
 
-PRIVATE int BOFS_FileRead( struct BOFS_FileDescriptor *fdptr, void* buf, uint32 count)
+/**
+ * BOFS_FileReadahead - 文件预读
+ * @fdptr: 文件描述符
+ * @first: 本次读取的第一个块
+ * @last: 本次读取的最后一个块
+ * 
+ * 顺序读取时，把后面的块异步读取到块缓冲中，读者之后就可以直接命中。
+ * 每次预读后窗口翻倍，最大到BOFS_RA_MAX，读者接近窗口末尾时才继续预读。
+ */
+PRIVATE void BOFS_FileReadahead(struct BOFS_FileDescriptor *fdptr, uint32 first, uint32 last)
 {
-    //printk("file read start!\n");
+    struct BOFS_SuperBlock *sb = fdptr->superBlock;
+    sector_t blocks[BOFS_RA_MAX];
+    uint32 start, end, lba, i, n = 0;
+
+    /* 统计命中预读窗口的块 */
+    for (i = first; i <= last; i++) {
+        fdptr->raReads++;
+        if (i >= fdptr->raStart && i < fdptr->raEnd)
+            fdptr->raHits++;
+    }
 
-	/*step 1:
-	calculate that we can read how many bytes
-	*/
-	uint32 size = count, sizeLeft = count;
-	//printk("pos:%d count:%d size:%d\n", fdptr->pos, count, fdptr->inode->size);
+    /* 不是顺序读取就关闭预读 */
+    if (first != fdptr->raPrev && first != fdptr->raPrev + 1) {
+        BOFS_FileReadaheadReset(fdptr);
+        fdptr->raPrev = last;
+        return;
+    }
+    fdptr->raPrev = last;
 
-	//check read bytes
-	if ((fdptr->pos + count) > fdptr->inode->size){
-		size = fdptr->inode->size - fdptr->pos;
-		sizeLeft = size;
-		
-		if (sizeLeft == 0) {	   // if read at the end of file, return 0
-            //printk("sizeLeft:%d\n", sizeLeft);
-        	return -1;
-		}
-	}
-	
-	/*step 2:
-	calculate that we read data from which block id(sector)
-	*/
-	/*block id for get file data block.
-	we need set it by fd pos, we will start at a pos, not always 0.
-	because sometimes, pos is not start from 0, so we should set it use 
-	pos/SECTOR_SIZE.
-	for example:
-		if (0<= pos < 512) : id = 0
-		if (512<= pos < 1024) : id = 1
-		if (1024<= pos < 1536) : id = 2
-		...
-	*/
-    unsigned int blockSize = fdptr->superBlock->blockSize;
+    /* 离窗口末尾还远，不需要预读 */
+    if (fdptr->raSize && last + fdptr->raSize / 2 < fdptr->raEnd)
+        return;
+    
+    /* 每次预读窗口都翻倍 */
+    fdptr->raSize = fdptr->raSize ? min(fdptr->raSize * 2, BOFS_RA_MAX) : BOFS_RA_MIN;
 
-	uint32 blockID = fdptr->pos/blockSize;    
-	//printk(">>>start block id:%d\n", blockID);
-	
-	/*step 3:
-	read data to buf
-	*/
-	uint8 *dst = buf;        // src is buffer we will write to file 
-	uint32 bytesRead = 0;	    // we have written n bytes
-	uint32 sectorLba;	      // we will write data to a sector 
-	uint32 sectorOffsetBytes;    // bytes offset in a sector 
-	uint32 sectorLeftBytes;   // bytes left in a sector
-	uint32 chunkSize;	      // every time will write chunk size to disk
-	
-    buf8_t iobuf = kmalloc(blockSize, GFP_KERNEL);
-    if (iobuf == NULL) {
-        //printk("alloc failed!\n");
-        return -1;
+    /* 从还没有预读的块开始，本次要读取的块也一起提交，不超过文件末尾 */
+    start = max(first, fdptr->raEnd);
+    end = min(last + 1 + fdptr->raSize, DIV_ROUND_UP(fdptr->inode->size, sb->blockSize));
+    
+    for (i = start; i < end && n < BOFS_RA_MAX; i++) {
+        if (BOFS_GetInodeData(fdptr->inode, i, &lba, sb))
+            break;
+        blocks[n++] = lba;
     }
-        
-	struct BOFS_SuperBlock *sb = fdptr->superBlock;
+    if (!n)
+        return;
+    
+    /* 和之前的窗口不连续，就是一个新窗口 */
+    if (start != fdptr->raEnd)
+        fdptr->raStart = start;
+    fdptr->raEnd = start + n;
 
-    //printk("file read start!\n");
-    //printk("will read size %d\n", size);
-	while (bytesRead < size) {
-		//printk("get inode data");
-		/*BOFS_DumpSuperBlock(sb);
-		BOFS_DumpInode(fdptr->inode);*/
-		BOFS_GetInodeData(fdptr->inode, blockID, &sectorLba, sb);
+    Bprefetch(sb->devno, blocks, n);
+}
 
-		//printk("read block %d\n", sectorLba);
-		//get remainder of pos = pos/512
-		sectorOffsetBytes = fdptr->pos % blockSize;	
-		sectorLeftBytes = blockSize - sectorOffsetBytes;
-		
-		chunkSize = sizeLeft < sectorLeftBytes ? sizeLeft : sectorLeftBytes;
-		
-		//printk("sector:%d off:%d left:%d chunk:%d\n", sectorLba, sectorOffsetBytes, sectorLeftBytes, chunkSize);
-		
-		//clean buf and read data to buf
-		//memset(sb->iobuf, 0, blockSize);
-		//printk("read done!\n");
-		if(BlockRead(sb->devno, sectorLba, iobuf)) {
-            //printk("block read failed!\n");
-			goto ToFailed;
-		}
-		//printk("read done!\n");
-		/*copy disk data to out buf*/
-		memcpy(dst, iobuf + sectorOffsetBytes, chunkSize);
-		
-		dst += chunkSize;
-		fdptr->pos += chunkSize;
-		bytesRead += chunkSize;
-		sizeLeft -= chunkSize;
-		blockID++;
-	}
-	
-    //printk("read ok!\n");
-    kfree(iobuf);
-    
-    /* 如果读取0字节，那么就到文件末尾，EOF */
-    if (!bytesRead)
-        bytesRead = -1;
+/**
+ * BOFS_FileReadAt - 从文件的某个偏移读取数据
+ * @sb: 超级块
+ * @inode: 文件的节点
+ * @offset: 文件中的偏移
+ * @buf: 缓冲区
+ * @count: 字节数
+ * 
+ * 使用自己的位置，不会修改文件描述符的读写位置和预读状态，
+ * 读取的过程中可能休眠，其它任务同时使用同一个描述符也不会受影响。
+ * 成功返回读取的数据量，在文件末尾或者失败返回-1
+ */
+PRIVATE int BOFS_FileReadAt(struct BOFS_SuperBlock *sb, struct BOFS_Inode *inode,
+    uint32 offset, void *buf, uint32 count)
+{
+    unsigned int blockSize = sb->blockSize;
+    uint8 *dst = buf;
+    uint32 pos = offset, size, bytesRead = 0;
+    uint32 sectorLba, sectorOffsetBytes, chunkSize;
+    struct BufferHead *bh;
+
+    if (offset >= inode->size)
+        return -1;
+    size = min(count, inode->size - offset);
 
-	return bytesRead;
+    while (bytesRead < size) {
+        if (BOFS_GetInodeData(inode, pos / blockSize, &sectorLba, sb))
+            return -1;
 
-ToFailed:
-    kfree(iobuf);
-    printk("read failed!\n");
-    return -1;
+        sectorOffsetBytes = pos % blockSize;
+        chunkSize = min(size - bytesRead, blockSize - sectorOffsetBytes);
+
+        bh = BlockGet(sb->devno, sectorLba);
+        if (bh == NULL)
+            return -1;
+        memcpy(dst, bh->data + sectorOffsetBytes, chunkSize);
+        BlockPut(bh);
+
+        dst += chunkSize;
+        pos += chunkSize;
+        bytesRead += chunkSize;
+    }
+
+    /* 被共享映射修改过的页还没有写回，以页中的数据为准 */
+    BOFS_IcachePageCopy(sb, inode->id, offset, buf, bytesRead, 0);
+    return bytesRead;
 }
 
+/**
+ * BOFS_FileRead - 从文件描述符的读写位置读取数据
+ * @fdptr: 文件描述符
+ * @buf: 缓冲区
+ * @count: 字节数
+ * 
+ * 只有通过描述符的顺序读取才更新预读状态，映射的缺页使用BOFS_FileReadAt，
+ * 不会移动描述符的预读窗口。成功返回读取的数据量，在文件末尾或者失败返回-1
+ */
+PRIVATE int BOFS_FileRead(struct BOFS_FileDescriptor *fdptr, void *buf, uint32 count)
+{
+    unsigned int blockSize = fdptr->superBlock->blockSize;
+    uint32 size;
+    int read;
+
+    if (fdptr->pos >= fdptr->inode->size)
+        return -1;
+    size = min(count, fdptr->inode->size - fdptr->pos);
+
+    /* 顺序读取时预读后面的块 */
+    if (size > 0)
+        BOFS_FileReadahead(fdptr, fdptr->pos / blockSize, (fdptr->pos + size - 1) / blockSize);
+
+    read = BOFS_FileReadAt(fdptr->superBlock, fdptr->inode, fdptr->pos, buf, size);
+    if (read < 0) {
+        printk("read failed!\n");
+        return -1;
+    }
+    fdptr->pos += read;
+    return read;
+}
 
 /**
  * BOFS_Read - 读取数据
@@ -1649,6 +1783,135 @@ void BOFS_Redirect(unsigned int oldfd, unsigned int newfd)
     cur->fdTable[oldfd] = cur->fdTable[newfd];
 }
 
+/**
+ * BOFS_FileMapGet - 获取一个文件用于映射
+ * @fd: 文件描述符（局部）
+ * @write: 映射要写入文件，文件需要以可写的方式打开
+ * 
+ * 增加全局文件描述的引用，即使局部描述符关闭，文件也保持打开。
+ * 成功返回全局描述符，失败返回-1
+ */
+PUBLIC int BOFS_FileMapGet(int fd, int write)
+{
+    if (fd < 0 || fd >= MAX_OPEN_FILES_IN_PROC) {
+        return -1;
+    }
+    int globalFD = FdLocal2Global(fd);
+    if (globalFD < 0) {
+        return -1;
+    }
+    struct BOFS_FileDescriptor *file = &BOFS_GlobalFdTable[globalFD];
+
+    /* 只有普通文件才可以映射 */
+    if (IS_PIPE_FILE(file) || file->dirEntry->type != BOFS_FILE_TYPE_NORMAL) {
+        return -1;
+    }
+    if (write && !(file->flags & (BOFS_O_WRONLY | BOFS_O_RDWR))) {
+        return -1;
+    }
+    AtomicInc(&file->reference);
+    return globalFD;
+}
+
+/**
+ * BOFS_FileMapDup - 复制一个映射的文件
+ * @globalFd: 全局描述符
+ * 
+ * fork时子进程继承映射，增加引用
+ */
+PUBLIC void BOFS_FileMapDup(int globalFd)
+{
+    struct BOFS_FileDescriptor *file = BOFS_GetFileByFD(globalFd);
+    if (file != NULL) {
+        AtomicInc(&file->reference);
+    }
+}
+
+/**
+ * BOFS_FileMapPut - 释放一个映射的文件
+ * @globalFd: 全局描述符
+ * 
+ * 引用为0时把共享映射修改的数据同步到磁盘，然后关闭文件并释放全局描述符
+ */
+PUBLIC void BOFS_FileMapPut(int globalFd)
+{
+    struct BOFS_FileDescriptor *file = BOFS_GetFileByFD(globalFd);
+    if (file == NULL) {
+        return;
+    }
+    AtomicDec(&file->reference);
+    if (AtomicGet(&file->reference) > 0) {
+        return;
+    }
+    BOFS_IcacheDiscardPrealloc(file->superBlock, file->inode->id);
+    BOFS_FileSync(file);
+    BOFS_CloseFile(file);
+    BOFS_FreeFdGlobal(globalFd);
+}
+
+/**
+ * BOFS_FileMapRead - 从映射的文件中读取数据
+ * @globalFd: 全局描述符
+ * @buf: 缓冲区
+ * @offset: 文件中的偏移
+ * @count: 字节数
+ * 
+ * 不经过局部描述符，缺页时使用。
+ * 成功返回读取的数据量，失败返回-1
+ */
+PUBLIC int BOFS_FileMapRead(int globalFd, void *buf, unsigned int offset, unsigned int count)
+{
+    struct BOFS_FileDescriptor *file = BOFS_GetFileByFD(globalFd);
+    if (file == NULL || !(file->flags & BOFS_FD_USING)) {
+        return -1;
+    }
+    /* 映射共享了打开文件的描述符，不能改变它的读写位置和预读状态 */
+    return BOFS_FileReadAt(file->superBlock, file->inode, offset, buf, count);
+}
+
+/**
+ * BOFS_FileMapPage - 获取映射的文件中的一个页
+ * @globalFd: 全局描述符
+ * @offset: 文件中的偏移，需要页对齐
+ * @dirty: 共享的可写映射使用这个页，同步文件时要写回
+ * 
+ * 先在节点的页缓存中查找，没有就分配一个页读取文件数据，超过文件末尾的部分填0，
+ * 然后加入页缓存，映射同一个文件的进程共享这个页。
+ * 成功返回持有一个引用的物理页，失败返回0
+ */
+PUBLIC unsigned int BOFS_FileMapPage(int globalFd, unsigned int offset, int dirty)
+{
+    struct BOFS_FileDescriptor *file = BOFS_GetFileByFD(globalFd);
+    if (file == NULL || !(file->flags & BOFS_FD_USING)) {
+        return 0;
+    }
+    struct BOFS_SuperBlock *sb = file->superBlock;
+    unsigned int id = file->inode->id;
+    unsigned int index = offset / PAGE_SIZE;
+
+    unsigned int page = BOFS_IcachePageGet(sb, id, index, dirty);
+    if (page) {
+        return page;
+    }
+
+    page = AllocPage();
+    if (!page) {
+        return 0;
+    }
+    uint8 *data = Phy2Vir(page);
+    int read = 0;
+    if (offset < file->inode->size) {
+        read = BOFS_FileMapRead(globalFd, data, offset, PAGE_SIZE);
+        if (read < 0) {
+            FreePage(page);
+            return 0;
+        }
+    }
+    memset(data + read, 0, PAGE_SIZE - read);
+
+    return BOFS_IcachePageAdd(sb, id, index, page, dirty);
+}
+
 /**
  * BOFS_InitFile - 初始化文件相关
  */
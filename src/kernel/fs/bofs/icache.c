@@ -0,0 +1,872 @@
+/*
+ * file:		kernel/fs/bofs/icache.c
+ * auther:		Jason Hu
+ * time:		2020/4/23
+ * copyright:	(C) 2018-2020 by Book OS developers. All rights reserved.
+ */
+
+#include <book/arch.h>
+#include <book/debug.h>
+#include <book/interrupt.h>
+#include <book/memcache.h>
+#include <lib/string.h>
+#include <lib/math.h>
+#include <block/blk-buffer.h>
+#include <fs/bofs/icache.h>
+#include <fs/bofs/bitmap.h>
+
+/* 节点散列表 */
+PRIVATE struct List inodeHashTable[BOFS_ICACHE_HASH_NR];
+
+/* LRU链表，没有被引用的节点在上面，最久未使用的在最前面 */
+PRIVATE LIST_HEAD(inodeLruList);
+
+/* 没有被引用的节点数量 */
+PRIVATE unsigned int inodeUnused;
+
+/* 统计信息 */
+PRIVATE unsigned int icacheHits;
+PRIVATE unsigned int icacheMisses;
+PRIVATE unsigned int icacheWriteBacks;
+PRIVATE unsigned int icacheEvictions;
+PRIVATE unsigned int bmapHits;
+PRIVATE unsigned int bmapMisses;
+
+/* 页缓存散列表 */
+PRIVATE struct List pageHashTable[BOFS_PCACHE_HASH_NR];
+
+/* 页缓存统计信息 */
+PRIVATE unsigned int pcachePages;
+PRIVATE unsigned int pcacheHits;
+PRIVATE unsigned int pcacheMisses;
+
+/**
+ * InodeHash - 计算节点的散列表
+ * @devno: 设备号
+ * @id: 节点号
+ */
+PRIVATE struct List *InodeHash(dev_t devno, unsigned int id)
+{
+    unsigned int hash = (unsigned int)devno * 31 + id;
+    return &inodeHashTable[(hash ^ (hash >> 8)) & (BOFS_ICACHE_HASH_NR - 1)];
+}
+
+/**
+ * CachedInode - 获取节点所在的节点缓存
+ * @inode: BOFS_IcacheGet获取的节点
+ *
+ * 节点在节点缓存的最前面，可以直接转换
+ */
+PRIVATE INLINE struct BOFS_CachedInode *CachedInode(void *inode)
+{
+    return inode;
+}
+
+/**
+ * InodeFind - 查找节点缓存
+ * @devno: 设备号
+ * @id: 节点号
+ *
+ * 需要在关闭中断的情况下调用，没找到返回NULL
+ */
+PRIVATE struct BOFS_CachedInode *InodeFind(dev_t devno, unsigned int id)
+{
+    struct BOFS_CachedInode *cached;
+
+    ListForEachOwner(cached, InodeHash(devno, id), hashList) {
+        if (cached->devno == devno && cached->id == id)
+            return cached;
+    }
+    return NULL;
+}
+
+/**
+ * InodeHold - 增加引用
+ * @cached: 节点缓存
+ *
+ * 需要在关闭中断的情况下调用，第一次引用时从LRU链表上取下来
+ */
+PRIVATE void InodeHold(struct BOFS_CachedInode *cached)
+{
+    if (cached->count++ == 0) {
+        ListDel(&cached->lruList);
+        inodeUnused--;
+    }
+}
+
+/**
+ * InodeRelease - 减少引用
+ * @cached: 节点缓存
+ *
+ * 需要在关闭中断的情况下调用，没有引用后放到LRU链表末尾
+ */
+PRIVATE void InodeRelease(struct BOFS_CachedInode *cached)
+{
+    if (--cached->count == 0) {
+        ListAddTail(&cached->lruList, &inodeLruList);
+        inodeUnused++;
+    }
+}
+
+/**
+ * InodeWriteBack - 把脏节点写回磁盘
+ * @cached: 节点缓存，调用者需要持有引用
+ *
+ * 写回之前先清除脏标志，写回的过程中再次修改会重新标记。
+ * 成功返回0，失败返回-1
+ */
+PRIVATE int InodeWriteBack(struct BOFS_CachedInode *cached)
+{
+    unsigned long flags = InterruptSave();
+    if (!cached->dirty) {
+        InterruptRestore(flags);
+        return 0;
+    }
+    cached->dirty = 0;
+    icacheWriteBacks++;
+    InterruptRestore(flags);
+
+    if (BOFS_WriteInode(&cached->inode, cached->sb)) {
+        printk(PART_ERROR "BOFS write back inode %d failed!\n", cached->id);
+        flags = InterruptSave();
+        cached->dirty = 1;
+        InterruptRestore(flags);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * InodeShrink - 淘汰没有被引用的节点
+ * @max: 最多保留多少个没有被引用的节点
+ * @sb: 只淘汰这个超级块的节点，为NULL表示全部
+ *
+ * 脏节点先写回磁盘再释放
+ */
+PRIVATE void InodeShrink(unsigned int max, struct BOFS_SuperBlock *sb)
+{
+    struct BOFS_CachedInode *cached, *next;
+    unsigned long flags;
+
+Again:
+    flags = InterruptSave();
+    ListForEachOwnerSafe(cached, next, &inodeLruList, lruList) {
+        if (inodeUnused <= max)
+            break;
+        if (sb != NULL && cached->sb != sb)
+            continue;
+
+        if (cached->dirty || cached->preallocCount || cached->pageCount) {
+            /* 写回的时候会休眠，先持有引用，防止被别人释放 */
+            InodeHold(cached);
+            InterruptRestore(flags);
+
+            /* 没有使用的预分配块还给位图 */
+            BOFS_IcacheDiscardPrealloc(cached->sb, cached->id);
+
+            /* 页缓存中的脏页先写回，写回成功才释放 */
+            int err = BOFS_IcachePageSync(cached->sb, cached->id);
+            if (!err)
+                BOFS_IcachePageInvalidate(cached->sb, cached->id);
+
+            err |= InodeWriteBack(cached);
+
+            flags = InterruptSave();
+            InodeRelease(cached);
+            InterruptRestore(flags);
+
+            /* 写回失败就保留在缓存中，下次再写 */
+            if (err)
+                return;
+            goto Again;
+        }
+
+        ListDel(&cached->lruList);
+        ListDel(&cached->hashList);
+        inodeUnused--;
+        icacheEvictions++;
+        kfree(cached);
+    }
+    InterruptRestore(flags);
+}
+
+/**
+ * BOFS_IcacheGet - 获取节点
+ * @sb: 超级块
+ * @id: 节点号
+ * @init: 缓存中没有时用来初始化的节点，为NULL表示从磁盘读取
+ *
+ * 返回的节点持有一个引用，使用完后需要用BOFS_IcachePut释放。
+ * 失败返回NULL
+ */
+PUBLIC struct BOFS_Inode *BOFS_IcacheGet(struct BOFS_SuperBlock *sb,
+    unsigned int id, struct BOFS_Inode *init)
+{
+    struct BOFS_CachedInode *cached, *found;
+
+    unsigned long flags = InterruptSave();
+    cached = InodeFind(sb->devno, id);
+    if (cached != NULL) {
+        InodeHold(cached);
+        icacheHits++;
+        InterruptRestore(flags);
+        return &cached->inode;
+    }
+    icacheMisses++;
+    InterruptRestore(flags);
+
+    cached = kmalloc(sizeof(struct BOFS_CachedInode), GFP_KERNEL);
+    if (cached == NULL)
+        return NULL;
+
+    if (init != NULL) {
+        cached->inode = *init;
+    } else if (BOFS_ReadInode(&cached->inode, id, sb)) {
+        kfree(cached);
+        return NULL;
+    }
+
+    cached->sb = sb;
+    cached->devno = sb->devno;
+    cached->id = id;
+    cached->count = 1;
+    cached->dirty = 0;
+    cached->nextExtent = 0;
+    memset(cached->extents, 0, sizeof(cached->extents));
+    cached->allocGoal = 0;
+    cached->preallocStart = 0;
+    cached->preallocCount = 0;
+    INIT_LIST_HEAD(&cached->pageList);
+    cached->pageCount = 0;
+
+    flags = InterruptSave();
+    /* 读取磁盘的时候可能已经有人添加了 */
+    found = InodeFind(sb->devno, id);
+    if (found != NULL) {
+        InodeHold(found);
+        InterruptRestore(flags);
+        kfree(cached);
+        return &found->inode;
+    }
+    ListAdd(&cached->hashList, InodeHash(sb->devno, id));
+    InterruptRestore(flags);
+
+    InodeShrink(BOFS_ICACHE_NR, NULL);
+    return &cached->inode;
+}
+
+/**
+ * BOFS_IcachePut - 释放节点的引用
+ * @inode: BOFS_IcacheGet获取的节点
+ */
+PUBLIC void BOFS_IcachePut(struct BOFS_Inode *inode)
+{
+    struct BOFS_CachedInode *cached = CachedInode(inode);
+
+    unsigned long flags = InterruptSave();
+    InodeRelease(cached);
+    InterruptRestore(flags);
+
+    InodeShrink(BOFS_ICACHE_NR, NULL);
+}
+
+/**
+ * BOFS_IcacheMarkDirty - 标记节点已经修改
+ * @inode: BOFS_IcacheGet获取的节点
+ */
+PUBLIC void BOFS_IcacheMarkDirty(struct BOFS_Inode *inode)
+{
+    CachedInode(inode)->dirty = 1;
+}
+
+/**
+ * BOFS_IcacheWriteBack - 把一个节点写回磁盘
+ * @inode: BOFS_IcacheGet获取的节点
+ *
+ * 成功返回0，失败返回-1
+ */
+PUBLIC int BOFS_IcacheWriteBack(struct BOFS_Inode *inode)
+{
+    return InodeWriteBack(CachedInode(inode));
+}
+
+/**
+ * BOFS_IcacheSync - 把脏节点都写回磁盘
+ * @sb: 只同步这个超级块的节点，为NULL表示全部
+ *
+ * 写回的时候会休眠，所以每次找到一个脏节点写回后重新查找。
+ * 成功返回0，失败返回-1
+ */
+PUBLIC int BOFS_IcacheSync(struct BOFS_SuperBlock *sb)
+{
+    struct BOFS_CachedInode *cached;
+    unsigned long flags;
+    int i, err, ret = 0;
+
+    for (i = 0; i < BOFS_ICACHE_HASH_NR; i++) {
+Again:
+        flags = InterruptSave();
+        ListForEachOwner(cached, &inodeHashTable[i], hashList) {
+            if (!cached->dirty || (sb != NULL && cached->sb != sb))
+                continue;
+
+            InodeHold(cached);
+            InterruptRestore(flags);
+
+            err = InodeWriteBack(cached);
+
+            flags = InterruptSave();
+            InodeRelease(cached);
+            InterruptRestore(flags);
+
+            /* 写回失败的节点还是脏的，跳过这个散列表，避免死循环 */
+            if (err) {
+                ret = -1;
+                goto Next;
+            }
+            goto Again;
+        }
+        InterruptRestore(flags);
+Next:
+        ;
+    }
+    return ret;
+}
+
+/**
+ * BOFS_IcachePurge - 释放超级块的所有节点缓存
+ * @sb: 超级块
+ *
+ * 卸载文件系统时调用，先把脏节点写回磁盘
+ */
+PUBLIC void BOFS_IcachePurge(struct BOFS_SuperBlock *sb)
+{
+    BOFS_IcacheSync(sb);
+    InodeShrink(0, sb);
+}
+
+/**
+ * BOFS_IcacheMapLookup - 在块映射缓存中查找磁盘块
+ * @sb: 超级块
+ * @id: 节点号
+ * @index: 逻辑块
+ * @block: 找到后保存磁盘块
+ *
+ * 找到返回0，没找到返回-1
+ */
+PUBLIC int BOFS_IcacheMapLookup(struct BOFS_SuperBlock *sb, unsigned int id,
+    unsigned int index, unsigned int *block)
+{
+    struct BOFS_CachedInode *cached;
+    struct BOFS_BlockExtent *extent;
+    int i;
+
+    unsigned long flags = InterruptSave();
+    cached = InodeFind(sb->devno, id);
+    if (cached != NULL) {
+        for (i = 0; i < BOFS_BMAP_NR; i++) {
+            extent = &cached->extents[i];
+            if (index >= extent->index && index - extent->index < extent->count) {
+                *block = extent->block + (index - extent->index);
+                bmapHits++;
+                InterruptRestore(flags);
+                return 0;
+            }
+        }
+    }
+    bmapMisses++;
+    InterruptRestore(flags);
+    return -1;
+}
+
+/**
+ * BOFS_IcacheMapAdd - 把解析过的映射添加到块映射缓存
+ * @sb: 超级块
+ * @id: 节点号
+ * @index: 逻辑块
+ * @block: 磁盘块
+ *
+ * 能接在某个区间后面就扩展区间，不能就替换一个区间
+ */
+PUBLIC void BOFS_IcacheMapAdd(struct BOFS_SuperBlock *sb, unsigned int id,
+    unsigned int index, unsigned int block)
+{
+    struct BOFS_CachedInode *cached;
+    struct BOFS_BlockExtent *extent;
+    int i;
+
+    unsigned long flags = InterruptSave();
+    cached = InodeFind(sb->devno, id);
+    if (cached == NULL) {
+        InterruptRestore(flags);
+        return;
+    }
+
+    for (i = 0; i < BOFS_BMAP_NR; i++) {
+        extent = &cached->extents[i];
+        if (extent->count && index == extent->index + extent->count &&
+            block == extent->block + extent->count) {
+            extent->count++;
+            InterruptRestore(flags);
+            return;
+        }
+    }
+
+    extent = &cached->extents[cached->nextExtent];
+    cached->nextExtent = (cached->nextExtent + 1) % BOFS_BMAP_NR;
+    extent->index = index;
+    extent->block = block;
+    extent->count = 1;
+    InterruptRestore(flags);
+}
+
+/**
+ * BOFS_IcacheMapInvalidate - 丢弃节点的块映射缓存
+ * @sb: 超级块
+ * @id: 节点号
+ *
+ * 释放节点的数据块之后调用
+ */
+PUBLIC void BOFS_IcacheMapInvalidate(struct BOFS_SuperBlock *sb, unsigned int id)
+{
+    struct BOFS_CachedInode *cached;
+
+    unsigned long flags = InterruptSave();
+    cached = InodeFind(sb->devno, id);
+    if (cached != NULL) {
+        cached->nextExtent = 0;
+        memset(cached->extents, 0, sizeof(cached->extents));
+    }
+    InterruptRestore(flags);
+}
+
+/**
+ * BOFS_IcacheAllocBlock - 为节点分配一个数据块
+ * @sb: 超级块
+ * @id: 节点号
+ *
+ * 优先使用节点的预分配块，没有的时候从上一次分配的后面开始，
+ * 一次分配一段连续的块，剩下的留给之后的分配使用。
+ * 返回块在位图中的索引，失败返回-1
+ */
+PUBLIC int BOFS_IcacheAllocBlock(struct BOFS_SuperBlock *sb, unsigned int id)
+{
+    struct BOFS_CachedInode *cached;
+    unsigned int goal = 0, count;
+    int idx;
+
+    unsigned long flags = InterruptSave();
+    cached = InodeFind(sb->devno, id);
+    if (cached != NULL) {
+        if (cached->preallocCount) {
+            idx = cached->preallocStart++;
+            cached->preallocCount--;
+            cached->allocGoal = idx + 1;
+            sb->allocPrealloc++;
+            InterruptRestore(flags);
+            return idx;
+        }
+        goal = cached->allocGoal;
+    }
+    InterruptRestore(flags);
+
+    idx = BOFS_AllocBlocks(sb, goal, cached != NULL ? BOFS_PREALLOC_NR : 1, &count);
+    if (idx == -1)
+        return -1;
+
+    flags = InterruptSave();
+    /* 分配的时候节点可能被淘汰，或者已经有了预分配 */
+    cached = InodeFind(sb->devno, id);
+    if (cached != NULL && !cached->preallocCount) {
+        cached->preallocStart = idx + 1;
+        cached->preallocCount = count - 1;
+        count = 1;
+    }
+    if (cached != NULL)
+        cached->allocGoal = idx + 1;
+    InterruptRestore(flags);
+
+    /* 多出来的块没有地方保存，直接释放 */
+    if (count > 1)
+        BOFS_FreeBlocks(sb, idx + 1, count - 1);
+    return idx;
+}
+
+/**
+ * BOFS_IcacheDiscardPrealloc - 释放节点没有使用的预分配块
+ * @sb: 超级块
+ * @id: 节点号
+ *
+ * 关闭文件，释放节点数据或者淘汰节点的时候调用
+ */
+PUBLIC void BOFS_IcacheDiscardPrealloc(struct BOFS_SuperBlock *sb, unsigned int id)
+{
+    struct BOFS_CachedInode *cached;
+    unsigned int start = 0, count = 0;
+
+    unsigned long flags = InterruptSave();
+    cached = InodeFind(sb->devno, id);
+    if (cached != NULL) {
+        start = cached->preallocStart;
+        count = cached->preallocCount;
+        cached->preallocCount = 0;
+    }
+    InterruptRestore(flags);
+
+    if (count)
+        BOFS_FreeBlocks(sb, start, count);
+}
+
+/**
+ * PageHash - 计算页缓存的散列表
+ * @cached: 节点缓存
+ * @index: 文件中的页号
+ */
+PRIVATE struct List *PageHash(struct BOFS_CachedInode *cached, unsigned int index)
+{
+    unsigned int hash = ((unsigned int)cached >> 4) * 31 + index;
+    return &pageHashTable[(hash ^ (hash >> 8)) & (BOFS_PCACHE_HASH_NR - 1)];
+}
+
+/**
+ * PageFind - 查找页缓存中的页
+ * @cached: 节点缓存
+ * @index: 文件中的页号
+ *
+ * 需要在关闭中断的情况下调用，没找到返回NULL
+ */
+PRIVATE struct BOFS_CachedPage *PageFind(struct BOFS_CachedInode *cached, unsigned int index)
+{
+    struct BOFS_CachedPage *cpage;
+
+    if (!cached->pageCount)
+        return NULL;
+
+    ListForEachOwner(cpage, PageHash(cached, index), hashList) {
+        if (cpage->owner == cached && cpage->index == index)
+            return cpage;
+    }
+    return NULL;
+}
+
+/**
+ * PageWriteBack - 把页的数据写到块缓冲
+ * @cached: 节点缓存，调用者需要持有引用
+ * @index: 文件中的页号
+ * @page: 物理页，调用者需要持有引用
+ *
+ * 只写文件大小以内的部分，不会改变文件大小。
+ * 成功返回0，失败返回-1
+ */
+PRIVATE int PageWriteBack(struct BOFS_CachedInode *cached, unsigned int index, unsigned int page)
+{
+    struct BOFS_SuperBlock *sb = cached->sb;
+    struct BOFS_Inode *inode = &cached->inode;
+    struct BufferHead *bh;
+    uint8 *data = Phy2Vir(page);
+    unsigned int pos = index * PAGE_SIZE, end, lba, offset, chunk;
+
+    if (pos >= inode->size)
+        return 0;
+    end = MIN(pos + PAGE_SIZE, inode->size);
+
+    while (pos < end) {
+        offset = pos % sb->blockSize;
+        chunk = MIN(sb->blockSize - offset, end - pos);
+
+        if (BOFS_GetInodeData(inode, pos / sb->blockSize, &lba, sb))
+            return -1;
+
+        /* 整个块都被覆盖就不需要读取旧数据 */
+        if (chunk == sb->blockSize)
+            bh = Bget(sb->devno, lba);
+        else
+            bh = BlockGet(sb->devno, lba);
+        if (bh == NULL)
+            return -1;
+
+        BufferBeginWrite(bh);
+        bh->owner = BOFS_BUFFER_OWNER(inode);
+        memcpy(bh->data + offset, data, chunk);
+        BufferEndWrite(bh);
+        BlockPut(bh);
+
+        data += chunk;
+        pos += chunk;
+    }
+    return 0;
+}
+
+/**
+ * BOFS_IcachePageGet - 在页缓存中查找文件的页
+ * @sb: 超级块
+ * @id: 节点号
+ * @index: 文件中的页号
+ * @dirty: 页要被共享的可写映射使用，标记为脏
+ *
+ * 找到返回物理页并增加一个引用，使用完后需要FreePage，没找到返回0
+ */
+PUBLIC unsigned int BOFS_IcachePageGet(struct BOFS_SuperBlock *sb, unsigned int id,
+    unsigned int index, char dirty)
+{
+    struct BOFS_CachedInode *cached;
+    struct BOFS_CachedPage *cpage = NULL;
+    unsigned int page = 0;
+
+    unsigned long flags = InterruptSave();
+    cached = InodeFind(sb->devno, id);
+    if (cached != NULL)
+        cpage = PageFind(cached, index);
+
+    if (cpage != NULL) {
+        if (dirty)
+            cpage->dirty = 1;
+        page = cpage->page;
+        HoldPage(page);
+        pcacheHits++;
+    } else {
+        pcacheMisses++;
+    }
+    InterruptRestore(flags);
+    return page;
+}
+
+/**
+ * BOFS_IcachePageAdd - 把读取好数据的页添加到页缓存
+ * @sb: 超级块
+ * @id: 节点号
+ * @index: 文件中的页号
+ * @page: 已经填好数据的物理页，引用交给页缓存
+ * @dirty: 页要被共享的可写映射使用，标记为脏
+ *
+ * 读取文件的时候可能已经有人添加了同一个页，就释放自己的页，使用已经存在的。
+ * 节点不在缓存中时不缓存页，直接返回。
+ * 返回要使用的物理页，持有一个引用
+ */
+PUBLIC unsigned int BOFS_IcachePageAdd(struct BOFS_SuperBlock *sb, unsigned int id,
+    unsigned int index, unsigned int page, char dirty)
+{
+    struct BOFS_CachedInode *cached;
+    struct BOFS_CachedPage *cpage, *found;
+
+    cpage = kmalloc(sizeof(struct BOFS_CachedPage), GFP_KERNEL);
+
+    unsigned long flags = InterruptSave();
+    cached = InodeFind(sb->devno, id);
+    if (cached == NULL || cpage == NULL) {
+        InterruptRestore(flags);
+        if (cpage != NULL)
+            kfree(cpage);
+        return page;
+    }
+
+    found = PageFind(cached, index);
+    if (found != NULL) {
+        if (dirty)
+            found->dirty = 1;
+        HoldPage(found->page);
+        InterruptRestore(flags);
+
+        kfree(cpage);
+        FreePage(page);
+        return found->page;
+    }
+
+    cpage->owner = cached;
+    cpage->index = index;
+    cpage->page = page;
+    cpage->dirty = dirty;
+    ListAdd(&cpage->hashList, PageHash(cached, index));
+    ListAddTail(&cpage->list, &cached->pageList);
+    cached->pageCount++;
+    pcachePages++;
+
+    /* 页缓存持有原来的引用，再给调用者一个 */
+    HoldPage(page);
+    InterruptRestore(flags);
+    return page;
+}
+
+/**
+ * BOFS_IcachePageCopy - 在页缓存和缓冲区之间复制文件数据
+ * @sb: 超级块
+ * @id: 节点号
+ * @offset: 文件中的偏移
+ * @buf: 缓冲区
+ * @count: 字节数
+ * @write: 为1表示数据写入了文件，复制到缓存的页中；
+ *         为0表示从文件读取了数据，用被映射修改过的页覆盖读到的数据
+ *
+ * 让read()和write()与文件的映射看到相同的数据，节点没有缓存的页时直接返回
+ */
+PUBLIC void BOFS_IcachePageCopy(struct BOFS_SuperBlock *sb, unsigned int id,
+    unsigned int offset, void *buf, unsigned int count, char write)
+{
+    struct BOFS_CachedInode *cached;
+    struct BOFS_CachedPage *cpage;
+    unsigned int index, start, end = offset + count, page;
+    uint8 *data;
+
+    for (index = offset / PAGE_SIZE; index * PAGE_SIZE < end; index++) {
+        unsigned long flags = InterruptSave();
+        cached = InodeFind(sb->devno, id);
+        if (cached == NULL || !cached->pageCount) {
+            InterruptRestore(flags);
+            return;
+        }
+        cpage = PageFind(cached, index);
+        if (cpage == NULL || (!write && !cpage->dirty)) {
+            InterruptRestore(flags);
+            continue;
+        }
+        /* 复制的时候缓冲区可能发生缺页，先持有页再打开中断 */
+        page = cpage->page;
+        HoldPage(page);
+        InterruptRestore(flags);
+
+        start = MAX(index * PAGE_SIZE, offset);
+        data = (uint8 *)Phy2Vir(page) + (start - index * PAGE_SIZE);
+        if (write)
+            memcpy(data, (uint8 *)buf + (start - offset), MIN((index + 1) * PAGE_SIZE, end) - start);
+        else
+            memcpy((uint8 *)buf + (start - offset), data, MIN((index + 1) * PAGE_SIZE, end) - start);
+        FreePage(page);
+    }
+}
+
+/**
+ * BOFS_IcachePageSync - 把页缓存中的脏页写到块缓冲
+ * @sb: 超级块
+ * @id: 节点号
+ *
+ * 写的时候会休眠，所以每次找到页号最小的下一个脏页。
+ * 仍然被进程映射的页之后还可能被修改，只有页缓存自己在使用的页写完后才清除脏标志。
+ * 成功返回0，失败返回-1
+ */
+PUBLIC int BOFS_IcachePageSync(struct BOFS_SuperBlock *sb, unsigned int id)
+{
+    struct BOFS_CachedInode *cached;
+    struct BOFS_CachedPage *cpage, *next;
+    unsigned int index = 0, page;
+    unsigned long flags;
+    int ret = 0;
+
+    while (1) {
+        flags = InterruptSave();
+        cached = InodeFind(sb->devno, id);
+        next = NULL;
+        if (cached != NULL) {
+            ListForEachOwner(cpage, &cached->pageList, list) {
+                if (cpage->dirty && cpage->index >= index &&
+                    (next == NULL || cpage->index < next->index))
+                    next = cpage;
+            }
+        }
+        if (next == NULL) {
+            InterruptRestore(flags);
+            break;
+        }
+        index = next->index;
+        page = next->page;
+        HoldPage(page);
+        InterruptRestore(flags);
+
+        if (PageWriteBack(cached, index, page)) {
+            printk(PART_ERROR "BOFS write back page %d of inode %d failed!\n", index, id);
+            ret = -1;
+        } else {
+            flags = InterruptSave();
+            cpage = PageFind(cached, index);
+            /* 页缓存和自己持有的引用 */
+            if (cpage != NULL && cpage->page == page && PagesReference(page) <= 2)
+                cpage->dirty = 0;
+            InterruptRestore(flags);
+        }
+        FreePage(page);
+        index++;
+    }
+    return ret;
+}
+
+/**
+ * BOFS_IcacheIsDirty - 节点或者它的页缓存是否有没有写回的修改
+ * @sb: 超级块
+ * @id: 节点号
+ *
+ * 节点不在缓存中返回0
+ */
+PUBLIC int BOFS_IcacheIsDirty(struct BOFS_SuperBlock *sb, unsigned int id)
+{
+    struct BOFS_CachedInode *cached;
+    struct BOFS_CachedPage *cpage;
+    int dirty = 0;
+
+    unsigned long flags = InterruptSave();
+    cached = InodeFind(sb->devno, id);
+    if (cached != NULL) {
+        dirty = cached->dirty;
+        ListForEachOwner(cpage, &cached->pageList, list) {
+            if (cpage->dirty)
+                dirty = 1;
+        }
+    }
+    InterruptRestore(flags);
+    return dirty;
+}
+
+/**
+ * BOFS_IcachePageInvalidate - 丢弃节点的页缓存
+ * @sb: 超级块
+ * @id: 节点号
+ *
+ * 释放节点的数据块或者淘汰节点的时候调用，没有写回的数据会丢失。
+ * 还被进程映射的页由映射持有引用，取消映射的时候才释放
+ */
+PUBLIC void BOFS_IcachePageInvalidate(struct BOFS_SuperBlock *sb, unsigned int id)
+{
+    struct BOFS_CachedInode *cached;
+    struct BOFS_CachedPage *cpage, *next;
+
+    unsigned long flags = InterruptSave();
+    cached = InodeFind(sb->devno, id);
+    if (cached != NULL) {
+        ListForEachOwnerSafe(cpage, next, &cached->pageList, list) {
+            ListDel(&cpage->hashList);
+            ListDel(&cpage->list);
+            FreePage(cpage->page);
+            kfree(cpage);
+            pcachePages--;
+        }
+        cached->pageCount = 0;
+    }
+    InterruptRestore(flags);
+}
+
+PUBLIC void BOFS_DumpIcache()
+{
+    printk(PART_TIP "----Inode Cache----\n");
+    printk(PART_TIP "hits:%d misses:%d write backs:%d evictions:%d unused:%d\n",
+        icacheHits, icacheMisses, icacheWriteBacks, icacheEvictions, inodeUnused);
+    printk(PART_TIP "block map hits:%d misses:%d\n", bmapHits, bmapMisses);
+    printk(PART_TIP "page cache pages:%d hits:%d misses:%d\n",
+        pcachePages, pcacheHits, pcacheMisses);
+}
+
+/**
+ * BOFS_InitIcache - 初始化节点缓存
+ */
+PUBLIC void BOFS_InitIcache()
+{
+    int i;
+
+    for (i = 0; i < BOFS_ICACHE_HASH_NR; i++)
+        INIT_LIST_HEAD(&inodeHashTable[i]);
+
+    inodeUnused = 0;
+    icacheHits = icacheMisses = icacheWriteBacks = icacheEvictions = 0;
+    bmapHits = bmapMisses = 0;
+
+    for (i = 0; i < BOFS_PCACHE_HASH_NR; i++)
+        INIT_LIST_HEAD(&pageHashTable[i]);
+    pcachePages = pcacheHits = pcacheMisses = 0;
+}
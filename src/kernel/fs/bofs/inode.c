@@ -14,9 +14,23 @@
 #include <lib/math.h>
 #include <fs/bofs/inode.h>
 #include <fs/bofs/bitmap.h>
+#include <fs/bofs/icache.h>
 #include <block/blk-buffer.h>
 #include <clock/clock.h>
 
+/**
+ * BOFS_OpenInode - 打开一个节点
+ * @sb: 节点所在的超级块
+ * @id: 节点id
+ * 
+ * 返回节点缓存中的节点，打开同一个节点的都共享它
+ * 失败返回NULL
+ */
+PUBLIC struct BOFS_Inode *BOFS_OpenInode(struct BOFS_SuperBlock *sb, unsigned int id)
+{
+	return BOFS_IcacheGet(sb, id, NULL);
+}
+
 /**
  * BOFS_CloseInode - 关闭一个节点
  * @inode: 要关闭的节点
@@ -25,7 +39,7 @@
 PUBLIC void BOFS_CloseInode(struct BOFS_Inode *inode)
 {
 	if(inode != NULL){
-		kfree(inode);
+		BOFS_IcachePut(inode);
 	}
 }
 
@@ -86,13 +100,13 @@ PUBLIC void BOFS_DumpInode(struct BOFS_Inode *inode)
 }
 
 /**
- * BOFS_SyncInode - 把节点同步到磁盘
- * @inode: 要同步的节点
+ * BOFS_WriteInode - 把节点写入磁盘
+ * @inode: 要写入的节点
  * @sb: 节点所在的超级块
  * 
  * 成功返回0，失败返回-1
  */
-PUBLIC int BOFS_SyncInode(struct BOFS_Inode *inode, struct BOFS_SuperBlock *sb)
+PUBLIC int BOFS_WriteInode(struct BOFS_Inode *inode, struct BOFS_SuperBlock *sb)
 {
 	uint32 sectorOffset = inode->id / sb->inodeNrInSector;
 	uint32 lba = sb->inodeTableLba + sectorOffset;
@@ -127,60 +141,70 @@ PUBLIC int BOFS_SyncInode(struct BOFS_Inode *inode, struct BOFS_SuperBlock *sb)
     return 0;
 }
 
+/**
+ * BOFS_SyncInode - 把节点同步到节点缓存
+ * @inode: 要同步的节点
+ * @sb: 节点所在的超级块
+ * 
+ * 只更新节点缓存并标记为脏，同步或者淘汰的时候才写回磁盘
+ * 成功返回0，失败返回-1
+ */
+PUBLIC int BOFS_SyncInode(struct BOFS_Inode *inode, struct BOFS_SuperBlock *sb)
+{
+	struct BOFS_Inode *cached = BOFS_IcacheGet(sb, inode->id, inode);
+	if (cached == NULL) {
+		return -1;
+	}
+	/* 打开的文件直接使用缓存中的节点，不需要复制 */
+	if (cached != inode) {
+		*cached = *inode;
+	}
+	BOFS_IcacheMarkDirty(cached);
+	BOFS_IcachePut(cached);
+	return 0;
+}
+
 /**
  * BOFS_EmptyInode - 清空节点的信息
  * @inode: 节点
  * @sb: 节点所在的超级块
  * 
- * 从磁盘上吧节点的所有信息清空
+ * 把节点的所有信息清空，保留节点id，因为打开的文件可能还在使用它，
+ * 同步或者淘汰的时候才写回磁盘
  * 成功返回0，失败返回-1
  */
 PUBLIC int BOFS_EmptyInode(struct BOFS_Inode *inode, struct BOFS_SuperBlock *sb)
 {
-	uint32 sectorOffset = inode->id/sb->inodeNrInSector;
-	uint32 lba = sb->inodeTableLba + sectorOffset;
-	uint32 bufOffset = inode->id % sb->inodeNrInSector;
-	
-	//printk("bofs sync: sec off:%d lba:%d buf off:%d\n", sectorOffset, lba, bufOffset);
-	/* 分配IO缓冲区 */
-    buf8_t iobuf = kmalloc(sb->blockSize, GFP_KERNEL);
-    if (iobuf == NULL) {
-        return -1;
-    }
+	unsigned int id = inode->id;
+	struct BOFS_Inode empty;
 
-	memset(iobuf, 0, sb->blockSize);
-	
-	if (BlockRead(sb->devno, lba, iobuf)) {
-        kfree(iobuf);
-		return -1;
-	}
+	memset(&empty, 0, sizeof(struct BOFS_Inode));
+	empty.id = id;
 
-	struct BOFS_Inode *inodeBuf = (struct BOFS_Inode *)iobuf;
-
-	memset(&inodeBuf[bufOffset], 0, sizeof(struct BOFS_Inode));
-	
-	if (BlockWrite(sb->devno, lba, iobuf, 0)) {
-        kfree(iobuf);
+	struct BOFS_Inode *cached = BOFS_IcacheGet(sb, id, &empty);
+	if (cached == NULL) {
 		return -1;
 	}
-
-    kfree(iobuf);
+	*cached = empty;
+	BOFS_IcacheMarkDirty(cached);
+	BOFS_IcacheMapInvalidate(sb, id);
+	BOFS_IcachePageInvalidate(sb, id);
+	BOFS_IcachePut(cached);
 	return 0;
 }
 
 /**
- * BOFS_LoadInodeByID - 通过inode id 加载节点信息
+ * BOFS_ReadInode - 从磁盘读取节点
  * @inode: 储存节点信息
  * @id: 节点id
  * @sb: 所在的超级块
  * 
  * 成功返回0，失败返回-1
  */
-PUBLIC int BOFS_LoadInodeByID(struct BOFS_Inode *inode, 
+PUBLIC int BOFS_ReadInode(struct BOFS_Inode *inode, 
     unsigned int id, 
     struct BOFS_SuperBlock *sb)
 {
-
 	uint32 sectorOffset = id / sb->inodeNrInSector;
 	uint32 lba = sb->inodeTableLba + sectorOffset;
 	uint32 bufOffset = id % sb->inodeNrInSector;
@@ -208,6 +232,28 @@ PUBLIC int BOFS_LoadInodeByID(struct BOFS_Inode *inode,
 	return 0;
 }
 
+/**
+ * BOFS_LoadInodeByID - 通过inode id 加载节点信息
+ * @inode: 储存节点信息
+ * @id: 节点id
+ * @sb: 所在的超级块
+ * 
+ * 成功返回0，失败返回-1
+ */
+PUBLIC int BOFS_LoadInodeByID(struct BOFS_Inode *inode, 
+    unsigned int id, 
+    struct BOFS_SuperBlock *sb)
+{
+	/* 先从节点缓存中查找，没有的时候才读取磁盘 */
+	struct BOFS_Inode *cached = BOFS_IcacheGet(sb, id, NULL);
+	if (cached == NULL) {
+		return -1;
+	}
+	*inode = *cached;
+	BOFS_IcachePut(cached);
+	return 0;
+}
+
 /**
  * BOFS_CopyInodeData - 复制节点的数据
  * @dst: 目的节点
@@ -283,9 +329,20 @@ PUBLIC void BOFS_CopyInode(struct BOFS_Inode *dst, struct BOFS_Inode *src)
 
 }
 
-PRIVATE int AllocOneSector(struct BOFS_SuperBlock *sb, unsigned int *data)
+/**
+ * AllocOneSector - 为节点分配一个块
+ * @sb: 超级块
+ * @inode: 节点
+ * @data: 保存块的地址
+ * 
+ * 从节点的预分配块中分配，尽量和节点之前的块连续
+ * 成功返回0，失败返回-1
+ */
+PRIVATE int AllocOneSector(struct BOFS_SuperBlock *sb, 
+	struct BOFS_Inode *inode,
+	unsigned int *data)
 {
-	int idx = BOFS_AllocBitmap(sb, BOFS_BMT_SECTOR, 1);
+	int idx = BOFS_IcacheAllocBlock(sb, inode->id);
 	if(idx == -1){
 		printk("alloc block bitmap failed!\n");
 		return -1;
@@ -302,7 +359,7 @@ PRIVATE int AllocOneSector(struct BOFS_SuperBlock *sb, unsigned int *data)
 	}
 	
 	memset(buffer, 0, sb->blockSize);
-	if (BlockWrite(sb->devno, *data, buffer, 0)) {
+	if (BlockWriteOwner(sb->devno, *data, buffer, BOFS_BUFFER_OWNER(inode))) {
 		printk(PART_ERROR "device %d write failed!\n", sb->devno);
 		return -1;
 	}
@@ -375,7 +432,7 @@ PRIVATE int GetBlockInInderect1(struct BOFS_Inode *inode,
 	/* 如果间接块没有数据 */
 	if (*inderect1 == 0) {
 		/* 分配一个数据块 */
-		if (AllocOneSector(sb, inderect1)) {
+		if (AllocOneSector(sb, inode, inderect1)) {
 			printk(PART_ERROR "alloc one block failed!\n");
 			goto ToEnd;
 		}
@@ -397,7 +454,7 @@ PRIVATE int GetBlockInInderect1(struct BOFS_Inode *inode,
 	/* 如果直接块没有数据 */
 	if (*derect == 0) {
 		/* 分配一个数据块 */
-		if (AllocOneSector(sb, derect)) {
+		if (AllocOneSector(sb, inode, derect)) {
 			printk("lv 1 alloc one block failed!\n");
 			goto ToEnd;
 		}
@@ -406,7 +463,7 @@ PRIVATE int GetBlockInInderect1(struct BOFS_Inode *inode,
 	
 		/* 直接块修改之后，需要把直接块的值保存，也就是说，需要把
 		直接块对应的数据写回磁盘，写回到1级间接块的数据中 */
-		if (BlockWrite(sb->devno, *inderect1, buffer1, 0)) {
+		if (BlockWriteOwner(sb->devno, *inderect1, buffer1, BOFS_BUFFER_OWNER(inode))) {
 			printk(PART_ERROR "device %d write failed!\n", sb->devno);
 			goto ToEnd;
 		} 
@@ -473,7 +530,7 @@ PRIVATE int GetBlockInInderect2(struct BOFS_Inode *inode,
 	/* 如果间接块没有数据 */
 	if (*inderect1 == 0) {
 		/* 分配一个数据块 */
-		if (AllocOneSector(sb, inderect1)) {
+		if (AllocOneSector(sb, inode, inderect1)) {
 			printk(PART_ERROR "alloc one block failed!\n");
 			goto ToEnd;
 		}
@@ -496,7 +553,7 @@ PRIVATE int GetBlockInInderect2(struct BOFS_Inode *inode,
 	/* 如果2级间接块没有数据 */
 	if (*inderect2 == 0) {
 		/* 分配一个数据块 */
-		if (AllocOneSector(sb, inderect2)) {
+		if (AllocOneSector(sb, inode, inderect2)) {
 			printk(PART_ERROR "alloc one block failed!\n");
 			goto ToEnd;
 		}
@@ -505,7 +562,7 @@ PRIVATE int GetBlockInInderect2(struct BOFS_Inode *inode,
 		
 		/* 2级间接块块修改之后，需要把块的值保存，也就是说，需要把
 		2级间接块对应的数据写回磁盘，写回到1级间接块的数据中 */
-		if (BlockWrite(sb->devno, *inderect1, buffer1, 0)) {
+		if (BlockWriteOwner(sb->devno, *inderect1, buffer1, BOFS_BUFFER_OWNER(inode))) {
 			printk(PART_ERROR "device %d write failed!\n", sb->devno);
 			goto ToEnd;
 		}
@@ -525,7 +582,7 @@ PRIVATE int GetBlockInInderect2(struct BOFS_Inode *inode,
 	/* 如果直接块没有数据 */
 	if (*derect == 0) {
 		/* 创建一个数据块 */
-		if (AllocOneSector(sb, derect)) {
+		if (AllocOneSector(sb, inode, derect)) {
 			printk("alloc one block failed!\n");
 			goto ToEnd;
 		}
@@ -533,7 +590,7 @@ PRIVATE int GetBlockInInderect2(struct BOFS_Inode *inode,
 	
 		/* 直接块修改之后，需要把直接块的值保存，也就是说，需要把
 		直接块对应的数据写回磁盘，写回到2级间接块的数据中 */
-		if (BlockWrite(sb->devno, *inderect2, buffer2, 0)) {
+		if (BlockWriteOwner(sb->devno, *inderect2, buffer2, BOFS_BUFFER_OWNER(inode))) {
 			printk(PART_ERROR "device %d write failed!\n", sb->devno);
 			goto ToEnd;
 		}
@@ -626,7 +683,7 @@ PRIVATE int GetBlockInInderect3(struct BOFS_Inode *inode,
 	/* 如果间接块没有数据 */
 	if (*inderect1 == 0) {
 		/* 分配一个数据块 */
-		if (AllocOneSector(sb, inderect1)) {
+		if (AllocOneSector(sb, inode, inderect1)) {
 			printk(PART_ERROR "alloc one block failed!\n");
 			goto ToEnd;
 		}
@@ -649,7 +706,7 @@ PRIVATE int GetBlockInInderect3(struct BOFS_Inode *inode,
 	/* 如果2级间接块没有数据 */
 	if (*inderect2 == 0) {
 		/* 分配一个数据块 */
-		if (AllocOneSector(sb, inderect2)) {
+		if (AllocOneSector(sb, inode, inderect2)) {
 			printk(PART_ERROR "alloc one block failed!\n");
 			goto ToEnd;
 		}
@@ -658,7 +715,7 @@ PRIVATE int GetBlockInInderect3(struct BOFS_Inode *inode,
 		
 		/* 2级间接块块修改之后，需要把块的值保存，也就是说，需要把
 		2级间接块对应的数据写回磁盘，写回到1级间接块的数据中 */
-		if (BlockWrite(sb->devno, *inderect1, buffer1, 0)) {
+		if (BlockWriteOwner(sb->devno, *inderect1, buffer1, BOFS_BUFFER_OWNER(inode))) {
 			printk(PART_ERROR "device %d write failed!\n", sb->devno);
 			goto ToEnd;
 		}
@@ -678,7 +735,7 @@ PRIVATE int GetBlockInInderect3(struct BOFS_Inode *inode,
 	/* 如果3级间接块没有数据 */
 	if (*inderect3 == 0) {
 		/* 分配一个数据块 */
-		if (AllocOneSector(sb, inderect3)) {
+		if (AllocOneSector(sb, inode, inderect3)) {
 			printk(PART_ERROR "alloc one block failed!\n");
 			goto ToEnd;
 		}
@@ -687,7 +744,7 @@ PRIVATE int GetBlockInInderect3(struct BOFS_Inode *inode,
 		*/
 		/* 3级间接块块修改之后，需要把块的值保存，也就是说，需要把
 		3级间接块对应的数据写回磁盘，写回到2级间接块的数据中 */
-		if (BlockWrite(sb->devno, *inderect2, buffer2, 0)) {
+		if (BlockWriteOwner(sb->devno, *inderect2, buffer2, BOFS_BUFFER_OWNER(inode))) {
 			printk(PART_ERROR "device %d write failed!\n", sb->devno);
 			goto ToEnd;
 		}
@@ -707,14 +764,14 @@ PRIVATE int GetBlockInInderect3(struct BOFS_Inode *inode,
 	/* 如果直接块没有数据 */
 	if (*derect == 0) {
 		/* 创建一个数据块 */
-		if (AllocOneSector(sb, derect)) {
+		if (AllocOneSector(sb, inode, derect)) {
 			printk("alloc one block failed!\n");
 			goto ToEnd;
 		}
 
 		/* 直接块修改之后，需要把直接块的值保存，也就是说，需要把
 		直接块对应的数据写回磁盘，写回到3级间接块的数据中 */
-		if (BlockWrite(sb->devno, *inderect3, buffer3, 0)) {
+		if (BlockWriteOwner(sb->devno, *inderect3, buffer3, BOFS_BUFFER_OWNER(inode))) {
 			printk(PART_ERROR "device %d write failed!\n", sb->devno);
 			goto ToEnd;
 		}
@@ -765,7 +822,7 @@ PUBLIC int BOFS_GetInodeData(struct BOFS_Inode *inode,
 		/* 没有数据块 */
 		if (*derect == 0) {
 			/* 创建一个数据块 */
-			if (AllocOneSector(sb, derect)) {
+			if (AllocOneSector(sb, inode, derect)) {
 				printk("alloc one block failed!\n");
 				return -1;
 			}
@@ -778,6 +835,12 @@ PUBLIC int BOFS_GetInodeData(struct BOFS_Inode *inode,
 	
 		printk("level 0, index %d base %d derect %d\n", index, base, *derect);
 		#endif
+	} else if (!BOFS_IcacheMapLookup(sb, inode->id, index, block)) {
+		/* 间接块中的映射已经解析过，不需要再读取间接块 */
+		#ifdef DEBUG_NODE_DATA
+		printk("cached, index %d block %d\n", index, *block);
+		#endif
+		return 0;
 	} else if (index < BLOCK_LV1) {
 		/* 1级块,12 + 256个 */
 		base = index - BLOCK_LV0;
@@ -812,6 +875,10 @@ PUBLIC int BOFS_GetInodeData(struct BOFS_Inode *inode,
         ForceSignal(SIGXFSZ, SysGetPid());
 		return -1;
 	}
+	/* 记录从间接块中解析出来的映射 */
+	if (index >= BLOCK_LV0) {
+		BOFS_IcacheMapAdd(sb, inode->id, index, *block);
+	}
 	return 0;
 }
 
@@ -932,7 +999,7 @@ PRIVATE int PutBlockInInderect1(struct BOFS_Inode *inode,
 			} else {	
 				/* 直接块修改之后，需要把直接块的值保存，也就是说，需要把
 				直接块对应的数据写回磁盘，写回到1级间接块的数据中 */
-				if (BlockWrite(sb->devno, *inderect1, buffer1, 0)) {
+				if (BlockWriteOwner(sb->devno, *inderect1, buffer1, BOFS_BUFFER_OWNER(inode))) {
 					printk(PART_ERROR "device %d write failed!\n", sb->devno);
 					goto ToEnd;
 				}
@@ -1075,7 +1142,7 @@ PRIVATE int PutBlockInInderect2(struct BOFS_Inode *inode,
 					} else {	
 						/* 2级块修改之后，需要把2级块的值保存，也就是说，需要把
 						2级块对应的数据写回磁盘，写回到1级间接块的数据中 */
-						if (BlockWrite(sb->devno, *inderect1, buffer1, 0)) {
+						if (BlockWriteOwner(sb->devno, *inderect1, buffer1, BOFS_BUFFER_OWNER(inode))) {
 							printk(PART_ERROR "device %d write failed!\n", sb->devno);
 							goto ToEnd;
 						}
@@ -1083,7 +1150,7 @@ PRIVATE int PutBlockInInderect2(struct BOFS_Inode *inode,
 				} else {	
 					/* 直接块修改之后，需要把直接块的值保存，也就是说，需要把
 					直接块对应的数据写回磁盘，写回到2级间接块的数据中 */
-					if (BlockWrite(sb->devno, *inderect2, buffer2, 0)) {
+					if (BlockWriteOwner(sb->devno, *inderect2, buffer2, BOFS_BUFFER_OWNER(inode))) {
 						printk(PART_ERROR "device %d write failed!\n", sb->devno);
 						goto ToEnd;
 					}
@@ -1275,7 +1342,7 @@ PRIVATE int PutBlockInInderect3(struct BOFS_Inode *inode,
 							} else {	
 								/* 2级块修改之后，需要把2级块的值保存，也就是说，需要把
 								2级块对应的数据写回磁盘，写回到1级间接块的数据中 */
-								if (BlockWrite(sb->devno, *inderect1, buffer1, 0)) {
+								if (BlockWriteOwner(sb->devno, *inderect1, buffer1, BOFS_BUFFER_OWNER(inode))) {
 									printk(PART_ERROR "device %d write failed!\n", sb->devno);
 									goto ToEnd;
 								}
@@ -1284,7 +1351,7 @@ PRIVATE int PutBlockInInderect3(struct BOFS_Inode *inode,
 						} else {	
 							/* 3级块修改之后，需要把3级块的值保存，也就是说，需要把
 							3级块对应的数据写回磁盘，写回到2级间接块的数据中 */
-							if (BlockWrite(sb->devno, *inderect2, buffer2, 0)) {
+							if (BlockWriteOwner(sb->devno, *inderect2, buffer2, BOFS_BUFFER_OWNER(inode))) {
 								printk(PART_ERROR "device %d write failed!\n", sb->devno);
 								goto ToEnd;
 							}
@@ -1292,7 +1359,7 @@ PRIVATE int PutBlockInInderect3(struct BOFS_Inode *inode,
 					} else {	
 						/* 直接块修改之后，需要把直接块的值保存，也就是说，需要把
 						直接块对应的数据写回磁盘，写回到3级间接块的数据中 */
-						if (BlockWrite(sb->devno, *inderect3, buffer3, 0)) {
+						if (BlockWriteOwner(sb->devno, *inderect3, buffer3, BOFS_BUFFER_OWNER(inode))) {
 							printk(PART_ERROR "device %d write failed!\n", sb->devno);
 							goto ToEnd;
 						}
@@ -1404,6 +1471,11 @@ PUBLIC int PutBlockByBlockIndex(struct BOFS_Inode *inode,
 PUBLIC int BOFS_ReleaseInodeData(struct BOFS_SuperBlock *sb,
 	struct BOFS_Inode *inode)
 {
+	/* 数据块都要释放，块映射缓存，预分配和页缓存都不再有效 */
+	BOFS_IcacheMapInvalidate(sb, inode->id);
+	BOFS_IcachePageInvalidate(sb, inode->id);
+	BOFS_IcacheDiscardPrealloc(sb, inode->id);
+
 	/* 如果节点没有数据，就直接返回 */
 	if (!inode->size)
 		return 0;
@@ -20,6 +20,7 @@
 #include <block/blk-dev.h>
 #include <block/ide/ide.h>
 #include <block/virtual/ramdisk.h>
+#include <clock/clock.h>
 
 #include <fs/bofs/bofs.h>
 #include <fs/bofs/drive.h>
@@ -28,10 +29,14 @@
 #include <fs/bofs/device.h>
 #include <fs/bofs/pipe.h>
 #include <fs/bofs/fifo.h>
+#include <fs/bofs/icache.h>
 
 /* 同步磁盘上的数据到文件系统 */
 #define SYNC_DISK_DATA 1
 
+/* 在ramdisk上测试文件系统的性能 */
+//#define _DEBUG_BENCH
+
 #define DATA_BLOCK 256
 
 #if 1
@@ -286,6 +291,69 @@ PRIVATE void MakeDeviceFile()
     //Spin("test");
 }
 
+#ifdef _DEBUG_BENCH
+/* 测试文件的大小和每次读写的大小 */
+#define BENCH_FILE_SIZE     (256 * 1024)
+#define BENCH_CHUNK         4096
+
+/**
+ * FileSystemBenchmark - 测试文件的顺序读写
+ * @name: 测试的名字
+ * 
+ * 在sys盘（ramdisk）上写入并读取一个文件，ramdisk的读写直接复制数据，
+ * 所以用时基本都是文件系统和块缓冲自身的开销
+ */
+PRIVATE void FileSystemBenchmark(char *name)
+{
+    clock_t start, writeTicks, readTicks;
+    int fd, i;
+
+    char *buf = kmalloc(BENCH_CHUNK, GFP_KERNEL);
+    if (buf == NULL)
+        return;
+    memset(buf, 0x5a, BENCH_CHUNK);
+
+    fd = SysOpen("sys:/bench", O_CREAT | O_RDWR);
+    if (fd < 0) {
+        kfree(buf);
+        return;
+    }
+
+    start = systicks;
+    for (i = 0; i < BENCH_FILE_SIZE / BENCH_CHUNK; i++)
+        SysWrite(fd, buf, BENCH_CHUNK);
+    SysFsync(fd);
+    writeTicks = systicks - start;
+
+    SysLseek(fd, 0, SEEK_SET);
+    start = systicks;
+    for (i = 0; i < BENCH_FILE_SIZE / BENCH_CHUNK; i++)
+        SysRead(fd, buf, BENCH_CHUNK);
+    readTicks = systicks - start;
+
+    SysClose(fd);
+    SysRemove("sys:/bench");
+    kfree(buf);
+
+    printk("bench: %s write %d KB %d ticks, read %d ticks\n",
+        name, BENCH_FILE_SIZE / 1024, writeTicks, readTicks);
+}
+
+/**
+ * RamdiskBenchmark - 比较ramdisk保留和不保留块缓冲时文件系统的性能
+ */
+PRIVATE void RamdiskBenchmark()
+{
+    FileSystemBenchmark("cached");
+
+    DeviceOpen(DEV_RDA, 0);
+    DeviceIoctl(DEV_RDA, RAMDISK_IO_NOCACHE, 1);
+    FileSystemBenchmark("nocache");
+    DeviceIoctl(DEV_RDA, RAMDISK_IO_NOCACHE, 0);
+    DeviceClose(DEV_RDA);
+}
+#endif /* _DEBUG_BENCH */
+
 /* 磁盘符链表头 */
 EXTERN struct List driveListHead;
 
@@ -770,6 +838,31 @@ PUBLIC int SysClose(int fd)
 	return BOFS_Close(fd);
 }
 
+PUBLIC int FileMapGet(int fd, int write)
+{
+    return BOFS_FileMapGet(fd, write);
+}
+
+PUBLIC void FileMapDup(int file)
+{
+    BOFS_FileMapDup(file);
+}
+
+PUBLIC void FileMapPut(int file)
+{
+    BOFS_FileMapPut(file);
+}
+
+PUBLIC int FileMapRead(int file, void *buffer, unsigned int offset, unsigned int size)
+{
+    return BOFS_FileMapRead(file, buffer, offset, size);
+}
+
+PUBLIC unsigned int FileMapPage(int file, unsigned int offset, int dirty)
+{
+    return BOFS_FileMapPage(file, offset, dirty);
+}
+
 PUBLIC int SysStat(const char *pathname, struct stat *buf)
 {
     char absPath[MAX_PATH_LEN] = {0};
@@ -881,6 +974,8 @@ PUBLIC int SysFsync(int fd)
 
 PUBLIC int SysSync()
 {
+    /* 先把节点缓存中的脏节点写到块缓冲区，再同步到磁盘 */
+    BOFS_IcacheSync(NULL);
     return BlockSync();
 }
 
@@ -1165,6 +1260,10 @@ PUBLIC void InitFileSystem()
     WriteDataToFS();
     
     Test();
+
+    #ifdef _DEBUG_BENCH
+    RamdiskBenchmark();
+    #endif
     /*
     int fd1 = SysOpen("/ff", O_RDWR);
     if (fd1 < 0)
@@ -85,7 +85,8 @@ PUBLIC void KGC_ContainerFree(KGC_Container_t *container)
 				KGC_ContainerZ(container, -1);	/* 隐藏 */
 			}
             /* 释放容器缓冲区 */
-            kfree(container->buffer);
+            KGC_FreeBuffer(container->buffer,
+                container->width * container->height * container->bytesPerPixel);
 			container->flags = KGC_CONTAINER_UNUSED;
 			break;
 		}
@@ -98,7 +99,8 @@ PUBLIC int KGC_ContainerInit(KGC_Container_t *container,
     int width, int height,
     void *private)
 {
-	container->buffer = (uint32_t *) kmalloc(width * height * KGC_CONTAINER_BPP, GFP_KERNEL);
+	/* 窗口的缓冲区可能很大，不需要物理上连续 */
+	container->buffer = (uint32_t *) KGC_AllocBuffer(width * height * KGC_CONTAINER_BPP);
 	if (container->buffer == NULL) {
 		return -1;
 	}
@@ -30,6 +30,7 @@
 #include <kgc/handler.h>
 #include <kgc/font/font.h>
 #include <kgc/container/container.h>
+#include <kgc/window/message.h>
 
 #include <clock/clock.h>
 
@@ -40,19 +41,36 @@
  * KGC_AllocBuffer - 分配缓冲区
  * @size: 缓冲区大小
  * 
- * 根据大小选择不同的分配方式
+ * 根据大小选择不同的分配方式，图形缓冲区不需要物理上连续，
+ * 大于一个页的用vmalloc逐页分配，不会占用大块的连续内存
  * 
  * 成功返回缓冲区地址，失败返回NULL
  */
 PUBLIC void *KGC_AllocBuffer(size_t size)
 {
-    if (size < MAX_MEM_CACHE_SIZE) {
+    if (size <= MAX_MEM_CACHE_SIZE) {
         return kmalloc(size, GFP_KERNEL);
     } else {
         return vmalloc(size);    
     }
 }
 
+/**
+ * KGC_FreeBuffer - 释放缓冲区
+ * @buffer: 缓冲区地址
+ * @size: 分配时的大小
+ * 
+ * 和KGC_AllocBuffer对应，根据大小选择释放的方式
+ */
+PUBLIC void KGC_FreeBuffer(void *buffer, size_t size)
+{
+    if (size <= MAX_MEM_CACHE_SIZE) {
+        kfree(buffer);
+    } else {
+        vfree(buffer);
+    }
+}
+
 /**
  * KGC_KeyboardInput - 图形核心键盘输入
  */
@@ -112,6 +130,9 @@ PUBLIC int InitKGC()
 #ifdef CONFIG_DISPLAY_GRAPH
     /* 初始化字体 */
     KGC_InitFont();    
+    /* 初始化消息 */
+    if (KGC_InitMessage())
+        Panic("init kgc message failed!\n");
     /* 初始化容器 */
     KGC_InitContainer();
 #endif /* CONFIG_DISPLAY_GRAPH */
@@ -16,9 +16,25 @@
 #include <kgc/window/message.h>
 #include <kgc/window/window.h>
 
+/* 消息节点的专用缓存 */
+PRIVATE struct MemCache *messageNodeCache;
+
+/**
+ * KGC_InitMessage - 初始化消息
+ * 
+ * 消息节点在每次输入事件时都要分配，使用专用的缓存
+ */
+PUBLIC int KGC_InitMessage()
+{
+    messageNodeCache = CreateMemCache("kgc message", sizeof(KGC_MessageNode_t), 0, 0, NULL);
+    if (messageNodeCache == NULL)
+        return -1;
+    return 0;
+}
+
 PUBLIC KGC_MessageNode_t *KGC_CreateMessageNode()
 {
-    KGC_MessageNode_t *node = kmalloc(sizeof(KGC_MessageNode_t), GFP_KERNEL);
+    KGC_MessageNode_t *node = MemCacheAlloc(messageNodeCache, GFP_KERNEL);
     return node;
 }
 
@@ -30,7 +46,7 @@ PUBLIC void KGC_FreeMessageList(KGC_Window_t *window)
         /* 从链表中删除 */
         ListDel(&node->list);
         /* 释放消息节点 */
-        kfree(node);
+        MemCacheFree(messageNodeCache, node);
     }
 }
 
@@ -78,7 +94,7 @@ PUBLIC int KGC_RecvMessage(KGC_Message_t *message)
         
     *message = node->message;
 
-    kfree(node);
+    MemCacheFree(messageNodeCache, node);
     //printk("[receive]");
     return 0;
 }
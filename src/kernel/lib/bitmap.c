@@ -7,6 +7,7 @@
 
 #include <lib/string.h>
 #include <book/bitmap.h>
+#include <book/bitops.h>
 
 /*
  * Bitmapinit - 初始化位图
@@ -17,6 +18,7 @@
 PUBLIC void BitmapInit(struct Bitmap *btmp) 
 {
    memset(btmp->bits, 0, btmp->btmpBytesLen);   
+   btmp->hint = 0;
 }
 
 /*
@@ -34,53 +36,135 @@ PUBLIC bool BitmapScanTest(struct Bitmap *btmp, unsigned int  bitIdx)
 }
 
 /*
- * Bitmapscan - 扫描n个位
- * @btmp: 要检测的位图
- * @cnt: 要扫描多少位
+ * BitmapWord - 读取位图中的一个32位的字
+ * @btmp: 位图
+ * @word: 字的索引
  * 
- * 可以通过检测寻找哪些是已经使用的，哪些还没有使用
+ * 位图的长度不一定是4字节的倍数，末尾超出位图的位当作已经使用
  */
-PUBLIC int BitmapScan(struct Bitmap *btmp, unsigned int cnt) {
-   unsigned int idxByte = 0;
+PRIVATE INLINE uint32_t BitmapWord(struct Bitmap *btmp, unsigned int word)
+{
+   unsigned int byte = word * 4;
+   uint32_t value = 0;
+   int i;
 
-   while (( 0xff == btmp->bits[idxByte]) && (idxByte < btmp->btmpBytesLen)) {
-      idxByte++;
+   if (byte + 4 <= btmp->btmpBytesLen) {
+      return *(uint32_t *)(btmp->bits + byte);
    }
-
-   
-   if (idxByte == btmp->btmpBytesLen) {  
-      return -1;
+   for (i = 0; i < 4; i++) {
+      if (byte + i < btmp->btmpBytesLen)
+         value |= (uint32_t)btmp->bits[byte + i] << (i * 8);
+      else
+         value |= (uint32_t)0xff << (i * 8);
    }
+   return value;
+}
 
-   int idxBit = 0;
-
-   while ((unsigned char)(BITMAP_MASK << idxBit) & btmp->bits[idxByte]) { 
-	 idxBit++;
-   }
-	 
-   int bitIdxStart = idxByte * 8 + idxBit;  
-   if (cnt == 1) {
-      return bitIdxStart;
+/*
+ * BitmapFindBit - 在一个范围内查找值为value的第一个位
+ * @btmp: 位图
+ * @start: 开始位置
+ * @end: 结束位置，不包括它
+ * @value: 要找的值（0或1）
+ * 
+ * 一次检测32位，用bsf找到字中的第一个位。没有找到返回-1
+ */
+PRIVATE int BitmapFindBit(struct Bitmap *btmp, unsigned int start,
+   unsigned int end, char value)
+{
+   uint32_t word;
+   unsigned int idx;
+
+   while (start < end) {
+      word = BitmapWord(btmp, start / 32);
+      /* 找0的时候取反，统一成找1 */
+      if (!value)
+         word = ~word;
+      /* 忽略开始位置前面的位 */
+      word &= ~0U << (start % 32);
+      if (word) {
+         idx = (start & ~31) + FindFirstSetBit(word);
+         return idx < end ? idx : -1;
+      }
+      start = (start & ~31) + 32;
    }
+   return -1;
+}
 
-   unsigned int bit_left = (btmp->btmpBytesLen * 8 - bitIdxStart);
-   unsigned int nextBit = bitIdxStart + 1;
-   unsigned int count = 1;
+/*
+ * BitmapScanRange - 在一个范围内扫描连续的n个空闲位
+ * @btmp: 位图
+ * @start: 开始位置
+ * @end: 结束位置，不包括它
+ * @cnt: 要多少个连续的位
+ * 
+ * 先找到一个空闲位，再找后面第一个已经使用的位，中间的长度足够就找到了，
+ * 不够就从那个已经使用的位后面继续找。没有找到返回-1
+ */
+PRIVATE int BitmapScanRange(struct Bitmap *btmp, unsigned int start,
+   unsigned int end, unsigned int cnt)
+{
+   int idx, used;
 
-   bitIdxStart = -1;
-   while (bit_left-- > 0) {
-      if (!(BitmapScanTest(btmp, nextBit))) {
-	 count++;
-      } else {
-	 count = 0;
+   while (start + cnt <= end) {
+      idx = BitmapFindBit(btmp, start, end, 0);
+      if (idx == -1 || idx + cnt > end) {
+         return -1;
       }
-      if (count == cnt) {
-	 bitIdxStart = nextBit - cnt + 1;
-	 break;
+      if (cnt == 1) {
+         return idx;
       }
-      nextBit++;          
+      used = BitmapFindBit(btmp, idx + 1, idx + cnt, 1);
+      if (used == -1) {
+         return idx;
+      }
+      start = used + 1;
+   }
+   return -1;
+}
+
+/*
+ * Bitmapscan - 扫描n个位
+ * @btmp: 要检测的位图
+ * @cnt: 要扫描多少位
+ * 
+ * 从上一次找到的位置后面开始扫描，到末尾后再从头扫描，
+ * 这样每次分配不用从头跳过已经使用的部分。
+ * 返回连续的cnt个空闲位的第一位，没有找到返回-1
+ */
+PUBLIC int BitmapScan(struct Bitmap *btmp, unsigned int cnt)
+{
+   unsigned int bits = btmp->btmpBytesLen * 8;
+   unsigned int hint = btmp->hint;
+   int idx;
+
+   if (!cnt) {
+      return -1;
    }
-   return bitIdxStart;
+   if (hint >= bits) {
+      hint = 0;
+   }
+
+   idx = BitmapScanRange(btmp, hint, bits, cnt);
+   if (idx == -1 && hint) {
+      idx = BitmapScanRange(btmp, 0, bits, cnt);
+   }
+   if (idx != -1) {
+      btmp->hint = idx + cnt;
+   }
+   return idx;
+}
+
+/*
+ * BitmapFindZero - 从某一位开始查找空闲位
+ * @btmp: 要检测的位图
+ * @start: 从哪一位开始
+ * 
+ * 返回第一个为0的位，没有找到返回-1
+ */
+PUBLIC int BitmapFindZero(struct Bitmap *btmp, unsigned int start)
+{
+   return BitmapFindBit(btmp, start, btmp->btmpBytesLen * 8, 0);
 }
 
 /*
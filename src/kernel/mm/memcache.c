@@ -12,7 +12,10 @@
 #include <lib/string.h>
 #include <lib/math.h>
 #include <lib/const.h>
+#include <lib/vsprintf.h>
+#include <clock/clock.h>
 
+//#define _DEBUG_BENCH
 
 /*
  * cacheSizes - cache大小的描述
@@ -28,21 +31,8 @@ PRIVATE struct CacheSize cacheSizes[] = {
 	{512, NULL},
 	{1024, NULL},
 	{2048, NULL},
+	/* 最大的cache是一个页，更大的分配直接使用页分配器 */
 	{4096, NULL},
-	{8*1024, NULL},
-	{16*1024, NULL},
-	{32*1024, NULL},
-	{64*1024, NULL},
-	/* 通常情况下最大支持128KB的内存分配，需要在1MB内完成对象分割 */
-	{128*1024, NULL},	
-	/* 配置大内存的分配 */
-	#ifdef CONFIG_LARGE_ALLOCS
-	{256*1024, NULL},
-	{512*1024, NULL},
-	{1024*1024, NULL},
-	{2*1024*1024, NULL},
-	{4*1024*1024, NULL},	// 64KB
-	#endif
 	{0, NULL},		// 用于索引判断结束
 };
 
@@ -50,30 +40,39 @@ PRIVATE struct CacheSize cacheSizes[] = {
  * 通过页的大小来选择cache数量
  */
 #if PAGE_SIZE == 4096
-	#ifdef CONFIG_LARGE_ALLOCS 
-		#define MAX_MEM_CACHE_NR 18
-	#else
-		#define MAX_MEM_CACHE_NR 13
-	#endif
+	#define MAX_MEM_CACHE_NR 8
 #else
-	#ifdef CONFIG_LARGE_ALLOCS 
-		#define MAX_MEM_CACHE_NR 17
-	#else
-		#define MAX_MEM_CACHE_NR 12
-	#endif
+	#define MAX_MEM_CACHE_NR 7
 #endif
 
-
+/*
+ * 最小的cache大小对应的位移，cache的大小都是2的幂，
+ * 所以大小对应的cache索引就是向上取整的log2减去这个位移
+ */
+#if PAGE_SIZE == 4096
+	#define MEM_CACHE_MIN_SHIFT 5
+#else
+	#define MEM_CACHE_MIN_SHIFT 6
+#endif
 
 /* 最开始的groupcache */
 struct MemCache memCacheTable[MAX_MEM_CACHE_NR];
 
+/* 所有的cache，包括kmalloc使用的cache和创建的专用cache */
+PRIVATE LIST_HEAD(memCacheList);
+
+/* 获取空闲对象中保存下一个空闲对象的指针 */
+#define MEM_OBJECT_NEXT_FREE(cache, object) \
+	(*(void **)((unsigned char *)(object) + (cache)->freeOffset))
+
 
 PUBLIC void DumpMemCache(struct MemCache *cache)
 {
 	printk(PART_TIP "----Mem Cache----\n");
 	printk(PART_TIP "object size %d count %d\n", cache->objectSize, cache->objectNumber);
 	printk(PART_TIP "flags %x name %s\n", cache->flags, cache->name);
+	printk(PART_TIP "size %d align %d groups %d using %d\n", 
+		cache->size, cache->align, cache->groups, cache->usingObjects);
 	printk(PART_TIP "full %x partial %x free %x\n", cache->fullGroups, cache->partialGroups, cache->freeGroups);
 	
 }
@@ -81,51 +80,94 @@ PUBLIC void DumpMemCache(struct MemCache *cache)
 PUBLIC void DumpMemGroup(struct MemGroup *group)
 {
 	printk(PART_TIP "----Mem Group----\n");
-	printk(PART_TIP "map bits %x len %d\n", group->map.bits, group->map.btmpBytesLen);
+	printk(PART_TIP "free list %x\n", group->freeList);
 	printk(PART_TIP "objects %x flags %x list %x\n", group->objects, group->flags, group->list);
 	printk(PART_TIP "using %d free %x\n", group->usingCount, group->freeCount);
 	
 }
 
 
-PRIVATE INIT int MemCacheInit(struct MemCache *cache,
+/**
+ * MemGroupObjectsOffset - 获取小对象在group页中的偏移
+ * @cache: group所在的cache
+ * 
+ * 对象紧跟在group结构后面，地址按照cache的对齐
+ */
+PRIVATE INLINE unsigned int MemGroupObjectsOffset(struct MemCache *cache)
+{
+	return DIV_ROUND_UP(SIZEOF_MEM_GROUP, cache->align) * cache->align;
+}
+
+PRIVATE int MemCacheInit(struct MemCache *cache,
 	char *name, 
 	size_t size, 
-	flags_t flags)
+	size_t align,
+	flags_t flags,
+	void (*ctor)(void *))
 {
 	if (!size)
 		return -1;
+	
+	/* 对齐必须是2的幂，并且不能超过一个页 */
+	if (align < MEM_CACHE_MIN_ALIGN)
+		align = MEM_CACHE_MIN_ALIGN;
+	if ((align & (align - 1)) || align > PAGE_SIZE)
+		return -1;
+
 	// 初始化链表
 	INIT_LIST_HEAD(&cache->fullGroups);
 	INIT_LIST_HEAD(&cache->partialGroups);
 	INIT_LIST_HEAD(&cache->freeGroups);
 
-	/* 根据size来选择不同的储存方式，以节约内存 */
-	if (size < 1024) { // 如果是小于1024，那么就放到单个页中。
-		/* 地址和8字节对齐，因为在结构体后面存放位图，位图是8字节为单位的 */
-		unsigned int groupSize = ALIGN_WITH(SIZEOF_MEM_GROUP, 8);
+	cache->size = size;
+	cache->align = align;
+	cache->ctor = ctor;
+	
+	/* 对象至少要能放下空闲链表的指针 */
+	unsigned int objectSize = DIV_ROUND_UP(size, sizeof(void *)) * sizeof(void *);
+	if (ctor) {
+		/* 有构造函数时，空闲链表的指针放在对象后面，不破坏构造好的数据 */
+		cache->freeOffset = objectSize;
+		objectSize += sizeof(void *);
+	} else {
+		cache->freeOffset = 0;
+	}
+	objectSize = DIV_ROUND_UP(objectSize, align) * align;
 
-		/* 如果是32字节为准，那么，就位图就只需要16字节即可 */
-		unsigned int leftSize = PAGE_SIZE - groupSize - 16;
+	/* 根据size来选择不同的储存方式，以节约内存 */
+	if (objectSize < 1024) { // 如果是小于1024，那么就放到单个页中。
+		unsigned int leftSize = PAGE_SIZE - MemGroupObjectsOffset(cache);
 
 		// 对象数量
-		cache->objectNumber = leftSize / size;;
-	} else if (size <= 128 * 1024) {  // 如果是小于128kb，就放到1MB以内
-		cache->objectNumber = (1 * MB) / size;
-	} else if (size <= 4 * 1024 * 1024) { // 如果是小于4MB，就放到4MB以内
-		cache->objectNumber = (4 * MB) / size;
+		cache->objectNumber = leftSize / objectSize;
+		cache->groupPages = 1;
+	} else if (objectSize <= MAX_MEM_CACHE_SIZE) {
+		/* 对象放在固定页数的连续页中，不会一次占用太多连续的内存 */
+		cache->objectNumber = (MEM_GROUP_OBJECT_PAGES * PAGE_SIZE) / objectSize;
+		/* group结构单独占用一个页 */
+		cache->groupPages = 1 + DIV_ROUND_UP(cache->objectNumber * objectSize, PAGE_SIZE);
+	} else {
+		return -1;
 	}
 
 	// 对象的大小
-	cache->objectSize = size;
+	cache->objectSize = objectSize;
 
 	// 设定cache的标志
 	cache->flags = flags;
 	
+	cache->groups = 0;
+	cache->usingObjects = 0;
+
 	// 设置名字
 	memset(cache->name, 0, MEM_CACHE_NAME_LEN);
-	strcpy(cache->name, name);
+	strncpy(cache->name, name, MEM_CACHE_NAME_LEN - 1);
 
+	/* 添加到cache链表，统计和收缩时会遍历它 */
+	unsigned long iflags = InterruptSave();
+	ListAddTail(&cache->list, &memCacheList);
+	InterruptRestore(iflags);
+	
 	//DumpMemCache(cache);
 	return 0;
 }
@@ -153,27 +195,15 @@ PRIVATE int MemCacheFreePages(void *address)
 	return 0;
 }
 
-PRIVATE INIT int MemGroupInit(struct MemCache *cache,
+PRIVATE int MemGroupInit(struct MemCache *cache,
 	struct MemGroup *group,
 	flags_t flags)
 {
-	// 把group添加到free链表
-	ListAdd(&group->list, &cache->freeGroups);
-
-	// 位图位于group结构后面
-	unsigned char *map = (unsigned char *)(group+1);
-
-	// 设定位图
-	group->map.btmpBytesLen = DIV_ROUND_UP(cache->objectNumber, 8);
-	group->map.bits = (unsigned char *)map;	
-	
-	BitmapInit(&group->map);
-
 	struct MemNode *node; 
 
 	/* 根据缓冲中记录的对象大小进行不同的设定 */
 	if (cache->objectSize < 1024) {
-		group->objects = map + 16;
+		group->objects = (unsigned char *)group + MemGroupObjectsOffset(cache);
 
 		/* 转换成节点，并标记 */
 		node = Page2MemNode(Vir2Phy(group));
@@ -194,6 +224,24 @@ PRIVATE INIT int MemGroupInit(struct MemCache *cache,
 		}
 	}
 
+	/* 把所有对象串成空闲链表，低地址的对象在前面，有构造函数就先构造对象 */
+	unsigned char *object = group->objects;
+	unsigned int i;
+	for (i = 0; i < cache->objectNumber; i++) {
+		if (cache->ctor)
+			cache->ctor(object);
+		MEM_OBJECT_NEXT_FREE(cache, object) = (i < cache->objectNumber - 1) ? 
+			object + cache->objectSize : NULL;
+		object += cache->objectSize;
+	}
+	group->freeList = group->objects;
+
+	// 对象都准备好后才把group添加到free链表
+	unsigned long iflags = InterruptSave();
+	ListAdd(&group->list, &cache->freeGroups);
+	cache->groups++;
+	InterruptRestore(iflags);
+
 	group->usingCount = 0;
 	group->freeCount = cache->objectNumber;
 	group->flags =  flags;
@@ -244,10 +292,13 @@ PRIVATE int MakeMemCaches()
 
 	//printk(PART_TIP "memCacheTable addr %x size %d\n", memCache, sizeof(struct MemCache));
 
+	char name[MEM_CACHE_NAME_LEN];
+
 	// 如果没有遇到大小为0的cache，就会把cache初始化
 	while (cacheSize->cacheSize) {
 		/* 初始化缓存信息 */
-		if (MemCacheInit(memCache, "mem cache", cacheSize->cacheSize, 0)) {
+		sprintf(name, "size-%d", cacheSize->cacheSize);
+		if (MemCacheInit(memCache, name, cacheSize->cacheSize, 0, 0, NULL)) {
 			printk(PART_ERROR "create mem cache failed!\n");
 			return -1;
 		}
@@ -274,31 +325,23 @@ PRIVATE int MakeMemCaches()
  */
 PRIVATE INLINE void *__MemGroupAllocObjcet(struct MemCache *cache, struct MemGroup *group)
 {
-	void *object;
-
-	// 做一些标志的设定
-
-	
-	// 从位图中获取一个空闲的对象
-	int idx = BitmapScan(&group->map, 1);
+	// 从空闲链表头取出一个对象
+	void *object = group->freeList;
 	
 	// 分配失败
-	if (idx == -1) {
+	if (object == NULL) {
 		/* 没有可用对象了 */
-		printk(PART_TIP "bitmap scan failed!\n");
+		printk(PART_TIP "group free list empty!\n");
 		
 		return NULL;
 	}
 		
-	// 设定为已经使用
-	BitmapSet(&group->map, idx, 1);
-
-	// 获取object的位置
-	object = group->objects + idx * cache->objectSize;
+	group->freeList = MEM_OBJECT_NEXT_FREE(cache, object);
 	
 	// 改变group的使用情况
 	group->usingCount++;
 	group->freeCount--;
+	cache->usingObjects++;
 	
 	// 判断group是否已经使用完了
 	if (group->freeCount == 0) {
@@ -392,35 +435,75 @@ ToCreateNewgroup:
 	return NULL;
 }
 
+/**
+ * SizeToCacheIndex - 获取大小对应的cache索引
+ * @size: 对象的大小
+ * 
+ * cache的大小都是2的幂，计算向上取整的log2就能直接得到索引，
+ * 不需要逐个比较cache大小
+ */
+PRIVATE INLINE int SizeToCacheIndex(size_t size)
+{
+	if (size <= (1 << MEM_CACHE_MIN_SHIFT))
+		return 0;
+	
+	/* size-1的最高位所在的位置加1就是向上取整的log2 */
+	return 32 - __builtin_clz(size - 1) - MEM_CACHE_MIN_SHIFT;
+}
+
+/**
+ * LargeAlloc - 分配大于一个页的内存
+ * @size: 内存的大小
+ * 
+ * 直接从页分配器分配连续的页，AllocPages会把页数记录在第一个页的
+ * 内存节点的count中，节点没有cache，kfree时就知道是这样分配的
+ */
+PRIVATE void *LargeAlloc(size_t size)
+{
+	unsigned int page = AllocPages(DIV_ROUND_UP(size, PAGE_SIZE));
+	if (!page)
+		return NULL;
+	
+	return Phy2Vir(page);
+}
+
+/**
+ * LargeFree - 释放大于一个页的内存
+ * @object: 内存的地址
+ * @node: 第一个页的内存节点
+ */
+PRIVATE void LargeFree(void *object, struct MemNode *node)
+{
+	/* 必须是分配的第一个页 */
+	if (((unsigned long)object & (PAGE_SIZE - 1)) || !node->count)
+		Panic("kfree bad large object %x!\n", object);
+	
+	FreePages(Vir2Phy(object));
+}
+
 /*
  * kmalloc - 分配一个对象
  * @size: 对象的大小
  * @flags: 分配需要的flags
  * 
- * 分配一个size大小的内存，用flags
+ * 分配一个size大小的内存，用flags，大于一个页的内存直接分配页
  */
 PUBLIC void *kmalloc(size_t size, unsigned int flags)
 {
 	// 如果越界了就返回空
-	if (size > MAX_MEM_CACHE_SIZE) {
+	if (size > MAX_KMALLOC_SIZE) {
 		printk(PART_WARRING "kmalloc size %d too big!", size);
 		return NULL;
 	}
+	
+	if (size > MAX_MEM_CACHE_SIZE)
+		return LargeAlloc(size);
 		
 	// 判断是否有标志
 	/*if (!flags) 
 		return NULL;*/
 
-	struct CacheSize *cacheSize = cacheSizes;
-
-	while (cacheSize->cacheSize) {
-		// 如果找到一个大于等于当前大小的cache，就跳出循环
-		if (cacheSize->cacheSize >= size)
-			break;
-		
-		// 指向下一个大小描述
-		cacheSize++;
-	}
+	struct CacheSize *cacheSize = &cacheSizes[SizeToCacheIndex(size)];
 	
 	//printk(PART_TIP "des %x cache %x size %x\n", sizeDes, sizeDes->cachePtr, sizeDes->cachePtr->objectSize);
 	return GroupAllocObjcet(cacheSize->memCache);
@@ -455,17 +538,14 @@ PRIVATE void __GroupFreeObject(struct MemCache *cache, void *object)
 
 	//printk(PART_TIP "get object group %x\n", group);
 
-	// 把group中对应的object释放，也就是把位图清除
-
-	// 找到位图的索引
-	int index = (((unsigned char *)object) - group->objects)/cache->objectSize; 
-	
-	// 检测index是否正确
-	if (index < 0 || index > group->map.btmpBytesLen*8)
-		Panic("map index bad range!\n");
+	// 检测对象是否在group的范围内
+	if ((unsigned char *)object < group->objects ||
+		(unsigned char *)object >= group->objects + cache->objectNumber * cache->objectSize)
+		Panic("object bad range!\n");
 	
-	// 把位图设置为0，就说明它没有使用了
-	BitmapSet(&group->map, index, 0);
+	// 把对象放回空闲链表头，下次分配时优先使用，cache也比较热
+	MEM_OBJECT_NEXT_FREE(cache, object) = group->freeList;
+	group->freeList = object;
 
 	int unsing = group->usingCount;
 	/*
@@ -478,6 +558,7 @@ PRIVATE void __GroupFreeObject(struct MemCache *cache, void *object)
 	group->usingCount--;
 	// 空闲的对象数增加
 	group->freeCount++;
+	cache->usingObjects--;
 	
 	// 没有使用中的对象
 	if (!group->usingCount) {
@@ -486,7 +567,6 @@ PRIVATE void __GroupFreeObject(struct MemCache *cache, void *object)
 		ListAddTail(&group->list, &cache->freeGroups);
 
 		//printk("kfree: free to free group.\n");
-		//memset(group->map.bits, 0, group->map.btmpBytesLen);
 		//printk(PART_TIP "free to cache %x name %s group %x\n", cache, cache->name, group);
 	} else if (unsing == cache->objectNumber) {
 		// 释放之前这个是满的group，现在释放后，就到partial中去
@@ -536,6 +616,12 @@ PUBLIC void kfree(void *objcet)
 	// 转换成group cache
 	cache = MEM_NODE_GET_CACHE(node);
 
+	/* 没有cache的是直接分配的页 */
+	if (cache == NULL) {
+		LargeFree(objcet, node);
+		return;
+	}
+
 	//DumpMemCache(cache);
 	//printk(PART_TIP "get object group cache %x\n", cache);
 
@@ -556,6 +642,7 @@ PRIVATE int GroupDestory(struct MemCache *cache, struct MemGroup *group)
 {
 	// 删除链表关系
 	ListDel(&group->list);
+	cache->groups--;
 	
 	/* 根据缓冲中记录的对象大小进行不同的设定 */
 	if (cache->objectSize < 1024) {
@@ -611,7 +698,21 @@ PRIVATE int MemCacheShrink(struct MemCache *cache)
 	InterruptRestore(flags);
 
 	// 返回收缩了的内存大小
-	return ret * cache->objectNumber * cache->objectSize;
+	return ret * cache->groupPages * PAGE_SIZE;
+}
+
+/* 注册了的内存收缩器 */
+PRIVATE LIST_HEAD(memShrinkerList);
+
+/**
+ * RegisterMemShrinker - 注册内存收缩器
+ * @shrinker: 收缩器
+ */
+PUBLIC void RegisterMemShrinker(struct MemShrinker *shrinker)
+{
+	unsigned long flags = InterruptSave();
+	ListAddTail(&shrinker->list, &memShrinkerList);
+	InterruptRestore(flags);
 }
 
 /**
@@ -622,20 +723,208 @@ PUBLIC int kmshrink()
 	// 释放了的大小
 	size_t size = 0;
 
-	// 指向cache的指针
-	struct CacheSize *cacheSize = &cacheSizes[0];
+	// 先让收缩器释放缓存的对象，这样cache中才会有更多空闲的group
+	struct MemShrinker *shrinker;
+	ListForEachOwner(shrinker, &memShrinkerList, list) {
+		shrinker->shrink();
+	}
 
 	// 对每一个cache都进行收缩
-	while (cacheSize->cacheSize) {
-		// 收缩大小
-		size += MemCacheShrink(cacheSize->memCache);
-		// 指向下一个cache大小描述
-		cacheSize++;
+	struct MemCache *cache;
+	ListForEachOwner(cache, &memCacheList, list) {
+		size += MemCacheShrink(cache);
 	}
 
 	return size;
 }
 
+/**
+ * CreateMemCache - 创建一个专用的对象缓存
+ * @name: cache的名字
+ * @size: 对象的大小
+ * @align: 对象的对齐，为0就使用默认的对齐
+ * @flags: cache的标志
+ * @ctor: 对象的构造函数，可以为空
+ * 
+ * 和kmalloc不同，对象的大小不会向上取整到2的幂。构造函数只在创建group时
+ * 对每个对象调用一次，所以释放对象前要把它恢复到构造后的状态。
+ * 成功返回cache，失败返回NULL
+ */
+PUBLIC struct MemCache *CreateMemCache(char *name, size_t size, size_t align,
+	flags_t flags, void (*ctor)(void *))
+{
+	if (name == NULL || !size || size > MAX_MEM_CACHE_SIZE)
+		return NULL;
+	
+	struct MemCache *cache = kmalloc(sizeof(struct MemCache), GFP_KERNEL);
+	if (cache == NULL)
+		return NULL;
+	
+	if (MemCacheInit(cache, name, size, align, flags, ctor)) {
+		printk(PART_ERROR "create mem cache %s failed!\n", name);
+		kfree(cache);
+		return NULL;
+	}
+	return cache;
+}
+
+/**
+ * DestroyMemCache - 销毁创建的对象缓存
+ * @cache: 要销毁的cache
+ * 
+ * cache中的对象都要已经释放，成功返回0，失败返回-1
+ */
+PUBLIC int DestroyMemCache(struct MemCache *cache)
+{
+	if (cache == NULL)
+		return -1;
+	
+	unsigned long flags = InterruptSave();
+	if (cache->usingObjects) {
+		InterruptRestore(flags);
+		printk(PART_ERROR "mem cache %s still has %d objects!\n", 
+			cache->name, cache->usingObjects);
+		return -1;
+	}
+	__MemCacheShrink(cache);
+	ListDel(&cache->list);
+	InterruptRestore(flags);
+
+	kfree(cache);
+	return 0;
+}
+
+/**
+ * MemCacheAlloc - 从对象缓存中分配一个对象
+ * @cache: 对象缓存
+ * @flags: 分配需要的标志
+ */
+PUBLIC void *MemCacheAlloc(struct MemCache *cache, unsigned int flags)
+{
+	if (cache == NULL)
+		return NULL;
+	return GroupAllocObjcet(cache);
+}
+
+/**
+ * MemCacheFree - 把对象释放到对象缓存
+ * @cache: 对象缓存
+ * @object: 对象
+ * 
+ * 对象也可以用kfree释放，这里会多检查对象是否属于cache
+ */
+PUBLIC void MemCacheFree(struct MemCache *cache, void *object)
+{
+	if (object == NULL)
+		return;
+	
+	struct MemNode *node = Page2MemNode(Vir2Phy(object));
+	CHECK_MEM_NODE(node);
+	if (MEM_NODE_GET_CACHE(node) != cache)
+		Panic("object %x not in mem cache %s!\n", object, cache->name);
+	
+	GroupFreeObject(cache, object);
+}
+
+/**
+ * SysMemCacheScan - 扫描内存缓存
+ * @ms: 保存cache信息
+ * @idx: 要获取的cache的序号，成功后指向下一个
+ * 
+ * 成功返回0，已经到达末尾返回-1
+ */
+PUBLIC int SysMemCacheScan(memcache_status_t *ms, unsigned int *idx)
+{
+	if (ms == NULL || idx == NULL)
+		return -1;
+	
+	struct MemCache *cache;
+	/* 先在本地填写，用户空间的缓冲区可能会触发缺页，不能在关中断时访问 */
+	memcache_status_t status;
+	unsigned int target = *idx;
+	unsigned int n = 0;
+	int found = 0;
+
+	unsigned long flags = InterruptSave();
+	ListForEachOwner(cache, &memCacheList, list) {
+		/* 到达了需求的序号 */
+		if (n == target) {
+			memset(status.mc_name, 0, sizeof(status.mc_name));
+			strncpy(status.mc_name, cache->name, sizeof(status.mc_name) - 1);
+			status.mc_size = cache->size;
+			status.mc_objsize = cache->objectSize;
+			status.mc_objects = cache->usingObjects;
+			status.mc_total = cache->groups * cache->objectNumber;
+			status.mc_groups = cache->groups;
+			status.mc_pages = cache->groups * cache->groupPages;
+			/* 对齐的填充、空闲链表的指针和group中放不下一个对象的空间 */
+			status.mc_waste = status.mc_pages * PAGE_SIZE - status.mc_total * cache->size;
+			found = 1;
+			break;
+		}
+		n++;
+	}
+	InterruptRestore(flags);
+	
+	/* 已经到达末尾了 */
+	if (!found)
+		return -1;
+
+	/* 恢复中断后再复制到用户空间 */
+	memcpy(ms, &status, sizeof(memcache_status_t));
+	*idx = target + 1;
+	return 0;
+}
+
+#ifdef _DEBUG_BENCH
+/* 每一轮分配的对象数量和测试的轮数，一对kmalloc/kfree只要一百个周期左右，
+轮数要足够多，用时才能超过几个时钟 */
+#define BENCH_OBJECTS   512
+#define BENCH_ROUNDS    10000
+
+/**
+ * MemCacheBenchmark - 测试kmalloc和kfree的吞吐量
+ * 
+ * 每一轮先分配BENCH_OBJECTS个对象，再全部释放，
+ * 统计不同大小的对象完成所有轮次需要的时钟数
+ */
+PRIVATE void MemCacheBenchmark()
+{
+	size_t sizes[] = {32, 100, 256, 1024, 4096, 16 * 1024};
+	clock_t start;
+	int i, j, k;
+
+	void **table = kmalloc(BENCH_OBJECTS * sizeof(void *), GFP_KERNEL);
+	if (table == NULL)
+		return;
+
+	for (k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++) {
+		start = systicks;
+		for (i = 0; i < BENCH_ROUNDS; i++) {
+			for (j = 0; j < BENCH_OBJECTS; j++)
+				table[j] = kmalloc(sizes[k], GFP_KERNEL);
+			for (j = 0; j < BENCH_OBJECTS; j++)
+				kfree(table[j]);
+		}
+		printk("bench: kmalloc/kfree size %d %d pairs %d ticks\n",
+			sizes[k], BENCH_OBJECTS * BENCH_ROUNDS, systicks - start);
+	}
+	kfree(table);
+}
+#endif /* _DEBUG_BENCH */
+
+/**
+ * MemCacheTest - 对内存缓存进行测试
+ * 
+ * 测试需要时钟，所以在时钟初始化后调用
+ */
+PUBLIC void MemCacheTest()
+{
+	#ifdef _DEBUG_BENCH
+	MemCacheBenchmark();
+	#endif
+}
+
 PUBLIC int InitMemCaches()
 {
 	MakeMemCaches();
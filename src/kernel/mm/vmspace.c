@@ -12,43 +12,308 @@
 #include <book/mmu.h>
 #include <book/vmspace.h>
 #include <book/task.h>
+#include <book/fs.h>
 #include <lib/string.h>
 #include <lib/math.h>
 
+/* 空间结构的专用缓存 */
+PRIVATE struct MemCache *vmspaceCache;
+
+/* 子树的高度，空树为0 */
+#define VMS_HEIGHT(space)   ((space) ? (space)->height : 0)
+
+/**
+ * VMSpaceTreeRecalc - 根据子节点重新计算节点的信息
+ * @space: 空间
+ * 
+ * 子节点的信息需要已经是正确的
+ */
+PRIVATE void VMSpaceTreeRecalc(struct VMSpace *space)
+{
+    struct VMSpace *left = space->left, *right = space->right;
+
+    space->height = MAX(VMS_HEIGHT(left), VMS_HEIGHT(right)) + 1;
+    space->subStart = left ? left->subStart : space->start;
+    space->subEnd = right ? right->subEnd : space->end;
+
+    /* 子树中的空闲区域在左右子树中，或者在左右子树和自己之间 */
+    space->maxGap = 0;
+    if (left)
+        space->maxGap = MAX(left->maxGap, space->start - left->subEnd);
+    if (right) {
+        space->maxGap = MAX(space->maxGap, right->maxGap);
+        space->maxGap = MAX(space->maxGap, right->subStart - space->end);
+    }
+}
+
+/**
+ * VMSpaceTreeReplace - 在父节点中用新节点替换旧节点
+ * @mm: 内存管理器
+ * @old: 旧节点
+ * @new: 新节点，可以为NULL
+ */
+PRIVATE void VMSpaceTreeReplace(struct MemoryManager *mm, 
+        struct VMSpace *old, struct VMSpace *new)
+{
+    struct VMSpace *parent = old->parent;
+
+    if (new != NULL)
+        new->parent = parent;
+
+    if (parent == NULL)
+        mm->spaceRoot = new;
+    else if (parent->left == old)
+        parent->left = new;
+    else
+        parent->right = new;
+}
+
+/**
+ * VMSpaceTreeRotateLeft - 左旋
+ * @mm: 内存管理器
+ * @space: 旋转的节点
+ * 
+ * 返回旋转后子树的根
+ */
+PRIVATE struct VMSpace *VMSpaceTreeRotateLeft(struct MemoryManager *mm, 
+        struct VMSpace *space)
+{
+    struct VMSpace *right = space->right;
+
+    space->right = right->left;
+    if (right->left)
+        right->left->parent = space;
+    VMSpaceTreeReplace(mm, space, right);
+    right->left = space;
+    space->parent = right;
+
+    VMSpaceTreeRecalc(space);
+    VMSpaceTreeRecalc(right);
+    return right;
+}
+
+/**
+ * VMSpaceTreeRotateRight - 右旋
+ * @mm: 内存管理器
+ * @space: 旋转的节点
+ * 
+ * 返回旋转后子树的根
+ */
+PRIVATE struct VMSpace *VMSpaceTreeRotateRight(struct MemoryManager *mm, 
+        struct VMSpace *space)
+{
+    struct VMSpace *left = space->left;
+
+    space->left = left->right;
+    if (left->right)
+        left->right->parent = space;
+    VMSpaceTreeReplace(mm, space, left);
+    left->right = space;
+    space->parent = left;
+
+    VMSpaceTreeRecalc(space);
+    VMSpaceTreeRecalc(left);
+    return left;
+}
+
+/**
+ * VMSpaceTreeRebalance - 从节点往上重新计算信息并且保持平衡
+ * @mm: 内存管理器
+ * @space: 开始的节点，可以为NULL
+ * 
+ * 一直处理到根节点，树的高度是O(log n)的
+ */
+PRIVATE void VMSpaceTreeRebalance(struct MemoryManager *mm, struct VMSpace *space)
+{
+    int balance;
+
+    while (space != NULL) {
+        VMSpaceTreeRecalc(space);
+        balance = VMS_HEIGHT(space->left) - VMS_HEIGHT(space->right);
+
+        if (balance > 1) {
+            if (VMS_HEIGHT(space->left->left) < VMS_HEIGHT(space->left->right))
+                VMSpaceTreeRotateLeft(mm, space->left);
+            space = VMSpaceTreeRotateRight(mm, space);
+        } else if (balance < -1) {
+            if (VMS_HEIGHT(space->right->right) < VMS_HEIGHT(space->right->left))
+                VMSpaceTreeRotateRight(mm, space->right);
+            space = VMSpaceTreeRotateLeft(mm, space);
+        }
+        space = space->parent;
+    }
+}
+
+/**
+ * VMSpaceTreeInsert - 把空间插入树
+ * @mm: 内存管理器
+ * @space: 空间
+ * 
+ * 返回开始地址在空间前面的最后一个空间，也就是链表中的前一个空间
+ */
+PRIVATE struct VMSpace *VMSpaceTreeInsert(struct MemoryManager *mm, struct VMSpace *space)
+{
+    struct VMSpace **link = &mm->spaceRoot;
+    struct VMSpace *parent = NULL, *prev = NULL;
+
+    while (*link != NULL) {
+        parent = *link;
+        if (space->start < parent->start) {
+            link = &parent->left;
+        } else {
+            prev = parent;
+            link = &parent->right;
+        }
+    }
+
+    space->parent = parent;
+    space->left = space->right = NULL;
+    *link = space;
+
+    VMSpaceTreeRebalance(mm, space);
+    return prev;
+}
+
+/**
+ * VMSpaceTreeErase - 把空间从树中删除
+ * @mm: 内存管理器
+ * @space: 空间
+ */
+PRIVATE void VMSpaceTreeErase(struct MemoryManager *mm, struct VMSpace *space)
+{
+    struct VMSpace *next, *fix;
+
+    if (space->left && space->right) {
+        /* 有两个子节点，用后继节点代替自己的位置 */
+        next = space->right;
+        while (next->left)
+            next = next->left;
+
+        if (next->parent != space) {
+            fix = next->parent;
+            VMSpaceTreeReplace(mm, next, next->right);
+            next->right = space->right;
+            space->right->parent = next;
+        } else {
+            fix = next;
+        }
+        next->left = space->left;
+        space->left->parent = next;
+        VMSpaceTreeReplace(mm, space, next);
+    } else {
+        fix = space->parent;
+        VMSpaceTreeReplace(mm, space, space->left ? space->left : space->right);
+    }
+
+    if (mm->spaceCache == space)
+        mm->spaceCache = NULL;
+
+    VMSpaceTreeRebalance(mm, fix);
+}
+
+/**
+ * VMSpaceTreeFindGap - 在子树中查找空闲区域
+ * @space: 子树的根
+ * @low: 区域的最低地址
+ * @len: 区域的长度
+ * 
+ * 只查找子树中相邻空间之间的区域，最大空闲长度不够的子树直接跳过。
+ * 返回不小于low的最低的地址，没有找到返回-1
+ */
+PRIVATE address_t VMSpaceTreeFindGap(struct VMSpace *space, address_t low, uint32 len)
+{
+    address_t addr;
+
+    if (space == NULL || space->maxGap < len || space->subEnd <= low)
+        return -1;
+
+    /* 按地址从低到高：左子树，左子树和自己之间，自己和右子树之间，右子树 */
+    addr = VMSpaceTreeFindGap(space->left, low, len);
+    if (addr != -1)
+        return addr;
+
+    if (space->left) {
+        addr = MAX(space->left->subEnd, low);
+        if (addr + len <= space->start)
+            return addr;
+    }
+
+    if (space->right) {
+        addr = MAX(space->end, low);
+        if (addr + len <= space->right->subStart)
+            return addr;
+    }
+
+    return VMSpaceTreeFindGap(space->right, low, len);
+}
+
+/**
+ * UpdateVMSpace - 空间的范围改变后更新树
+ * @space: 空间
+ * 
+ * 修改了空间的开始或者结束地址后调用，修改后和其它空间的顺序需要保持不变
+ */
+PUBLIC void UpdateVMSpace(struct VMSpace *space)
+{
+    VMSpaceTreeRebalance(space->mm, space);
+}
+
 /**
  * GetUnmappedVMSpace - 获取一个没有映射的空闲空间
  * @mm: 内存管理器
  * @len: 要获取的长度
  * 
- * 查找一个没有映射的空间并返回其地址
+ * 从VMS_UNMAPPED_BASE开始查找第一个足够大的空闲区域并返回其地址，
+ * 通过树中记录的最大空闲长度跳过放不下的子树
  */
 PRIVATE address_t GetUnmappedVMSpace(struct MemoryManager *mm, uint32 len)
 {
     /* 地址指向没有映射的空间的最开始处 */
     address_t addr = VMS_UNMAPPED_BASE;
+    struct VMSpace *root = mm->spaceRoot;
 
-    // 根据地址获取一个space
-    struct VMSpace *space = FindVMSpace(mm, addr);
-    
-    // 循环查找长度符合的空间
-    while (space != NULL) {
-        /* 如果到达最后，就退出查找 */
-        if (USER_VM_SIZE - len < addr)
-            return -1;
+    if (USER_VM_SIZE - len < addr)
+        return -1;
 
-        /* 如果要查找的区域在链表中间就直接返回地址 */
-        if (addr + len <= space->start)
-            return addr;
-        
-        /* 获取下一个地址 */
-        addr = space->end;
-        /* 获取下一个空间 */
-        space = space->next;
-    }
-    /* 地址空间在链表的最后面 */
+    /* 在第一个空间的前面 */
+    if (root == NULL || addr + len <= root->subStart)
+        return addr;
+
+    /* 在两个空间的中间 */
+    address_t gap = VMSpaceTreeFindGap(root, addr, len);
+    if (gap != -1)
+        return gap;
+
+    /* 地址空间在最后一个空间的后面 */
+    addr = MAX(root->subEnd, addr);
+    if (USER_VM_SIZE - len < addr)
+        return -1;
     return addr;
 }
 
+/**
+ * AllocVMSpace - 分配空间结构
+ * 
+ * 从空间的专用缓存中分配
+ */
+PUBLIC struct VMSpace *AllocVMSpace()
+{
+    return MemCacheAlloc(vmspaceCache, GFP_KERNEL);
+}
+
+/**
+ * FreeVMSpace - 释放空间结构
+ * @space: 空间
+ * 
+ * 如果空间映射了文件，就释放对文件的引用
+ */
+PUBLIC void FreeVMSpace(struct VMSpace *space)
+{
+    if (space->file >= 0)
+        FileMapPut(space->file);
+    MemCacheFree(vmspaceCache, space);
+}
+
 /**
  * MergeVMSpace - 尝试把空间和相邻的空间合并
  * @prev: 前一个空间
@@ -65,11 +330,13 @@ PUBLIC int MergeVMSpace(struct VMSpace* prev, struct VMSpace* space, struct VMSp
     if (prev != NULL && prev->end == space->start) {
         /* 其他属性页一样 */
         if (prev->pageProt == space->pageProt && prev->flags == space->flags) {
-            // 把space从链表删除
+            // 把space从链表和树中删除
+            VMSpaceTreeErase(space->mm, space);
             prev->end = space->end;
             prev->next = next;
+            UpdateVMSpace(prev);
             // 释放这个空间
-            kfree(space);
+            FreeVMSpace(space);
             // 空间指向prev
             space = prev;
             merged = 1;
@@ -79,11 +346,13 @@ PUBLIC int MergeVMSpace(struct VMSpace* prev, struct VMSpace* space, struct VMSp
     /* 合并space和p */
     if (next != NULL && space->end == next->start) {
         if (space->pageProt == next->pageProt && space->flags == next->flags) {
-            // 把p从链表中删除
+            // 把p从链表和树中删除
+            VMSpaceTreeErase(next->mm, next);
             space->end = next->end;
             space->next = next->next;
+            UpdateVMSpace(space);
             // 释放这个空间
-            kfree(next);
+            FreeVMSpace(next);
             merged = 1;
         }
     }
@@ -94,38 +363,29 @@ PUBLIC int MergeVMSpace(struct VMSpace* prev, struct VMSpace* space, struct VMSp
  * @mm: 内存管理器
  * @space: 要插入的空间
  * 
+ * 同时插入到树中，从树中得到链表中的前一个空间。
  * 成功返回0
  */
 PUBLIC int InsertVMSpace(struct MemoryManager *mm, struct VMSpace* space)
 {
-    struct VMSpace* prev = NULL;
-    /* 获取第一个空间 */
-    struct VMSpace* p = mm->spaceMap;
-    /*  */
-    while (p != NULL) {
-        /* 在中间找到一个空间 */
-        if (p->start >= space->end) {
-            break;
-        }
-        /* 保存前一个空间 */
-        prev = p;
-        p = p->next;
-    }
+    space->mm = mm;
 
-    /* 把空间插入到中间或者最后 */
-    space->next = p;
+    /* 获取前一个空间 */
+    struct VMSpace* prev = VMSpaceTreeInsert(mm, space);
 
     /* 如果前一个不是空，那么前一个的后一个就是当前插入的空间 */
     if (prev != NULL) {
+        space->next = prev->next;
         prev->next = space;
     }
     else {
         // 前一个为空，那么就把space当做第一个空间
+        space->next = mm->spaceMap;
         mm->spaceMap = space;
     }
 
     /* 合并prev和space */
-    //MergeVMSpace(prev, space, p);
+    //MergeVMSpace(prev, space, space->next);
     return 0;
 }
 
@@ -135,7 +395,7 @@ PUBLIC int InsertVMSpace(struct MemoryManager *mm, struct VMSpace* space)
  * @space: 要移除的空间
  * @prev: 空间的前一个空间
  * 
- * 把一个空间从内存管理器的空间链表中移除
+ * 把一个空间从内存管理器的空间链表和树中移除
  */
 PUBLIC void RemoveVMSpace(struct MemoryManager *mm, struct VMSpace *space, struct VMSpace *prev)
 {
@@ -146,8 +406,9 @@ PUBLIC void RemoveVMSpace(struct MemoryManager *mm, struct VMSpace *space, struc
         /* 没有prev，就让内存管理器的空间头指针指向space的下一个 */
         mm->spaceMap = space->next;
     }
+    VMSpaceTreeErase(mm, space);
     /* 现在可以正确得移除space了，因为已经把它从链表移除 */
-    kfree(space);
+    FreeVMSpace(space);
 }
 
 /**
@@ -155,19 +416,31 @@ PUBLIC void RemoveVMSpace(struct MemoryManager *mm, struct VMSpace *space, struc
  * @mm: 内存管理器
  * @addr: 要查找的地址
  * 
- * 查找第一个满足 addr < space->end, 并且不是NULL的空间
+ * 查找第一个满足 addr < space->end, 并且不是NULL的空间。
+ * 缺页时一般连续访问同一个空间，所以先检查上一次找到的空间
  */
 PUBLIC struct VMSpace *FindVMSpace(struct MemoryManager *mm, address_t addr)
 {
-    struct VMSpace* space = mm->spaceMap;
+    struct VMSpace *space = mm->spaceCache;
+    if (space != NULL && space->start <= addr && addr < space->end)
+        return space;
+
+    struct VMSpace *found = NULL;
+    space = mm->spaceRoot;
     while (space != NULL) {
-        /* 如果地址满足条件 */
-        if (addr < space->end)
-            return space;
-        
-        space = space->next;
+        if (addr < space->end) {
+            found = space;
+            /* 地址在空间中，不会有更前面的空间满足条件 */
+            if (space->start <= addr) {
+                mm->spaceCache = space;
+                break;
+            }
+            space = space->left;
+        } else {
+            space = space->right;
+        }
     }
-    return NULL;
+    return found;
 }
 /**
  * FindVMSpacePrev - 查找虚拟内存空间并且保存前一个空间
@@ -180,18 +453,22 @@ PUBLIC struct VMSpace *FindVMSpace(struct MemoryManager *mm, address_t addr)
  */
 PUBLIC struct VMSpace *FindVMSpacePrev(struct MemoryManager *mm, address_t addr, struct VMSpace **prev)
 {
+    struct VMSpace *found = NULL;
+    struct VMSpace *space = mm->spaceRoot;
+
     *prev = NULL;
-    struct VMSpace* space = mm->spaceMap;
     while (space != NULL) {
         /* 如果地址比查询的空间的结束地址小既 [addr, space->end] */
-        if (addr < space->end)
-            return space;
-        
-        /* 保存空间的前一个空间 */
-        *prev = space;
-        space = space->next;
+        if (addr < space->end) {
+            found = space;
+            space = space->left;
+        } else {
+            /* 结束地址不超过addr的最后一个空间就是前一个空间 */
+            *prev = space;
+            space = space->right;
+        }
     }
-    return NULL;
+    return found;
 }
 
 /**
@@ -274,10 +551,10 @@ PUBLIC int32 DoMmap(struct MemoryManager *mm, address_t addr, uint32_t len, uint
         }
     }
     
-    /* 从slab中分配一块内存来当做VMSpace结构 */
-    struct VMSpace *space = (struct VMSpace *)kmalloc(sizeof(struct VMSpace), GFP_KERNEL);
+    /* 从空间缓存中分配一个VMSpace结构 */
+    struct VMSpace *space = AllocVMSpace();
     if (!space) {
-        printk(PART_ERROR "DoMmap: kmalloc for space failed!\n");
+        printk(PART_ERROR "DoMmap: alloc for space failed!\n");
         return -1;    
     }
         
@@ -286,6 +563,9 @@ PUBLIC int32 DoMmap(struct MemoryManager *mm, address_t addr, uint32_t len, uint
     space->end = addr + len;
     space->flags = flags;
     space->pageProt = prot;
+    space->file = -1;
+    space->mm = mm;
+    space->next = NULL;
 
     /* 插入空间到链表中，并且尝试合并 */
     if (InsertVMSpace(mm, space)) {
@@ -298,6 +578,111 @@ PUBLIC int32 DoMmap(struct MemoryManager *mm, address_t addr, uint32_t len, uint
     return addr;
 }
 
+/** 
+ * DoMmapFile - 映射文件到地址
+ * @addr: 地址
+ * @len: 长度
+ * @prot: 页保护
+ * @flags: 空间的标志，MAP_SHARED表示共享映射，否则是私有映射
+ * @fd: 文件描述符
+ * @offset: 文件偏移，需要页对齐
+ * @fileSize: 从偏移处开始要映射的文件数据大小
+ * 
+ * 只建立空间，不读取数据。访问页时，缺页处理才从文件读取，
+ * 超过fileSize的部分填0。共享的可写映射需要文件可以写入
+ */
+PUBLIC int32 DoMmapFile(struct MemoryManager *mm, address_t addr, uint32_t len, 
+        uint32_t prot, uint32_t flags, int fd, uint32_t offset, uint32_t fileSize)
+{
+    if (offset & ~PAGE_MASK) {
+        printk(PART_ERROR "DoMmapFile: offset %x not page aligned!\n", offset);
+        return -1;
+    }
+
+    /* 获取文件，空间存在期间一直持有文件 */
+    int file = FileMapGet(fd, (flags & MAP_SHARED) && (prot & PROT_WRITE));
+    if (file < 0) {
+        printk(PART_ERROR "DoMmapFile: fd %d can't be mapped!\n", fd);
+        return -1;
+    }
+
+    int32 ret = DoMmap(mm, addr, len, prot, flags);
+    if (ret == -1) {
+        FileMapPut(file);
+        return -1;
+    }
+
+    struct VMSpace *space = FindVMSpace(mm, ret);
+    space->file = file;
+    space->fileOffset = offset;
+    space->fileSize = fileSize;
+    return ret;
+}
+
+/**
+ * VMSpaceFillPage - 缺页时映射文件的页
+ * @space: 映射了文件的空间
+ * @addr: 没有映射物理页的地址
+ * 
+ * 共享映射和整个页都是文件数据的私有映射，直接映射文件页缓存中的页，
+ * 映射同一个文件的进程使用同一个物理页。私有映射以写时复制的方式映射，
+ * 写入时才复制一个自己的页。文件数据结尾的页（比如和bss在同一个页）
+ * 需要一个私有的页，文件中有数据的部分从文件读取，其余部分填0。
+ * 成功返回0，失败返回-1
+ */
+PUBLIC int VMSpaceFillPage(struct VMSpace *space, address_t addr)
+{
+    addr &= PAGE_MASK;
+    uint32_t pageOffset = addr - space->start;
+    unsigned int page, protect;
+    int read = 0;
+    
+    if ((space->flags & MAP_SHARED) || pageOffset + PAGE_SIZE <= space->fileSize) {
+        /* 共享的可写映射会修改页，页被标记为脏，同步时写回文件 */
+        char shared = (space->flags & MAP_SHARED) && (space->pageProt & PROT_WRITE);
+
+        page = FileMapPage(space->file, space->fileOffset + pageOffset, shared);
+        if (!page) {
+            printk(PART_ERROR "VMSpaceFillPage: map file page at %x failed!\n", 
+                space->fileOffset + pageOffset);
+            return -1;
+        }
+
+        protect = PAGE_US_U;
+        if (shared)
+            protect |= PAGE_RW_W;
+        else if (space->pageProt & PROT_WRITE)
+            protect |= PAGE_COW;
+        
+        if (PageTableAdd(addr, page, protect)) {
+            FreePage(page);
+            return -1;
+        }
+        return 0;
+    }
+
+    page = AllocPage();
+    if (!page)
+        return -1;
+    if (PageTableAdd(addr, page, PAGE_US_U | PAGE_RW_W)) {
+        FreePage(page);
+        return -1;
+    }
+
+    if (pageOffset < space->fileSize) {
+        uint32_t size = MIN(PAGE_SIZE, space->fileSize - pageOffset);
+        read = FileMapRead(space->file, (void *)addr, space->fileOffset + pageOffset, size);
+        if (read < 0) {
+            printk(PART_ERROR "VMSpaceFillPage: read file at %x failed!\n", 
+                space->fileOffset + pageOffset);
+            return -1;
+        }
+    }
+    /* 剩余部分，比如bss，需要清0 */
+    memset((void *)(addr + read), 0, PAGE_SIZE - read);
+    return 0;
+}
+
 /** 
  * DoMunmap - 取消一个空间的映射
  * @mm: 内存管理器
@@ -346,33 +731,44 @@ PUBLIC int DoMunmap(struct MemoryManager *mm, uint32 addr, uint32 len)
         
     /* 分配一个新的空间，有可能要unmap的空间会分成2个空间，例如：
     [start, addr, addr+len, end] => [start, addr], [addr+len, end]
+    后面部分为空时不需要新的空间，避免树中出现开始地址相同的空间
      */
-    struct VMSpace* spaceNew = (struct VMSpace*)kmalloc(sizeof(struct VMSpace), GFP_KERNEL);
-    if (!spaceNew) {        
-        printk(PART_ERROR "DoMunmap: kmalloc for spaceNew failed!\n");
-        return -1;
-    }
+    if (addr + len < space->end) {
+        struct VMSpace* spaceNew = AllocVMSpace();
+        if (!spaceNew) {        
+            printk(PART_ERROR "DoMunmap: alloc for spaceNew failed!\n");
+            return -1;
+        }
 
-    /* 把新空间链接到链表 */
-    spaceNew->start = addr+len;
-    spaceNew->end = space->end;
-    space->end = addr;
-    spaceNew->next = space->next;
-    space->next = spaceNew;
+        /* 属性和原来的空间一样 */
+        *spaceNew = *space;
+        spaceNew->start = addr+len;
+        spaceNew->end = space->end;
+        
+        /* 映射了文件的话，后面部分的文件偏移也要跟着后移 */
+        if (space->file >= 0) {
+            FileMapDup(space->file);
+            uint32_t skip = spaceNew->start - space->start;
+            spaceNew->fileOffset = space->fileOffset + skip;
+            spaceNew->fileSize = space->fileSize > skip ? space->fileSize - skip : 0;
+        }
+        space->end = addr;
+        UpdateVMSpace(space);
+
+        /* 把新空间链接到链表和树 */
+        InsertVMSpace(mm, spaceNew);
+    } else {
+        space->end = addr;
+        UpdateVMSpace(space);
+    }
 
     /* 检查是否是第一部分需要移除 */
     if (space->start == space->end) {
         RemoveVMSpace(mm, space, prev);
-        space = prev;
-    }
-
-    /* 检查是否是第二部分需要移除 */
-    if (spaceNew->start == spaceNew->end) {
-        RemoveVMSpace(mm, spaceNew, space);
     }
 
-    /* 需要释放物理页 */
-    //UnmapPageRange(addr, len);
+    /* 释放物理页，共享的页（页缓存和写时复制）只减少引用 */
+    UnmapPagesFragment(addr, len);
    return 0;
 }
 
@@ -382,11 +778,20 @@ PUBLIC int DoMunmap(struct MemoryManager *mm, uint32 addr, uint32 len)
  * @len: 长度
  * @prot: 页保护
  * @flags: 空间的标志
+ * @frame: 中断栈框
+ * 
+ * 第5个参数fd通过edx传递，第6个参数offset通过ebp传递。
+ * fd小于0时是匿名映射，不然就映射文件从offset开始的len个字节
  */
-PUBLIC void *SysMmap(uint32_t addr, uint32_t len, uint32_t prot, uint32_t flags)
+PUBLIC void *SysMmap(uint32_t addr, uint32_t len, uint32_t prot, uint32_t flags,
+        struct TrapFrame *frame)
 {
     struct Task *current = CurrentTask();
-    return (void *)DoMmap(current->mm, addr, len, prot, flags);
+    int fd = (int)frame->edx;
+
+    if (fd < 0)
+        return (void *)DoMmap(current->mm, addr, len, prot, flags);
+    return (void *)DoMmapFile(current->mm, addr, len, prot, flags, fd, frame->ebp, len);
 }
 
 /**
@@ -408,6 +813,8 @@ PUBLIC int SysMunmap(uint32_t addr, uint32_t len)
 PUBLIC void InitMemoryManager(struct MemoryManager *mm)
 {
     mm->spaceMap = NULL;
+    mm->spaceRoot = NULL;
+    mm->spaceCache = NULL;
 }
 
 /** 
@@ -458,11 +865,13 @@ PUBLIC void ReleaseVMSpace(struct MemoryManager *mm, unsigned int flags)
             UnmapPagesFragment(cur->start, cur->end - cur->start);
 
             /* 释放虚拟空间 */
-            kfree(cur);
+            FreeVMSpace(cur);
         }
     }
     /* 释放完后把空间映射置空 */
     mm->spaceMap = NULL;
+    mm->spaceRoot = NULL;
+    mm->spaceCache = NULL;
 }
 
 /** 
@@ -502,11 +911,16 @@ PUBLIC void ExitVMSpace(struct MemoryManager *mm)
         }
         printk("task %s release space: start %x end %x\n", CurrentTask()->name, cur->start, cur->end);
 #endif
+        /* 取消页映射，写时复制共享的页只会减少引用次数 */
+        UnmapPagesFragment(cur->start, cur->end - cur->start);
+
         /* 释放虚拟空间 */
-        kfree(cur);        
+        FreeVMSpace(cur);
     }
     /* 释放完后把空间映射置空 */
     mm->spaceMap = NULL;
+    mm->spaceRoot = NULL;
+    mm->spaceCache = NULL;
 }
 
 
@@ -548,6 +962,7 @@ PRIVATE unsigned int DoBrk(struct MemoryManager *mm, unsigned int addr, unsigned
         /* 如果空间的结束和当前地址一样，并且flags也是一样的，就说明他们可以合并 */
         if (space && space->end == addr && space->flags == flags) {
             space->end = addr + len;
+            UpdateVMSpace(space);
             /*printk(PART_TIP "DoBrk: space can merge. The space [%x-%x], me [%x-%x]\n", 
                 space->start, space->end, addr, addr + len
             ); */
@@ -556,7 +971,7 @@ PRIVATE unsigned int DoBrk(struct MemoryManager *mm, unsigned int addr, unsigned
     }
 
     /* 创建一个space，用来映射新的地址 */
-    space = kmalloc(sizeof(struct VMSpace), GFP_KERNEL);
+    space = AllocVMSpace();
     if (space == NULL)
         return -1;
     
@@ -565,6 +980,7 @@ PRIVATE unsigned int DoBrk(struct MemoryManager *mm, unsigned int addr, unsigned
     space->flags = flags;
     /* 堆是可以执行的 */
     space->pageProt = PROT_READ | PROT_WRITE | PROT_EXEC;
+    space->file = -1;
     space->mm = mm;
     space->next = NULL;
     
@@ -666,7 +1082,15 @@ ToEnd:
  */
 PUBLIC void InitVMSpace()
 {
+    /* 空间结构分配得很频繁，使用专用的缓存 */
+    vmspaceCache = CreateMemCache("vmspace", sizeof(struct VMSpace), 0, 0, NULL);
+    if (vmspaceCache == NULL)
+        Panic("create vmspace cache failed!\n");
+
     // 注册页故障处理中断
     InterruptRegisterHandler(0x0e, DoPageFault);
 
+    /* fork的时候以写时复制的方式共享页 */
+    InitCopyOnWrite();
+
 }
@@ -71,6 +71,23 @@ SegmentLoad(int  fd, uint32_t offset, uint32_t fileSize, uint32_t memSize, uint3
         occupyPages = 1;
     }
 
+    /* 段在页中的偏移和在文件中的偏移相同时，就可以把文件按页映射到段上。
+    这里只记录映射，不分配物理页也不读取数据，第一次访问某个页时，
+    缺页处理才从文件中读取这个页，超过filesz的部分（bss）填0
+     */
+    if ((offset & PAGE_INSIDE) == (vaddr & PAGE_INSIDE)) {
+        uint32_t inside = vaddr & PAGE_INSIDE;
+        
+        int32 ret = DoMmapFile(CurrentTask()->mm, vaddrFirstPage, occupyPages*PAGE_SIZE, 
+                PROT_READ | PROT_WRITE | PROT_EXEC, MAP_FIXED,
+                fd, offset - inside, fileSize ? fileSize + inside : 0);
+        if (ret < 0) {
+            printk(PART_ERROR "SegmentLoad: DoMmapFile failed!\n");
+            return -1;
+        }
+        return 0;
+    }
+
     /* 虚拟地址和物理地址进行映射 */
     if (MapPagesMaybeMapped(vaddrFirstPage, occupyPages, PAGE_US_U | PAGE_RW_W)) {
         printk(PART_ERROR "SegmentLoad: MapPagesMaybeMapped failed!\n");
@@ -85,10 +102,10 @@ SegmentLoad(int  fd, uint32_t offset, uint32_t fileSize, uint32_t memSize, uint3
     //printk(PART_TIP "addr %x link done!\n", vaddrFirstPage);
     
     /* 映射虚拟空间 */  
-    int32 ret = (int32)SysMmap(vaddrFirstPage, occupyPages*PAGE_SIZE, 
+    int32 ret = DoMmap(CurrentTask()->mm, vaddrFirstPage, occupyPages*PAGE_SIZE, 
             PROT_READ | PROT_WRITE | PROT_EXEC, MAP_FIXED);
     if (ret < 0) {
-        printk(PART_ERROR "SegmentLoad: SysMmap failed!\n");
+        printk(PART_ERROR "SegmentLoad: DoMmap failed!\n");
         return -1;
     }
     //printk("task %s VMSpace: addr %x page %d\n",CurrentTask()->name, vaddrFirstPage, occupyPages);
@@ -99,6 +116,10 @@ SegmentLoad(int  fd, uint32_t offset, uint32_t fileSize, uint32_t memSize, uint3
         return -1;
     }
 
+    /* 如果内存占用大于文件占用，就要把内存中多余的部分置0 */
+    if (memSize > fileSize) {
+        memset((void *)(vaddr + fileSize), 0, memSize - fileSize);
+    }
     return 0;
 }
 
@@ -143,15 +164,6 @@ PRIVATE int LoadElfBinary(struct MemoryManager *mm, struct Elf32_Ehdr *elfHeader
                 return -1;
             }
             
-            /* 如果内存占用大于文件占用，就要把内存中多余的部分置0 */
-            if (progHeader.p_memsz > progHeader.p_filesz) {
-                memset((void *)(progHeader.p_vaddr + progHeader.p_filesz), 0,
-                    progHeader.p_memsz - progHeader.p_filesz);
-                /*printk("memsz(%x) > filesz(%x)\n", 
-                    progHeader.p_memsz, progHeader.p_filesz);
-                */
-            }
-            
             /* 设置段的起始和结束 */
             if (progHeader.p_flags == ELF32_PHDR_CODE) {
                 mm->codeStart = progHeader.p_vaddr;
@@ -185,16 +197,16 @@ PRIVATE int InitUserStack(struct Task *task, struct TrapFrame *frame,
         char **argv, int argc)
 {
     /* 设置栈空间 */
-    struct VMSpace *space = (struct VMSpace *)\
-            kmalloc(sizeof(struct VMSpace), GFP_KERNEL);
+    struct VMSpace *space = AllocVMSpace();
     if (!space) {
-        printk(PART_ERROR "SysExecv: kmalloc for stack space failed!\n");
+        printk(PART_ERROR "SysExecv: alloc for stack space failed!\n");
         return -1; 
     }
     space->end = USER_STACK_TOP;
     space->start = USER_STACK_TOP - PAGE_SIZE;  /* 初始用户栈大小为1个页 */
     space->pageProt = PROT_READ | PROT_WRITE;
     space->flags = VMS_STACK;
+    space->file = -1;
     space->next = NULL;
     
     /* 重新映射栈 */
@@ -314,7 +326,7 @@ ToFreePage:
     FreePages(paddr);
 ToFreeSpace:
     // 释放虚拟空间
-    kfree(space);
+    FreeVMSpace(space);
     
     return -1;
 }
@@ -524,8 +536,9 @@ PUBLIC int SysExecv(const char *path, const char *argv[])
     memset(name, 0, MAX_TASK_NAMELEN);
     strcpy(name, path);
     
-    /* 只释放占用的栈和堆，而代码，数据，bss都不释放（当进程重新加载时可以提高速度） */
-    ReleaseVMSpace(current->mm, VMS_STACK | VMS_HEAP);
+    /* 代码，数据，bss映射的是原来的镜像文件，所以和栈，堆一起全部释放，
+    新镜像的页在访问时才从文件中加载 */
+    ReleaseVMSpace(current->mm, VMS_STACK | VMS_HEAP | VMS_RESOURCE);
     
     /* 6.加载程序段 */
     if (LoadElfBinary(current->mm, &elfHeader, fd)) {
@@ -9,6 +9,7 @@
 #include <book/arch.h>
 #include <book/debug.h>
 #include <book/task.h>
+#include <book/alarm.h>
 #include <book/fs.h>
 #include <fs/bofs/file.h>
 #include <lib/string.h>
@@ -66,9 +67,11 @@ PRIVATE void AdopeChildren(struct Task *cur)
  */
 PRIVATE void ReleaseZombie(struct Task *task)
 {
-    /* 回收页目录 */
-    if (task->pgdir)
+    /* 回收页目录和用户空间的页表 */
+    if (task->pgdir) {
+        FreeUserPageTables(task->pgdir);
         kfree(task->pgdir);
+    }
     /* 回收MM */
     FreeTaskMemory(task);
 
@@ -83,6 +86,9 @@ PRIVATE void CancelEverything(struct Task *task)
         RemoveTimer(task->sleepTimer);
     }
 
+    /* 取消闹钟 */
+    AlarmCancel(task);
+
     /* 关闭窗口 */
     if (task->window) {
         //printk("close window\n");
@@ -109,7 +115,7 @@ PUBLIC void ThreadExit(struct Task *thread)
 
     /* 如果在就绪队列中，就从就绪队列中删除 */
     if (IsTaskInPriorityQueue(thread)) {
-        ListDelInit(&thread->list);
+        TaskPriorityQueueDel(thread);
     }
     
     InterruptRestore(flags);
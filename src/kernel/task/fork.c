@@ -9,6 +9,7 @@
 #include <book/arch.h>
 #include <book/debug.h>
 #include <book/task.h>
+#include <book/alarm.h>
 #include <book/fs.h>
 #include <lib/string.h>
 #include <fs/bofs/file.h>
@@ -24,12 +25,17 @@ PRIVATE int CopyStructAndKstack(struct Task *childTask, struct Task *parentTask)
     /* 单独修改内容 */
     childTask->pid = ForkPid();
     childTask->elapsedTicks = 0;
+    childTask->waitTicks = 0;
+    childTask->maxWaitTicks = 0;
+    childTask->switches = 0;
+    AlarmInit(childTask);   /* 子进程不继承闹钟 */
     childTask->status = TASK_READY;
     childTask->ticks = childTask->timeslice;
     childTask->parentPid = parentTask->pid;
     /* 重新设置链表，在这里不使用ListDel，那样会删除父进程在队列中的情况
     所以这里就直接把队列指针设为NULL，后面会添加到链表中*/
     childTask->list.next = childTask->list.prev = NULL;
+    childTask->onRunQueue = 0;
     childTask->globalList.next = childTask->globalList.prev = NULL;
     
     /* 复制名字，在后面追加fork表明是一个fork的进程，用于测试 */
@@ -37,93 +43,54 @@ PRIVATE int CopyStructAndKstack(struct Task *childTask, struct Task *parentTask)
     return 0;
 }
 
+/**
+ * CopyPageTable - 复制页表
+ * 
+ * 不复制页的数据，父子进程以写时复制的方式共享物理页，
+ * 谁先写入，谁就在页故障中得到一个新的页
+ */
 PRIVATE int CopyPageTable(struct Task *childTask, struct Task *parentTask)
 {
-    
-    /* 开始内存的复制 */
-    void *buf = kmalloc(PAGE_SIZE, GFP_KERNEL);
-    if (!buf) {
-        printk(PART_ERROR "CopyPageTable: kmalloc buf for data transform failed!\n");
-        return -1;
-    }
-        
     /* 获取父目录的虚拟空间 */
     struct VMSpace *space = parentTask->mm->spaceMap;
     
-    uint32_t progVaddr = 0;
-    uint32_t paddr;
-    
     /* 当空间不为空时就一直获取 */
     while (space != NULL) {
-        /* 获取空间最开始地址 */
-        progVaddr = space->start;
         // printk(PART_TIP "the space %x start %x end %x\n", space, space->start, space->end);
-        /* 在空间中进行复制 */
-        while (progVaddr < space->end) {
-            /* 1.将进程空间中的数据复制到内核空间，切换页表后，
-            还能访问到父进程中的数据 */
-            memcpy(buf, (void *)progVaddr, PAGE_SIZE);
-
-            /* 2.切换进程空间 */
-            PageDirActive(childTask);
-
-            /* 3.映射虚拟地址 */
-            // 分配一个物理页
-            paddr = AllocPage();
-            if (!paddr) {
-                printk(PART_ERROR "CopyPageTable: GetFreePage for vaddr failed!\n");
-        
-                /* 激活父进程并返回 */
-                PageDirActive(parentTask);
-                return -1;
-            }
-            // 页链接，从动态内存中分配一个页并且页保护是 用户，可写
-            PageTableAdd(progVaddr, paddr, PAGE_US_U | PAGE_RW_W);
-
-            /* 4.从内核复制数据到进程 */
-            memcpy((void *)progVaddr, buf, PAGE_SIZE);
-
-            /* 5.恢复父进程内存空间 */
-            PageDirActive(parentTask);
-            // printk(PART_TIP "copy at virtual address %x\n", progVaddr);
-            /* 指向下一个页 */
-            progVaddr += PAGE_SIZE;
+        /* 在空间中共享页 */
+        /* 文件的共享映射在父子进程之间继续共享，其它的写时复制 */
+        if (SharePagesCopyOnWrite(childTask->pgdir, space->start, space->end,
+                space->file >= 0 && (space->flags & MAP_SHARED))) {
+            printk(PART_ERROR "CopyPageTable: share pages failed!\n");
+            return -1;
         }
         /* 指向下一个空间 */
         space = space->next;
     }
-    kfree(buf);
     return 0; 
 }
 
 PRIVATE int CopyVMSpace(struct Task *childTask, struct Task *parentTask)
 {
-    /* 空间头 */
-    struct VMSpace *tail = NULL;
     /* 指向父任务的空间 */
     struct VMSpace *p = parentTask->mm->spaceMap;
     while (p != NULL) {
         /* 分配一个空间 */
-        struct VMSpace *space = (struct VMSpace *)kmalloc(
-                sizeof(struct VMSpace), GFP_KERNEL);
+        struct VMSpace *space = AllocVMSpace();
         if (space == NULL) {
-            printk(PART_ERROR "CopyVMSpace: kmalloc for space failed!\n");
+            printk(PART_ERROR "CopyVMSpace: alloc for space failed!\n");
             return -1;
         }
             
         /* 复制空间信息 */
         *space = *p;
-        /* 把下一个空间置空，后面加入链表 */
-        space->next = NULL;
-
-        /* 如果空间表头是空，那么就让空间表头指向第一个space */
-        if (tail == NULL)
-            childTask->mm->spaceMap = space;    
-        else 
-            tail->next = space; /* 让空间位于子任务的空间表的最后面 */
+        
+        /* 子进程的空间也引用映射的文件 */
+        if (space->file >= 0)
+            FileMapDup(space->file);
 
-        /* 让空间头指向新添加的空间 */
-        tail = space;
+        /* 插入到子任务的空间链表和树中，父任务的空间是有序的，所以总是在最后面 */
+        InsertVMSpace(childTask->mm, space);
 
         /* 获取下一个空间 */
         p = p->next;
@@ -16,8 +16,6 @@
 /* 导入主idle线程 */
 EXTERN Task_t *taskIdle;
 
-EXTERN struct List taskPriorityQueue[MAX_PRIORITY_NR];
-
 /** 
  * SwitchTo - 任务切换的核心
  * @prev: 当前任务
@@ -71,17 +69,7 @@ PRIVATE void ScheduleTryWakeupIdle()
 PRIVATE Task_t *SchedulePickTask()
 {
     /* 一定能够找到一个任务，因为最后的是idle任务 */
-    Task_t *task;
-    int i;
-    for (i = 0; i < MAX_PRIORITY_NR; i++) {
-        /* 如果有任务，才获取 */
-        if (!ListEmpty(&taskPriorityQueue[i])) {
-            task = ListFirstOwner(&taskPriorityQueue[i], Task_t, list);
-            ListDel(&task->list);
-            break;
-        }
-    }
-    return task;
+    return TaskPriorityQueueFetchFirst();
 }
 
 /**
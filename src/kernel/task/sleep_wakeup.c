@@ -91,10 +91,16 @@ PUBLIC uint32_t TaskSleep(uint32_t ticks)
      */
     //RemoveTimer(&timer);
 
+    /* 不是定时器唤醒的，定时器还在链表中，由于定时器在栈上，必须移除 */
+    flags = InterruptSave();
+    uint32_t left = TimerLeftTicks(&timer);
+    RemoveTimer(&timer);
+    InterruptRestore(flags);
+
     current->sleepTimer = NULL; /* 取消休眠定时器 */
     
-    // printk("@@@sleep wake up ticks %d\n", timer.expires);
-    return timer.expires;
+    // printk("@@@sleep wake up ticks %d\n", left);
+    return left;
 }
 
 /**
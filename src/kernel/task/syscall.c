@@ -13,6 +13,7 @@
 #include <book/fs.h>
 #include <book/kgc.h>
 #include <book/mmu.h>
+#include <book/memcache.h>
 #include <book/power.h>
 #include <clock/clock.h>
 #include <char/console/console.h>
@@ -84,6 +85,9 @@ syscall_t syscallTable[MAX_SYSCALL_NR] = {
     SysRedirect,            /* 55 */
     SysReboot,              /* 56 */
     SysGetVersion,          /* 57 */
+    SysGetITimer,           /* 58 */
+    SysSetITimer,           /* 59 */
+    SysMemCacheScan,        /* 60 */
 };
 
 /**
@@ -14,8 +14,14 @@
 #include <book/semaphore.h>
 #include <book/mutex.h>
 #include <book/spinlock.h>
+#include <book/bitops.h>
+#include <book/alarm.h>
+#include <clock/clock.h>
 #include <lib/string.h>
 
+/* 入队时检查任务是否已经在就绪队列中，需要遍历队列，只在调试调度时打开 */
+//#define _DEBUG_RUNQUEUE
+
 /**
  * SwitchToUser - 跳转到用户态执行的开关 
  * @frame: 中断栈
@@ -35,6 +41,9 @@ PUBLIC LIST_HEAD(taskGlobalList);
 /* 优先级队列链表 */
 PROTECT struct List taskPriorityQueue[MAX_PRIORITY_NR];
 
+/* 优先级队列位图，队列中有任务时对应的位为1 */
+PRIVATE unsigned int taskPriorityBitmap;
+
 /* idle任务 */
 PUBLIC Task_t *taskIdle;
 /**
@@ -205,13 +214,17 @@ PRIVATE void TaskInit(struct Task *thread, char *name, int priority)
     InitSignalInTask(thread);
 
     /* 设置闹钟 */
-    thread->alarm = 0;  /* 不设置闹钟 */
-    thread->alarmTicks = 0;     /* 闹钟ticks为0 */
-    thread->alarmSeconds = 0;   /* 闹钟时间为0 */
+    AlarmInit(thread);  /* 不设置闹钟 */
     
     /* 休眠定时器 */
     thread->sleepTimer = NULL;
 
+    /* 就绪队列统计 */
+    thread->readyStamp = 0;
+    thread->waitTicks = 0;
+    thread->maxWaitTicks = 0;
+    thread->switches = 0;
+
     /* 窗口为空 */
     thread->window = NULL;
 }
@@ -267,9 +280,14 @@ PUBLIC void FreeTaskMemory(struct Task *task)
 PUBLIC void TaskPriorityQueueAddTail(struct Task *task)
 {
     /* 添加到相应的优先级队列 */
+#ifdef _DEBUG_RUNQUEUE
     ASSERT(!ListFind(&task->list, &taskPriorityQueue[task->priority]));
+#endif
     // 添加到就绪队列
     ListAddTail(&task->list, &taskPriorityQueue[task->priority]);
+    taskPriorityBitmap |= 1 << task->priority;
+    task->readyStamp = systicks;
+    task->onRunQueue = 1;
 }
 
 /**
@@ -280,9 +298,53 @@ PUBLIC void TaskPriorityQueueAddTail(struct Task *task)
 PUBLIC void TaskPriorityQueueAddHead(struct Task *task)
 {
     /* 添加到相应的优先级队列 */
+#ifdef _DEBUG_RUNQUEUE
     ASSERT(!ListFind(&task->list, &taskPriorityQueue[task->priority]));
+#endif
     // 添加到就绪队列
     ListAdd(&task->list, &taskPriorityQueue[task->priority]);
+    taskPriorityBitmap |= 1 << task->priority;
+    task->readyStamp = systicks;
+    task->onRunQueue = 1;
+}
+
+/**
+ * TaskPriorityQueueDel - 把任务从特权级队列中删除
+ * @task: 任务
+ * 
+ * 队列空了之后，清除位图中对应的位
+ */
+PUBLIC void TaskPriorityQueueDel(struct Task *task)
+{
+    ListDelInit(&task->list);
+    task->onRunQueue = 0;
+    if (ListEmpty(&taskPriorityQueue[task->priority]))
+        taskPriorityBitmap &= ~(1 << task->priority);
+}
+
+/**
+ * TaskPriorityQueueFetchFirst - 取出优先级最高的第一个任务
+ * 
+ * 通过位图直接找到优先级最高的非空队列，并记录任务在队列中等待的时间
+ * 队列都为空时返回NULL
+ */
+PUBLIC struct Task *TaskPriorityQueueFetchFirst()
+{
+    if (!taskPriorityBitmap)
+        return NULL;
+    
+    unsigned int priority = FindFirstSetBit(taskPriorityBitmap);
+    struct Task *task = ListFirstOwner(&taskPriorityQueue[priority], struct Task, list);
+    TaskPriorityQueueDel(task);
+
+    /* 更新就绪队列统计 */
+    uint32_t wait = systicks - task->readyStamp;
+    task->waitTicks += wait;
+    if (wait > task->maxWaitTicks)
+        task->maxWaitTicks = wait;
+    task->switches++;
+    
+    return task;
 }
 
 /**
@@ -299,33 +361,33 @@ PUBLIC void TaskGloablListAdd(struct Task *task)
 }
 
 /**
- * IsTaskInPriorityQueue - 把任务添加到全局队列
+ * IsTaskInPriorityQueue - 判断任务是否在就绪队列中
  * @task: 任务
+ * 
+ * 直接使用队列操作维护的标志，不用遍历所有队列，
+ * 调试就绪队列时再用遍历的结果进行校验
  */
 PUBLIC int IsTaskInPriorityQueue(struct Task *task)
 {
-    int i;
+#ifdef _DEBUG_RUNQUEUE
+    int i, found = 0;
     for (i = 0; i < MAX_PRIORITY_NR; i++) {
         if (ListFind(&task->list, &taskPriorityQueue[i])) {
-            return 1;
+            found = 1;
+            break;
         }
     }
-    return 0;
+    ASSERT(found == task->onRunQueue);
+#endif
+    return task->onRunQueue;
 }
 
-
 /**
  * IsAllPriorityQueueEmpty - 判断优先级队列是否为空
  */
 PUBLIC int IsAllPriorityQueueEmpty()
 {
-    int i;
-    for (i = 0; i < MAX_PRIORITY_NR; i++) {
-        if (!ListEmpty(&taskPriorityQueue[i])) {
-            return 0;
-        }
-    }
-    return 1;
+    return !taskPriorityBitmap;
 }
 
 /**
@@ -459,8 +521,6 @@ PUBLIC void TaskUnblock(struct Task *task)
 
     // 没有就绪才能够唤醒，并且就绪
     if (task->status != TASK_READY) {
-        // 保证没有在就绪队列中
-        ASSERT(!IsTaskInPriorityQueue(task));
         // 已经就绪是不能再次就绪的
         if (IsTaskInPriorityQueue(task)) {
             Panic("TaskUnblock: task has already in ready list!\n");
@@ -747,6 +807,9 @@ PUBLIC int SysTaskScan(taskscan_status_t *ts, unsigned int *idx)
             ts->ts_priority = task->priority;
             ts->ts_ticks = task->ticks;
             ts->ts_runticks = task->elapsedTicks;
+            ts->ts_waitticks = task->waitTicks;
+            ts->ts_maxwait = task->maxWaitTicks;
+            ts->ts_switches = task->switches;
             memset(ts->ts_name, 0, 32);
             strcpy(ts->ts_name, task->name);
             *idx = *idx + 1;
@@ -845,6 +908,7 @@ PUBLIC void InitTasks()
     for (i = 0; i < MAX_PRIORITY_NR; i++) {
         INIT_LIST_HEAD(&taskPriorityQueue[i]);
     }
+    taskPriorityBitmap = 0;
 
     /* 跳过init进程的pid = 0，后面执行init的时候会把它的pid设置为0*/
     nextPid = 1;
@@ -9,35 +9,77 @@
 #include <book/debug.h>
 #include <book/task.h>
 #include <book/signal.h>
+#include <book/alarm.h>
 #include <clock/clock.h>
 
+/*
+ * 每个任务都有一个闹钟定时器，挂在定时器时间轮上，
+ * 到期的时候才会处理，不需要每个tick都遍历所有任务。
+ */
+
 /**
- * UpdateAlarmSystem - 更新闹钟系统
+ * AlarmTimeout - 闹钟到期
+ * @data: 闹钟所属的任务
  * 
- * 由于闹钟的基本单位是秒，所以更新也是1s执行一次
+ * 发送SIGALRM信号，如果设置了周期，就再次启动定时器
+ */
+PRIVATE void AlarmTimeout(uint32_t data)
+{
+    struct Task *task = (struct Task *)data;
+
+    //printk("alarm! %d\n", task->pid);
+    ForceSignal(SIGALRM, task->pid);
+
+    if (task->alarmInterval) {
+        TimerInit(&task->alarmTimer, task->alarmInterval, data, AlarmTimeout);
+        AddTimer(&task->alarmTimer);
+    }
+}
+
+/**
+ * AlarmInit - 初始化任务的闹钟
+ * @task: 任务
+ */
+PUBLIC void AlarmInit(struct Task *task)
+{
+    TimerInit(&task->alarmTimer, 0, (uint32_t)task, AlarmTimeout);
+    task->alarmInterval = 0;
+}
+
+/**
+ * AlarmSet - 设置任务的闹钟
+ * @task: 任务
+ * @ticks: 到期的ticks数，为0就取消闹钟
+ * @interval: 周期ticks数，为0就只触发一次
  * 
+ * 返回上次剩余的ticks数
  */
-PUBLIC void UpdateAlarmSystem()
+PUBLIC uint32_t AlarmSet(struct Task *task, uint32_t ticks, uint32_t interval)
 {
-    struct Task *task;
-    ListForEachOwner(task, &taskGlobalList, globalList) {
-        if (task->alarm) {
-            task->alarmTicks--;
-            if (!task->alarmTicks) {
-                //printk("a");
-                task->alarmSeconds--;
-
-                /* alarmTicks和时钟相关 */
-                task->alarmTicks = HZ; 
-                /* 如果时间结束，那么就发送SIGALRM信号 */
-                if (!task->alarmSeconds) {
-                    //printk("alarm! %d\n", task->pid);
-                    ForceSignal(SIGALRM, task->pid);
-                    task->alarm = 0;
-                }
-            }
-        }
+    unsigned long flags = InterruptSave();
+
+    uint32_t left = TimerLeftTicks(&task->alarmTimer);
+
+    /* 先取消之前的闹钟 */
+    RemoveTimer(&task->alarmTimer);
+    AlarmInit(task);
+
+    if (ticks) {
+        task->alarmInterval = interval;
+        TimerInit(&task->alarmTimer, ticks, (uint32_t)task, AlarmTimeout);
+        AddTimer(&task->alarmTimer);
     }
+    InterruptRestore(flags);
+    return left;
+}
+
+/**
+ * AlarmCancel - 取消任务的闹钟
+ * @task: 任务
+ */
+PUBLIC void AlarmCancel(struct Task *task)
+{
+    AlarmSet(task, 0, 0);
 }
 
 /**
@@ -51,20 +93,80 @@ PUBLIC void UpdateAlarmSystem()
  */
 PUBLIC unsigned int SysAlarm(unsigned int seconds)
 {
+    uint32_t left = AlarmSet(CurrentTask(), seconds * HZ, 0);
+    
+    /* 不足1秒的按照1秒返回 */
+    return (left + HZ - 1) / HZ;
+}
+
+/**
+ * TimevalToTicks - 把时间转换成ticks
+ * @tv: 时间
+ * 
+ * 不足1个tick的部分按照1个tick计算
+ */
+PRIVATE uint32_t TimevalToTicks(struct timeval *tv)
+{
+    return tv->tv_sec * HZ + ((unsigned long)tv->tv_usec * HZ + 999999) / 1000000;
+}
+
+/**
+ * TicksToTimeval - 把ticks转换成时间
+ * @ticks: ticks数
+ * @tv: 时间
+ */
+PRIVATE void TicksToTimeval(uint32_t ticks, struct timeval *tv)
+{
+    tv->tv_sec = ticks / HZ;
+    tv->tv_usec = (ticks % HZ) * (1000000 / HZ);
+}
+
+/**
+ * SysGetITimer - 获取间隔定时器
+ * @which: 定时器类型，目前只支持ITIMER_REAL
+ * @value: 保存定时器的值
+ * 
+ * 成功返回0，失败返回-1
+ */
+PUBLIC int SysGetITimer(int which, struct itimerval *value)
+{
+    if (which != ITIMER_REAL || value == NULL)
+        return -1;
+    
     struct Task *cur = CurrentTask();
+    unsigned long flags = InterruptSave();
+    TicksToTimeval(TimerLeftTicks(&cur->alarmTimer), &value->it_value);
+    TicksToTimeval(cur->alarmInterval, &value->it_interval);
+    InterruptRestore(flags);
+    return 0;
+}
 
-    /* 需要返回上次剩余的秒数 */
-    unsigned int oldSeconds = cur->alarmSeconds;
-
-    if (seconds == 0) {
-        cur->alarm = 0;     /* 取消闹钟 */
-    } else {
-        cur->alarm = 1;     /* 定时器生效 */
-        cur->alarmSeconds = seconds;    /* 设定秒数 */
-        cur->alarmTicks = HZ; /* 设置ticks数 */
-        
-        //printk("alarm seconds %d ticks %d\n", seconds, cur->alarmTicks);
+/**
+ * SysSetITimer - 设置间隔定时器
+ * @which: 定时器类型，目前只支持ITIMER_REAL
+ * @value: 新的定时器的值，it_value为0就取消定时器
+ * @oldValue: 不为NULL时保存原来的定时器的值
+ * 
+ * 和闹钟使用同一个定时器，到期后发送SIGALRM信号
+ * 成功返回0，失败返回-1
+ */
+PUBLIC int SysSetITimer(int which, struct itimerval *value, struct itimerval *oldValue)
+{
+    if (which != ITIMER_REAL || value == NULL)
+        return -1;
+    
+    if (value->it_value.tv_usec < 0 || value->it_value.tv_usec >= 1000000 ||
+        value->it_interval.tv_usec < 0 || value->it_interval.tv_usec >= 1000000)
+        return -1;
+    
+    struct Task *cur = CurrentTask();
+    uint32_t interval = cur->alarmInterval;
+    uint32_t left = AlarmSet(cur, TimevalToTicks(&value->it_value),
+        TimevalToTicks(&value->it_interval));
+    
+    if (oldValue) {
+        TicksToTimeval(left, &oldValue->it_value);
+        TicksToTimeval(interval, &oldValue->it_interval);
     }
-    //printk("alarm ret %d\n", oldSeconds);
-    return oldSeconds;
+    return 0;
 }
@@ -15,8 +15,32 @@
 
 //#define TIMER_TEST
 
-/* 定时器链表 */
-PUBLIC struct List timerList;
+/*
+ * 定时器时间轮，参考linux的分级时间轮
+ * 定时器按照到期的绝对时间（ticks）挂在对应的槽上，添加和删除都是O(1)。
+ * 第一级有256个槽，每个槽对应1个tick；后面4级各有64个槽，
+ * 每个槽对应的时间范围依次扩大64倍。每当第一级转完一圈，
+ * 就把上一级对应槽中的定时器重新分散到下一级中。
+ * 每个tick只需要处理第一级当前槽中的定时器。
+ */
+#define TVN_BITS    6
+#define TVR_BITS    8
+#define TVN_SIZE    (1 << TVN_BITS)
+#define TVR_SIZE    (1 << TVR_BITS)
+#define TVN_MASK    (TVN_SIZE - 1)
+#define TVR_MASK    (TVR_SIZE - 1)
+
+/* 除了第一级之外的级数 */
+#define TVN_LEVELS  4
+
+/* 第一级时间轮 */
+PRIVATE struct List timerVectorRoot[TVR_SIZE];
+
+/* 其它级的时间轮 */
+PRIVATE struct List timerVector[TVN_LEVELS][TVN_SIZE];
+
+/* 时间轮下一次要处理的ticks */
+PRIVATE unsigned long timerTicks;
 
 /**
  * TimerInit - 初始化一个定时器
@@ -24,6 +48,8 @@ PUBLIC struct List timerList;
  * @expires: 时间（ticks为单位）
  * @data: 传递的参数
  * @function: 要执行的函数
+ * 
+ * 在添加定时器的时候，会把expires转换成到期的绝对时间
  */
 PUBLIC void TimerInit(struct Timer *timer, uint64_t expires, uint32_t data,
         void (*function)(uint32_t))
@@ -42,37 +68,65 @@ PUBLIC void TimerInit(struct Timer *timer, uint64_t expires, uint32_t data,
     timer->next = NULL;
 }
 
-PUBLIC void DoTimerHandler(struct Timer *timer)
+/**
+ * InternalAddTimer - 把定时器挂到时间轮上
+ * @timer: 定时器，expires为到期的绝对时间
+ * 
+ * 需要在关闭中断的情况下调用
+ */
+PRIVATE void InternalAddTimer(struct Timer *timer)
 {
-    /* 执行完后应该把定时器从链表中删除，以后不再执行 */
-    RemoveTimer(timer);
-    timer->function(timer->data);
+    unsigned long expires = (unsigned long)timer->expires;
+    unsigned long idx = expires - timerTicks;
+    struct List *vec;
+    int level;
+
+    if ((long)idx < 0) {
+        /* 已经过期了，在下一个tick处理 */
+        vec = &timerVectorRoot[timerTicks & TVR_MASK];
+    } else if (idx < TVR_SIZE) {
+        vec = &timerVectorRoot[expires & TVR_MASK];
+    } else {
+        /* 找到能够容纳该时间的级 */
+        for (level = 0; level < TVN_LEVELS - 1; level++) {
+            if (idx < (1UL << (TVR_BITS + (level + 1) * TVN_BITS)))
+                break;
+        }
+        vec = &timerVector[level][(expires >> (TVR_BITS + level * TVN_BITS)) & TVN_MASK];
+    }
+    ListAddTail(&timer->list, vec);
 }
 
 /**
- * TimerUpdate - 定时器更新
- * @timer: 要更新的定时器
+ * CascadeTimers - 把某一级槽中的定时器重新分散到下一级
+ * @level: 级
+ * @index: 槽的索引
  * 
- * 如果定时器到期了，就执行定时器里面的函数，并传递参数过去
- * 不然就直接返回
+ * 返回槽的索引，为0时说明这一级也转完了一圈，需要继续处理上一级
  */
-PUBLIC bool TimerUpdate(struct Timer *timer)
+PRIVATE int CascadeTimers(int level, int index)
 {
-    /* 运行中才更新 */
-    if (timer->state == TIMER_RUNNING) {
-        
-        /* 减少计数 */
-        --timer->expires;
+    struct List list;
+    struct Timer *timer, *next;
 
-        /* 定时器到期就执行函数 */
-        if (timer->expires == 0){
-            DoTimerHandler(timer);
-            /* 使用过后就变成无效的了 */
-            timer->state = TIMER_INVALID;
-            return true;
-        }
+    if (ListEmpty(&timerVector[level][index]))
+        return index;
+    
+    /* 先把整个槽摘下来，再重新添加 */
+    ListReplaceInit(&timerVector[level][index], &list);
+    ListForEachOwnerSafe(timer, next, &list, list) {
+        InternalAddTimer(timer);
     }
-	return false;
+    return index;
+}
+
+PUBLIC void DoTimerHandler(struct Timer *timer)
+{
+    /* 执行完后应该把定时器从链表中删除，以后不再执行 */
+    RemoveTimer(timer);
+    /* 使用过后就变成无效的了，处理函数里面可以再次添加 */
+    timer->state = TIMER_INVALID;
+    timer->function(timer->data);
 }
 
 /**
@@ -88,12 +142,15 @@ PUBLIC void AddTimer(struct Timer *timer)
     unsigned long flags = InterruptSave();
     
 	/* 保证定时器不在队列里面 */
-	ASSERT(!ListFind(&timer->list, &timerList));
+	ASSERT(ListEmpty(&timer->list));
 
     timer->state = TIMER_RUNNING;
 
-	/* 添加到队列 */
-	ListAddTail(&timer->list, &timerList);
+    /* 转换成到期的绝对时间 */
+    timer->expires = systicks + (unsigned long)timer->expires;
+
+	/* 添加到时间轮 */
+	InternalAddTimer(timer);
 
 	/* 恢复之前的中断状态 */
 	InterruptRestore(flags);
@@ -108,26 +165,54 @@ PUBLIC void RemoveTimer(struct Timer *timer)
 	/* 保存状态并关闭中断 */
     unsigned long flags = InterruptSave();
     
-	/* 保证定时器在队列里面 */
-	ASSERT(ListFind(&timer->list, &timerList));
-	/* 从队列中删除 */
+	/* 从时间轮中删除，不在时间轮上时什么也不做 */
 	ListDelInit(&timer->list);
 
 	/* 恢复之前的中断状态 */
 	InterruptRestore(flags);
 }
 
+/**
+ * TimerLeftTicks - 获取定时器剩余的ticks
+ * @timer: 定时器
+ * 
+ * 定时器不在运行中时返回0
+ */
+PUBLIC uint32_t TimerLeftTicks(struct Timer *timer)
+{
+    unsigned long flags = InterruptSave();
+    uint32_t left = 0;
+    
+    if (timer->state == TIMER_RUNNING) {
+        long diff = (long)((unsigned long)timer->expires - systicks);
+        if (diff > 0)
+            left = diff;
+    } else if (timer->state == TIMER_STOP) {
+        /* 停止时expires保存的是剩余时间 */
+        left = (uint32_t)timer->expires;
+    }
+    InterruptRestore(flags);
+    return left;
+}
+
 /**
  * StopTimer - 停止一个定时器
  * @timer: 定时器
+ * 
+ * 从时间轮上摘下来，并记录剩余的时间，恢复的时候继续计时
  */
 PUBLIC void StopTimer(struct Timer *timer)
 {
 	/* 保存状态并关闭中断 */
     unsigned long flags = InterruptSave();
     
-    /* 设置成停止状态 */
-    timer->state = TIMER_STOP;
+    if (timer->state == TIMER_RUNNING) {
+        timer->expires = TimerLeftTicks(timer);
+        ListDelInit(&timer->list);
+
+        /* 设置成停止状态 */
+        timer->state = TIMER_STOP;
+    }
 
 	/* 恢复之前的中断状态 */
 	InterruptRestore(flags);
@@ -142,8 +227,10 @@ PUBLIC void ResumeTimer(struct Timer *timer)
 	/* 保存状态并关闭中断 */
     unsigned long flags = InterruptSave();
     
-    /* 设置成停止状态 */
-    timer->state = TIMER_RUNNING;
+    /* 用剩余的时间重新添加 */
+    if (timer->state == TIMER_STOP) {
+        AddTimer(timer);
+    }
     
 	/* 恢复之前的中断状态 */
 	InterruptRestore(flags);
@@ -161,15 +248,36 @@ PUBLIC void CancelTimer(struct Timer *timer)
 
 /**
  * UpdateTimerSystem - 更新定时器系统
+ * 
+ * 从上次处理到的ticks开始，一直处理到当前ticks，
+ * 每个tick只处理第一级时间轮中当前槽的定时器
  */
 PUBLIC void UpdateTimerSystem()
 {
     unsigned long flags = InterruptSave();
-	struct Timer *timer, *next;
-	/* 因为有可能会在更新后把定时器删除，所以这里要用安全 */
-	ListForEachOwnerSafe(timer, next, &timerList, list) {
-		TimerUpdate(timer);
-	}
+	struct Timer *timer;
+    struct List *head;
+    int index, level;
+
+    while ((long)(systicks - timerTicks) >= 0) {
+        index = timerTicks & TVR_MASK;
+        
+        /* 第一级转完一圈，从上一级搬运定时器下来 */
+        if (!index) {
+            for (level = 0; level < TVN_LEVELS; level++) {
+                if (CascadeTimers(level, (timerTicks >> (TVR_BITS + level * TVN_BITS)) & TVN_MASK))
+                    break;
+            }
+        }
+        ++timerTicks;
+
+        /* 处理函数里面可能会添加或删除定时器，所以每次都从头获取 */
+        head = &timerVectorRoot[index];
+        while (!ListEmpty(head)) {
+            timer = ListFirstOwner(head, struct Timer, list);
+            DoTimerHandler(timer);
+        }
+    }
     InterruptRestore(flags);
 }
 
@@ -185,8 +293,17 @@ PRIVATE void TimerTest(uint32_t data)
  */
 PUBLIC void InitTimer()
 {
-	/* 初始化定时器链表头 */
-	INIT_LIST_HEAD(&timerList);
+	int i, j;
+	/* 初始化时间轮 */
+	for (i = 0; i < TVR_SIZE; i++) {
+		INIT_LIST_HEAD(&timerVectorRoot[i]);
+	}
+	for (i = 0; i < TVN_LEVELS; i++) {
+		for (j = 0; j < TVN_SIZE; j++) {
+			INIT_LIST_HEAD(&timerVector[i][j]);
+		}
+	}
+	timerTicks = systicks;
 
 	/*
 	struct Timer *timer = kmalloc(sizeof(struct Timer), GFP_KERNEL);